@@ -0,0 +1,93 @@
+#ifndef CATEGORY_DICTIONARY_H
+#define CATEGORY_DICTIONARY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace zerocost {
+
+/**
+ * Process-wide table of category names, case-folded, mapped to small dense
+ * ids. Stored events are interned so ranking compares ids instead of
+ * strings; requests only look names up, so their size is bounded by what
+ * the store has seen. Ids are never reused, so they stay valid for the
+ * process.
+ */
+class CategoryDictionary {
+public:
+    static constexpr uint32_t NONE = std::numeric_limits<uint32_t>::max();
+    static constexpr size_t MAX_CATEGORIES = size_t(1) << 16;
+    static constexpr size_t MAX_NAME_LENGTH = 64;
+
+    /**
+     * The dictionary shared by every request and the event store.
+     */
+    static CategoryDictionary& global();
+
+    /**
+     * Id of a category, adding it if it is new. Safe from any thread.
+     *
+     * @param name Category name (matched case-insensitively)
+     * @return The id, or NONE if the name is too long or the table is full
+     */
+    uint32_t intern(std::string_view name);
+
+    /**
+     * Id of a category, or NONE if it has never been interned.
+     */
+    uint32_t find(std::string_view name) const;
+
+    size_t size() const;
+
+private:
+    static bool fold(std::string_view name, std::string& key);
+
+    mutable std::shared_mutex mutex_;
+    std::unordered_map<std::string, uint32_t> ids_;
+};
+
+/**
+ * A request's preferred categories as a bitmask over dictionary ids, built
+ * once per request so scoring an event is a single AND.
+ */
+class CategoryMask {
+public:
+    CategoryMask() = default;
+
+    /**
+     * Look up each preferred category; names never interned match nothing.
+     */
+    explicit CategoryMask(const std::vector<std::string>& preferred_categories);
+
+    bool contains(uint32_t category_id) const {
+        size_t word = category_id >> 6;
+        return word < words_.size() && (words_[word] >> (category_id & 63) & 1) != 0;
+    }
+
+    /**
+     * Category preference score: 0.5 without preferences, 1.0 for a
+     * preferred category and 0.3 otherwise.
+     */
+    double score(uint32_t category_id) const {
+        if (!active_) {
+            return 0.5;
+        }
+        return contains(category_id) ? 1.0 : 0.3;
+    }
+
+    bool active() const { return active_; }
+
+private:
+    std::vector<uint64_t> words_;
+    bool active_ = false;  // The request listed preferences
+};
+
+} // namespace zerocost
+
+#endif // CATEGORY_DICTIONARY_H
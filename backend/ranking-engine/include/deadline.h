@@ -0,0 +1,59 @@
+#ifndef DEADLINE_H
+#define DEADLINE_H
+
+#include <chrono>
+#include <stdexcept>
+#include <string>
+
+namespace zerocost {
+
+/**
+ * Thrown by Deadline::check when a request has run out of time.
+ * HttpServer maps it to 504 Gateway Timeout.
+ */
+class DeadlineExceeded : public std::runtime_error {
+public:
+    explicit DeadlineExceeded(const std::string& stage)
+        : std::runtime_error("deadline exceeded before " + stage) {}
+};
+
+/**
+ * Point in time after which a request's result is no longer useful.
+ * A default-constructed deadline never expires.
+ */
+class Deadline {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    Deadline() : at_(Clock::time_point::max()) {}
+    explicit Deadline(Clock::time_point at) : at_(at) {}
+
+    static Deadline after(Clock::time_point start, std::chrono::milliseconds budget) {
+        return Deadline(start + budget);
+    }
+
+    bool expired() const {
+        return at_ != Clock::time_point::max() && Clock::now() >= at_;
+    }
+
+    /**
+     * Cooperative cancellation point between pipeline stages.
+     *
+     * @param stage Name of the stage about to run (for the error message)
+     * @throws DeadlineExceeded if the deadline has passed
+     */
+    void check(const char* stage) const {
+        if (expired()) {
+            throw DeadlineExceeded(stage);
+        }
+    }
+
+    Clock::time_point time_point() const { return at_; }
+
+private:
+    Clock::time_point at_;
+};
+
+} // namespace zerocost
+
+#endif // DEADLINE_H
@@ -1,8 +1,14 @@
 #ifndef DISTANCE_H
 #define DISTANCE_H
 
+#include <cmath>
+
 namespace zerocost {
 
+constexpr double EARTH_RADIUS_KM = 6371.0;
+constexpr double PI = 3.14159265358979323846;
+constexpr double DEGREES_TO_RADIANS = PI / 180.0;
+
 /**
  * Calculate the great-circle distance between two points on Earth
  * using the Haversine formula.
@@ -24,6 +30,118 @@ double haversine_distance(double lat1, double lon1, double lat2, double lon2);
  */
 double calculate_distance_score(double distance_km, double max_distance_km);
 
+/**
+ * Point on the unit sphere, for distance checks without trigonometry.
+ * Computed once per event and stored alongside it.
+ */
+struct UnitVector {
+    double x;
+    double y;
+    double z;
+};
+
+/**
+ * Convert a latitude/longitude to a point on the unit sphere
+ * 
+ * @param latitude Latitude (degrees)
+ * @param longitude Longitude (degrees)
+ * @return Unit vector
+ */
+UnitVector to_unit_vector(double latitude, double longitude);
+
+/**
+ * Squared straight-line (chord) distance between two unit vectors.
+ * Increases with great-circle distance, so radius checks can compare it
+ * against max_chord_squared instead of computing distances.
+ */
+inline double chord_squared(const UnitVector& a, double x, double y, double z) {
+    double dx = a.x - x;
+    double dy = a.y - y;
+    double dz = a.z - z;
+    return dx * dx + dy * dy + dz * dz;
+}
+
+/**
+ * Squared chord of a great-circle distance
+ * 
+ * @param distance_km Distance in kilometers
+ * @return Squared chord; points within distance_km have a chord_squared at most this
+ */
+double max_chord_squared(double distance_km);
+
+/**
+ * Great-circle distance of a squared chord (the same value
+ * haversine_distance gives for the two points)
+ * 
+ * @param chord_sq Result of chord_squared
+ * @return Distance in kilometers
+ */
+double chord_distance(double chord_sq);
+
+/*
+ * Approximate distance mode. Within APPROXIMATE_DISTANCE_MAX_KM of a point
+ * no nearer the poles than APPROXIMATE_DISTANCE_MAX_LATITUDE, an
+ * equirectangular projection around it (scaled by the cosine of the mid
+ * latitude) stays within APPROXIMATE_DISTANCE_MAX_ERROR of haversine,
+ * relative: 10 m at 100 km. Measured worst cases are 2.3e-5 at 50 km and
+ * 9.2e-5 at 100 km, both at 70 degrees latitude (tests/distance_test).
+ */
+constexpr double APPROXIMATE_DISTANCE_MAX_KM = 100.0;
+constexpr double APPROXIMATE_DISTANCE_MAX_LATITUDE = 70.0;
+constexpr double APPROXIMATE_DISTANCE_MAX_ERROR = 2e-4;
+
+/**
+ * Terms of the equirectangular projection around one point, computed once
+ * per request.
+ */
+struct LocalProjection {
+    double latitude;        // Radians
+    double longitude;       // Radians
+    double cos_latitude;
+    double sin_latitude;
+};
+
+/**
+ * Check whether approximate_distance is within its error bound for
+ * distances up to max_distance_km from a point at this latitude
+ */
+inline bool approximate_distance_applies(double latitude, double max_distance_km) {
+    return max_distance_km <= APPROXIMATE_DISTANCE_MAX_KM &&
+           std::fabs(latitude) <= APPROXIMATE_DISTANCE_MAX_LATITUDE;
+}
+
+/**
+ * Prepare the projection around a point
+ * 
+ * @param latitude Latitude of the origin (degrees)
+ * @param longitude Longitude of the origin (degrees)
+ */
+LocalProjection make_local_projection(double latitude, double longitude);
+
+/**
+ * Approximate great-circle distance from origin: one square root and no
+ * trigonometry. Within APPROXIMATE_DISTANCE_MAX_ERROR of haversine_distance
+ * (relative) when approximate_distance_applies; never less than the
+ * north-south separation, so points far away are never approximated into
+ * range.
+ * 
+ * @param origin Projection around the user
+ * @param latitude Latitude of the other point (degrees)
+ * @param longitude Longitude of the other point (degrees)
+ * @return Distance in kilometers
+ */
+inline double approximate_distance(const LocalProjection& origin, double latitude, double longitude) {
+    double dlat = latitude * DEGREES_TO_RADIANS - origin.latitude;
+    double dlon = longitude * DEGREES_TO_RADIANS - origin.longitude;
+    dlon = dlon > PI ? dlon - 2.0 * PI : (dlon < -PI ? dlon + 2.0 * PI : dlon);
+    
+    // cos(mid latitude) from the origin's terms, to second order in the offset
+    double half = dlat * 0.5;
+    double cos_mid = origin.cos_latitude * (1.0 - half * half * 0.5) - origin.sin_latitude * half;
+    double x = dlon * cos_mid;
+    return EARTH_RADIUS_KM * std::sqrt(x * x + dlat * dlat);
+}
+
 } // namespace zerocost
 
 #endif // DISTANCE_H
@@ -0,0 +1,59 @@
+#ifndef EMBEDDING_H
+#define EMBEDDING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace zerocost {
+
+// Longest embedding accepted at ingest or in a request
+constexpr size_t MAX_EMBEDDING_DIMENSIONS = 4096;
+
+/**
+ * Quantize a float embedding to int8: every value is scaled by
+ * 127 / max |value| and rounded. Cosine similarity does not depend on the
+ * scale, so it is not kept; an all-zero vector stays all zeros.
+ *
+ * @param codes Replaced with one code per value
+ * @throws std::invalid_argument if a value is not finite or there are
+ *         more than MAX_EMBEDDING_DIMENSIONS
+ */
+void quantize_embedding(const std::vector<double>& values, std::vector<int8_t>& codes);
+
+/**
+ * Cosine similarity of int8 embeddings against one query embedding.
+ * Each comparison is a single pass over the event's codes that
+ * accumulates the dot product with the query and the event's own squared
+ * norm in 32-bit integers, vectorized (AVX-512 or AVX2 when the CPU has
+ * it). The query's norm is computed once, here.
+ */
+class EmbeddingQuery {
+public:
+    /**
+     * @param query Quantized query embedding (borrowed), or empty for none
+     */
+    explicit EmbeddingQuery(const std::vector<int8_t>& query);
+
+    bool empty() const { return dimensions_ == 0; }
+
+    /**
+     * Cosine similarity mapped to [0, 1] as (1 + cosine) / 2. 0.5 (as for
+     * orthogonal vectors) when there is no query, the event has no
+     * embedding or one of another length, or either vector is zero.
+     */
+    double similarity(const int8_t* embedding, size_t dimensions) const;
+
+    double similarity(const std::vector<int8_t>& embedding) const {
+        return similarity(embedding.data(), embedding.size());
+    }
+
+private:
+    const int8_t* query_;
+    size_t dimensions_;
+    double inverse_norm_ = 0.0;
+};
+
+} // namespace zerocost
+
+#endif // EMBEDDING_H
@@ -1,12 +1,18 @@
 #ifndef EVENT_H
 #define EVENT_H
 
+#include "deadline.h"
+#include <cstdint>
 #include <string>
 #include <ctime>
+#include <limits>
+#include <memory>
 #include <vector>
 
 namespace zerocost {
 
+struct ScoringProfile;
+
 struct Event {
     std::string id;
     std::string title;
@@ -16,15 +22,26 @@ struct Event {
     std::time_t start_time;
     std::time_t end_time;
     std::string category;
+    uint32_t category_id = std::numeric_limits<uint32_t>::max();  // CategoryDictionary id, NONE if not stored yet
     int view_count;
     int save_count;
     std::time_t created_at;
+    std::vector<int8_t> embedding;  // Quantized (embedding.h); empty if none was supplied
     
     // Calculated fields
     double distance_km;
     double score;
 };
 
+/**
+ * View and save increments for one event (POST /events/interactions).
+ */
+struct Interaction {
+    std::string event_id;
+    int views;
+    int saves;
+};
+
 struct UserLocation {
     double latitude;
     double longitude;
@@ -32,17 +49,82 @@ struct UserLocation {
     std::vector<std::string> preferred_categories;
 };
 
+/**
+ * Optional bounds on an event's start_time, both inclusive (epoch seconds).
+ */
+struct StartWindow {
+    std::time_t after = std::numeric_limits<std::time_t>::min();
+    std::time_t before = std::numeric_limits<std::time_t>::max();
+
+    bool bounded() const {
+        return after != std::numeric_limits<std::time_t>::min() ||
+               before != std::numeric_limits<std::time_t>::max();
+    }
+
+    bool contains(std::time_t start_time) const {
+        return start_time >= after && start_time <= before;
+    }
+};
+
 struct RankingRequest {
     UserLocation user_location;
     std::vector<Event> events;
+    bool has_events = false;  // false: rank the resident event store instead
     double max_distance_km;
     int limit;
+    StartWindow start_window;  // start_after / start_before
+    std::string scoring_profile;  // Profile name, empty for the default
+    std::vector<std::string> scoring_profiles;  // Several profiles, ranked side by side
+    std::string experiment;  // Experiment id standing for a list of profiles
+    // Resolved profiles, the first giving ranked_events; empty scores with the built-in default
+    std::vector<std::shared_ptr<const ScoringProfile>> profiles;
+    bool explain = false;  // Return a score breakdown for each ranked event
+    std::vector<int8_t> query_embedding;  // Quantized like Event::embedding; empty for none
+    Deadline deadline;  // Checked between pipeline stages
+};
+
+/**
+ * How one event's final score was made up: each component score, the
+ * weight the profile gives it and the proximity boost.
+ */
+struct ScoreExplanation {
+    double distance;
+    double urgency;
+    double popularity;
+    double freshness;
+    double category;
+    double text_similarity;
+    double embedding_similarity;
+
+    double weight_distance;
+    double weight_urgency;
+    double weight_popularity;
+    double weight_freshness;
+    double weight_category;
+    double weight_text_similarity;
+    double weight_embedding;
+
+    double boost;  // Factor applied to the weighted sum (1.0 outside the boost radius)
+    double score;  // min(weighted sum * boost, 1.0), or the model's score
+
+    std::string model;  // Model that scored the event, if the profile has one
+};
+
+/**
+ * The ranking one profile gives, when a request is scored with several.
+ */
+struct RankingVariant {
+    std::string profile;
+    std::vector<Event> ranked_events;
+    std::vector<ScoreExplanation> explanations;  // Parallel to ranked_events when explained
 };
 
 struct RankingResponse {
     std::vector<Event> ranked_events;
     int total_count;
     double processing_time_ms;
+    std::vector<RankingVariant> variants;  // One per profile when the request named more than one
+    std::vector<ScoreExplanation> explanations;  // Parallel to ranked_events when the request set explain
 };
 
 } // namespace zerocost
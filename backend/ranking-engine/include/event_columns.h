@@ -0,0 +1,153 @@
+#ifndef EVENT_COLUMNS_H
+#define EVENT_COLUMNS_H
+
+#include "event.h"
+#include "text_index.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace zerocost {
+
+/**
+ * Read-only structure-of-arrays view over a set of events. The arrays are
+ * not owned; they typically point into a request body or a mapped file.
+ *
+ * Strings live in a shared heap. Each event has three consecutive slots in
+ * string_offsets (id, title, description), so slot s spans
+ * [string_offsets[s], string_offsets[s + 1]) of string_heap.
+ */
+struct EventColumns {
+    size_t count = 0;
+    const double* latitude = nullptr;
+    const double* longitude = nullptr;
+    const int64_t* start_time = nullptr;
+    const int64_t* end_time = nullptr;
+    const int64_t* created_at = nullptr;
+    const int32_t* view_count = nullptr;
+    const int32_t* save_count = nullptr;
+    const uint32_t* category_id = nullptr;
+    const uint32_t* string_offsets = nullptr;     // 3 * count + 1 entries
+
+    // to_unit_vector of each row, when precomputed (resident snapshots);
+    // null otherwise
+    const double* unit_x = nullptr;
+    const double* unit_y = nullptr;
+    const double* unit_z = nullptr;
+
+    // Term vector of each row, row i spanning [term_offsets[i], term_offsets[i + 1])
+    // of terms, when precomputed (resident snapshots); null otherwise
+    const uint32_t* term_offsets = nullptr;
+    const TermEntry* terms = nullptr;
+
+    // Quantized embedding of each row, row i spanning [embedding_offsets[i],
+    // embedding_offsets[i + 1]) of embeddings (empty without one), when
+    // stored (resident snapshots); null otherwise
+    const uint64_t* embedding_offsets = nullptr;
+    const int8_t* embeddings = nullptr;
+
+    size_t category_count = 0;
+    const uint32_t* category_offsets = nullptr;   // category_count + 1 entries
+
+    const char* string_heap = nullptr;
+    size_t string_heap_size = 0;
+
+    static constexpr size_t STRINGS_PER_EVENT = 3;
+
+    std::string_view id(size_t i) const { return string_slot(i * STRINGS_PER_EVENT); }
+    std::string_view title(size_t i) const { return string_slot(i * STRINGS_PER_EVENT + 1); }
+    std::string_view description(size_t i) const { return string_slot(i * STRINGS_PER_EVENT + 2); }
+
+    // Row i's term vector (only when terms is set)
+    const TermEntry* row_terms(size_t i) const { return terms + term_offsets[i]; }
+    size_t row_term_count(size_t i) const { return term_offsets[i + 1] - term_offsets[i]; }
+
+    // Row i's embedding (only when embeddings is set)
+    const int8_t* row_embedding(size_t i) const { return embeddings + embedding_offsets[i]; }
+    size_t row_embedding_size(size_t i) const { return embedding_offsets[i + 1] - embedding_offsets[i]; }
+
+    std::string_view category_name(uint32_t category) const {
+        return std::string_view(string_heap + category_offsets[category],
+                                category_offsets[category + 1] - category_offsets[category]);
+    }
+
+    /**
+     * Copy row i into an Event (for responses and deduplication).
+     */
+    Event materialize(size_t i) const;
+
+private:
+    std::string_view string_slot(size_t slot) const {
+        return std::string_view(string_heap + string_offsets[slot],
+                                string_offsets[slot + 1] - string_offsets[slot]);
+    }
+};
+
+/**
+ * Little-endian header of the columnar request blob accepted by
+ * POST /rank/columnar. It is followed by these arrays, in order, each
+ * starting on an 8-byte boundary:
+ *
+ *   double   latitude[event_count]
+ *   double   longitude[event_count]
+ *   int64    start_time[event_count]        (epoch seconds)
+ *   int64    end_time[event_count]
+ *   int64    created_at[event_count]
+ *   int32    view_count[event_count]
+ *   int32    save_count[event_count]
+ *   uint32   category_id[event_count]       (index into category table)
+ *   uint32   string_offsets[3 * event_count + 1]
+ *   uint32   category_offsets[category_count + 1]
+ *   uint32   preferred_category_ids[preferred_count]
+ *   char     string_heap[string_heap_size]
+ */
+struct ColumnarHeader {
+    uint32_t magic;                 // COLUMNAR_MAGIC
+    uint32_t version;               // COLUMNAR_VERSION
+    uint64_t event_count;
+    uint32_t category_count;
+    uint32_t preferred_count;
+    uint64_t string_heap_size;
+    double user_latitude;
+    double user_longitude;
+    double max_distance_km;
+    int64_t current_time;           // Epoch seconds; 0 = use the server clock
+    int32_t limit;
+    uint32_t reserved;
+};
+
+constexpr uint32_t COLUMNAR_MAGIC = 0x314C435Au;   // "ZCL1"
+constexpr uint32_t COLUMNAR_VERSION = 1;
+
+static_assert(sizeof(ColumnarHeader) == 72, "ColumnarHeader layout is part of the wire format");
+
+/**
+ * Ranking request whose candidates are held as columns.
+ */
+struct ColumnarRankingRequest {
+    UserLocation user_location;                    // preferred_categories unused
+    std::vector<uint32_t> preferred_category_ids;  // Indices into the category table
+    EventColumns columns;
+    double max_distance_km;
+    int limit;
+    std::vector<std::shared_ptr<const ScoringProfile>> profiles;  // As in RankingRequest
+    Deadline deadline;
+};
+
+/**
+ * Interpret a columnar blob in place. Only bounds are checked: section
+ * sizes against the blob length, category ids against the category table
+ * and string offsets against the heap. No per-event parsing or allocation.
+ *
+ * @param data Blob start (must be 8-byte aligned)
+ * @param size Blob length in bytes
+ * @return Request whose columns point into data
+ * @throws DecodeError if the blob is truncated or out of bounds
+ */
+ColumnarRankingRequest decode_columnar_request(const char* data, size_t size);
+
+} // namespace zerocost
+
+#endif // EVENT_COLUMNS_H
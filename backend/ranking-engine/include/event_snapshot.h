@@ -0,0 +1,228 @@
+#ifndef EVENT_SNAPSHOT_H
+#define EVENT_SNAPSHOT_H
+
+#include "event.h"
+#include "event_columns.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace zerocost {
+
+/**
+ * Thrown when a snapshot file cannot be read or written.
+ */
+class SnapshotError : public std::runtime_error {
+public:
+    explicit SnapshotError(const std::string& message) : std::runtime_error(message) {}
+};
+
+/**
+ * Little-endian header at offset 0 of a snapshot file. It is followed by
+ * section_count SnapshotSection entries; each section starts on an 8-byte
+ * boundary. Readers skip section kinds they do not know, so new index
+ * sections can be added without bumping the version.
+ */
+struct SnapshotHeader {
+    uint32_t magic;                 // SNAPSHOT_MAGIC
+    uint32_t version;               // SNAPSHOT_VERSION
+    uint64_t generation;            // Increases with every compaction
+    uint64_t event_count;
+    uint32_t category_count;
+    uint32_t section_count;
+    int64_t created_at;             // Epoch seconds
+    uint64_t file_size;
+    uint64_t sequence;              // Last store write folded in; WAL replay resumes after it
+    uint64_t reserved;
+};
+
+struct SnapshotSection {
+    uint32_t kind;                  // SnapshotSectionKind
+    uint32_t element_size;
+    uint64_t offset;
+    uint64_t count;
+};
+
+enum class SnapshotSectionKind : uint32_t {
+    Latitude = 1,
+    Longitude,
+    StartTime,
+    EndTime,
+    CreatedAt,
+    ViewCount,
+    SaveCount,
+    CategoryId,
+    StringOffsets,
+    CategoryOffsets,
+    StringHeap,
+    CellKey,        // Spatial index: grid cell of each row, rows sorted by it
+    IdIndex,        // IdIndexEntry sorted by hash, for lookups by event id
+    ExpiryOrder,    // Rows sorted by end_time, walked to expire events (optional)
+    StartTimeBlocks, // StartTimeBlock per SNAPSHOT_BLOCK_ROWS rows (optional)
+    UnitX,          // to_unit_vector of each row, for trig-free distance checks (optional)
+    UnitY,
+    UnitZ,
+    TermOffsets,    // Start of each row's term vector in Terms, plus the end (optional)
+    Terms,          // TermEntry vectors of every row, for BM25 (optional)
+    DocumentFrequencies, // DocumentFrequency per distinct term, sorted by hash (optional)
+    TextTotals,     // One TextTotals for the snapshot (optional)
+    VocabularyOffsets, // Start of each distinct title term in VocabularyText, plus the end (optional)
+    VocabularyText, // Distinct title terms, sorted and concatenated (optional)
+    Trigrams,       // TrigramEntry per title term trigram, sorted, plus an end entry (optional)
+    TrigramPostings, // Term ids of each trigram (optional)
+    EmbeddingOffsets, // Start of each row's embedding in Embeddings, plus the end (optional)
+    Embeddings      // int8 codes of every row's embedding (optional)
+};
+
+struct IdIndexEntry {
+    uint64_t hash;
+    uint32_t row;
+    uint32_t reserved;
+};
+
+/**
+ * Smallest and largest start_time in one block of rows. Rows are ordered
+ * by start_time within each grid cell, so blocks span narrow time ranges.
+ */
+struct StartTimeBlock {
+    int64_t min;
+    int64_t max;
+};
+
+constexpr size_t SNAPSHOT_BLOCK_ROWS = 64;
+
+constexpr uint32_t SNAPSHOT_MAGIC = 0x3153435Au;   // "ZCS1"
+constexpr uint32_t SNAPSHOT_VERSION = 1;
+
+static_assert(sizeof(SnapshotHeader) == 64, "SnapshotHeader layout is part of the file format");
+static_assert(sizeof(SnapshotSection) == 24, "SnapshotSection layout is part of the file format");
+static_assert(sizeof(IdIndexEntry) == 16, "IdIndexEntry layout is part of the file format");
+static_assert(sizeof(StartTimeBlock) == 16, "StartTimeBlock layout is part of the file format");
+
+/**
+ * Immutable set of events in columnar form, either mapped read-only from a
+ * snapshot file or held in memory. Rows are ordered by spatial grid cell,
+ * then by start_time.
+ */
+class EventSnapshot {
+public:
+    using RowRange = std::pair<size_t, size_t>;
+
+    /**
+     * Map a snapshot file. Only the header and section table are validated,
+     * so opening costs the same regardless of corpus size; pages are read
+     * lazily as rankings touch them.
+     *
+     * @param path Snapshot file written by write_snapshot
+     * @throws SnapshotError if the file is missing, truncated or malformed
+     */
+    static std::shared_ptr<const EventSnapshot> open(const std::string& path);
+
+    /**
+     * Build an in-memory snapshot (used when no snapshot path is configured).
+     */
+    static std::shared_ptr<const EventSnapshot> build(std::vector<Event> events, uint64_t generation,
+                                                      uint64_t sequence);
+
+    /**
+     * A snapshot with no events.
+     */
+    static std::shared_ptr<const EventSnapshot> empty();
+
+    ~EventSnapshot();
+    EventSnapshot(const EventSnapshot&) = delete;
+    EventSnapshot& operator=(const EventSnapshot&) = delete;
+
+    const EventColumns& columns() const { return columns_; }
+    size_t size() const { return columns_.count; }
+    uint64_t generation() const { return header_.generation; }
+    uint64_t sequence() const { return header_.sequence; }
+    bool mapped() const { return mapping_ != nullptr; }
+
+    /**
+     * Rows in end_time order, or nullptr if the file predates the section.
+     */
+    const uint32_t* expiry_order() const { return expiry_order_; }
+
+    /**
+     * CategoryDictionary id of each category in columns(), indexed like
+     * columns().category_id values (NONE where the name could not be interned).
+     */
+    const std::vector<uint32_t>& dictionary_ids() const { return dictionary_ids_; }
+
+    /**
+     * Term statistics of the snapshot's events (empty if the file predates
+     * the text sections).
+     *
+     * @param delta Changes since the snapshot to fold in (borrowed)
+     */
+    TextCorpus text_corpus(const TextCorpusDelta* delta = nullptr) const;
+
+    /**
+     * Distinct title terms with their trigram index, for fuzzy search
+     * (empty if the file predates the vocabulary sections).
+     */
+    const TermVocabulary& vocabulary() const { return vocabulary_; }
+
+    /**
+     * Row of the event with this id, or -1 if it is not in the snapshot.
+     */
+    int64_t find(const std::string& id) const;
+
+    /**
+     * Append row ranges whose grid cells may hold events within radius_km
+     * of the given point. Rows outside the ranges are guaranteed farther.
+     */
+    void rows_near(double latitude, double longitude, double radius_km,
+                   std::vector<RowRange>& ranges) const;
+
+    /**
+     * Narrow ranges to the blocks whose start times can fall in window.
+     * Rows left in the ranges still need a per-row check; rows removed are
+     * guaranteed outside the window.
+     */
+    void restrict_to_window(const StartWindow& window, std::vector<RowRange>& ranges) const;
+
+private:
+    EventSnapshot() = default;
+
+    void attach(const char* data, size_t size);
+
+    SnapshotHeader header_ = {};
+    EventColumns columns_;
+    const uint32_t* cell_keys_ = nullptr;
+    const IdIndexEntry* id_index_ = nullptr;
+    const uint32_t* expiry_order_ = nullptr;
+    const StartTimeBlock* start_blocks_ = nullptr;
+    const DocumentFrequency* document_frequencies_ = nullptr;
+    size_t document_frequency_count_ = 0;
+    TextTotals text_totals_ = {};
+    TermVocabulary vocabulary_;
+    std::vector<uint32_t> dictionary_ids_;
+
+    void* mapping_ = nullptr;            // mmap'd file, or
+    std::vector<uint64_t> buffer_;       // owned in-memory image
+    size_t mapping_size_ = 0;
+};
+
+/**
+ * Write events as a snapshot file. The file is written next to path,
+ * synced and then renamed over path, so readers never see a partial file
+ * and existing mappings of the old file stay valid.
+ *
+ * @param path Destination file
+ * @param events Events to store (reordered by spatial cell)
+ * @param generation Generation number recorded in the header
+ * @param sequence Last store write included
+ * @throws SnapshotError on I/O failure
+ */
+void write_snapshot(const std::string& path, std::vector<Event> events, uint64_t generation,
+                    uint64_t sequence);
+
+} // namespace zerocost
+
+#endif // EVENT_SNAPSHOT_H
@@ -0,0 +1,248 @@
+#ifndef EVENT_STORE_H
+#define EVENT_STORE_H
+
+#include "event.h"
+#include "event_snapshot.h"
+#include "interaction_counters.h"
+#include "sharded_map.h"
+#include "timing_wheel.h"
+#include "write_ahead_log.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace zerocost {
+
+struct StoreOptions {
+    std::string snapshot_path;                          // Empty: keep snapshots in memory only
+    size_t compact_threshold = 4096;                    // Overlay entries that trigger a compaction
+    std::chrono::milliseconds compact_interval{10000};  // Compact at least this often when dirty
+    size_t compact_interactions = size_t(1) << 20;      // Logged increments that alone trigger a compaction
+    bool write_ahead_log = true;                        // Log writes next to the snapshot (needs snapshot_path)
+    bool expire_events = true;                          // Remove events once their end_time has passed
+};
+
+/**
+ * A write made since the current snapshot: an upserted event or, when
+ * deleted is set, a tombstone for a snapshot row.
+ */
+struct StoreEntry {
+    Event event;
+    bool deleted = false;
+    uint64_t sequence = 0;
+    uint32_t slot = RowSlots::NONE;     // Interaction counter slot (NONE for tombstones)
+    std::vector<TermEntry> terms;   // Term vector of the event (empty for tombstones)
+};
+
+/**
+ * Writes not yet folded into the snapshot. Immutable once published. The
+ * writer copies the overlay for each generation; entries and term
+ * statistics are sharded so the copy shares what the round leaves alone.
+ */
+struct StoreOverlay {
+    ShardedMap<std::string, StoreEntry> entries;
+    std::vector<uint32_t> masked_rows;   // Sorted snapshot rows replaced or deleted by entries
+
+    size_t live_entries = 0;             // Entries that are not tombstones
+    TextCorpusDelta text;                // Term statistics of entries minus the rows they mask
+    ShardedSet<std::string> title_terms;   // Title terms of entries the snapshot's vocabulary lacks
+
+    bool masks(size_t row) const;
+};
+
+/**
+ * Consistent view of the store pinned by a reader for one request.
+ */
+struct StoreView {
+    std::shared_ptr<const EventSnapshot> snapshot;
+    std::shared_ptr<const StoreOverlay> overlay;
+    std::shared_ptr<RowSlots> row_slots;    // Counter slots of the snapshot's rows; assigned by the store
+    const InteractionCounters* counters = nullptr;
+
+    size_t size() const;
+
+    /**
+     * Live counts of a snapshot row: its counter once it has one, otherwise
+     * the snapshot's columns.
+     */
+    int views(size_t row) const {
+        uint32_t slot = row_slots->find(row);
+        return slot == RowSlots::NONE ? snapshot->columns().view_count[row] : counters->views(slot);
+    }
+    int saves(size_t row) const {
+        uint32_t slot = row_slots->find(row);
+        return slot == RowSlots::NONE ? snapshot->columns().save_count[row] : counters->saves(slot);
+    }
+
+    /**
+     * Term statistics of the live events. Borrows from the view.
+     */
+    TextCorpus text_corpus() const { return snapshot->text_corpus(&overlay->text); }
+};
+
+/**
+ * Resident event set: an immutable snapshot (memory-mapped when a path is
+ * configured) plus a small copy-on-write overlay of recent writes. A
+ * background thread folds the overlay into a new snapshot generation.
+ *
+ * Readers never take a lock held during write work: the current
+ * generation is a shared_ptr read with std::atomic_load and replaced with
+ * std::atomic_store. A single writer thread applies queued writes, builds
+ * the next overlay and publishes it; a reader keeps whatever generation it
+ * pinned until it drops the view.
+ *
+ * With a snapshot path, writes are also appended to a write-ahead log and
+ * only acknowledged once synced; the log is replayed over the snapshot on
+ * load and trimmed after each compaction.
+ *
+ * Recent writes and snapshot rows that have been interacted with own a
+ * slot in an InteractionCounters table; rankings read popularity from it
+ * so view and save counts can change without rewriting the event. Other
+ * rows are scored from the snapshot's columns. Compaction writes live
+ * counts into the new snapshot and frees slots that no longer differ.
+ *
+ * Ended events are removed by the writer thread a few at a time: recent
+ * writes through a TimingWheel on end_time, snapshot rows by walking the
+ * snapshot's end_time order. Compaction drops them from the next snapshot
+ * and frees their counter slots.
+ */
+class EventStore {
+public:
+    explicit EventStore(StoreOptions options = StoreOptions());
+    ~EventStore();
+
+    /**
+     * Map the snapshot at options.snapshot_path if it exists, then replay
+     * the write-ahead log on top of it.
+     *
+     * @return Number of events loaded
+     * @throws SnapshotError if the file exists but is unreadable
+     * @throws WalError if the log cannot be read or a new segment created
+     */
+    size_t load();
+
+    /**
+     * Start the writer and background compaction threads.
+     */
+    void start();
+
+    /**
+     * Apply queued writes, stop both threads and fold any remaining writes
+     * into a final snapshot so they survive a restart.
+     */
+    void stop();
+
+    /**
+     * Insert or replace events by id. Returns once the writes are visible
+     * and durable.
+     *
+     * @throws WalError if the write-ahead log has failed
+     */
+    void upsert(std::vector<Event> events);
+
+    /**
+     * Delete events by id. Unknown ids are ignored. Returns once the
+     * deletes are visible and durable.
+     *
+     * @return Number of events removed
+     * @throws WalError if the write-ahead log has failed
+     */
+    size_t remove(std::vector<std::string> ids);
+
+    /**
+     * Add view and save increments to live events, under the writer lock
+     * but without a new generation: increments go straight to the counter
+     * table (giving a row its slot on first use) and are visible to the
+     * next ranking. With a write-ahead log they are also logged as one
+     * interactions record and acknowledged once durable, and only force a
+     * snapshot rewrite once options.compact_interactions of them are
+     * pending; without one counts are persisted with the next snapshot
+     * (at most compact_interval away).
+     *
+     * @return Number of interactions whose event exists
+     * @throws WalError if the write-ahead log has failed
+     */
+    size_t record_interactions(const std::vector<Interaction>& interactions);
+
+    /**
+     * Pin the current generation. Never waits for writers or compaction.
+     */
+    StoreView view() const;
+
+    /**
+     * Fold the overlay into a new snapshot generation and publish it.
+     *
+     * @return true if a new snapshot was written
+     * @throws SnapshotError if the snapshot cannot be written
+     */
+    bool compact();
+
+    /**
+     * The write-ahead log, or nullptr when writes are not logged.
+     */
+    const WriteAheadLog* wal() const { return wal_.get(); }
+
+    uint64_t interactions_recorded() const { return interactions_recorded_.load(std::memory_order_relaxed); }
+    uint64_t events_expired() const { return events_expired_.load(std::memory_order_relaxed); }
+
+private:
+    /**
+     * A queued upsert/delete request, completed by the writer thread.
+     */
+    struct PendingWrite {
+        std::vector<Event> upserts;
+        std::vector<std::string> deletes;
+        std::promise<size_t> removed;
+    };
+
+    size_t submit(std::vector<Event> upserts, std::vector<std::string> deletes);
+    void writer_loop();
+    void apply_writes(std::vector<std::unique_ptr<PendingWrite>>& writes);
+    void compaction_loop();
+    bool expire(int64_t now);
+    void publish(std::shared_ptr<const EventSnapshot> snapshot, std::shared_ptr<RowSlots> row_slots,
+                 std::shared_ptr<StoreOverlay> overlay);
+    int64_t counter_slot(const StoreView& view, const StoreOverlay& overlay, const std::string& id);
+    void apply_upsert(const StoreView& base, StoreOverlay& overlay, Event event, uint64_t sequence);
+    bool apply_delete(const StoreView& base, StoreOverlay& overlay, const std::string& id,
+                      uint64_t sequence) const;
+
+    StoreOptions options_;
+    InteractionCounters counters_;  // Slots allocated under writer_mutex_
+    std::atomic<uint64_t> counts_pending_{0};   // Increments since the last snapshot; changed under writer_mutex_
+    std::atomic<uint64_t> interactions_recorded_{0};
+
+    // Current generation; only accessed through std::atomic_load/atomic_store
+    std::shared_ptr<const StoreView> generation_;
+
+    std::mutex writer_mutex_;       // Held while building the next generation (writer thread, compaction)
+    uint64_t sequence_ = 0;         // Guarded by writer_mutex_
+    TimingWheel wheel_;             // End times of upserted events; guarded by writer_mutex_
+    size_t expiry_cursor_ = 0;      // Next position in the snapshot's expiry order; guarded by writer_mutex_
+    std::vector<std::string> expiring_;  // Due ids not yet removed; guarded by writer_mutex_
+    std::atomic<uint64_t> events_expired_{0};
+
+    std::mutex queue_mutex_;        // Guards queue_ and stopping flags
+    std::condition_variable queue_cv_;
+    std::condition_variable compaction_cv_;
+    std::vector<std::unique_ptr<PendingWrite>> queue_;
+    bool stopping_writer_ = false;
+    bool stopping_compactor_ = false;
+    std::thread writer_;
+    std::thread compactor_;
+
+    std::mutex compaction_mutex_;   // Serializes compact()
+    std::unique_ptr<WriteAheadLog> wal_;
+};
+
+} // namespace zerocost
+
+#endif // EVENT_STORE_H
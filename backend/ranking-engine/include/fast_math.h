@@ -0,0 +1,94 @@
+#ifndef FAST_MATH_H
+#define FAST_MATH_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+namespace zerocost {
+
+constexpr double LN2_HI = 6.93147180369123816490e-01;   // ln(2) split so n * LN2_HI is exact
+constexpr double LN2_LO = 1.90821492927058770002e-10;
+constexpr double LOG2E = 1.44269504088896338700e+00;
+constexpr double ROUND_SHIFT = 6755399441055744.0;       // 2^52 + 2^51: adding it rounds to an integer
+constexpr double SQRT2 = 1.41421356237309504880;
+
+/*
+ * exp and log for the batch scoring kernels, built from adds, multiplies
+ * and bit operations only, so they vectorize where std::exp and std::log
+ * are library calls. Both are within FAST_MATH_MAX_ULPS of libm over the
+ * ranges scoring uses (exp on [-3, 0], log on [1, 2^33]);
+ * tests/fast_math_test sweeps both.
+ */
+constexpr double FAST_MATH_MAX_ULPS = 2.0;
+
+inline double fast_exp(double x) {
+    x = std::min(std::max(x, -708.0), 709.0);
+
+    // x = n * ln2 + r with |r| <= ln2 / 2
+    double shifted = x * LOG2E + ROUND_SHIFT;
+    double n = shifted - ROUND_SHIFT;
+    double r = (x - n * LN2_HI) - n * LN2_LO;
+
+    // Taylor series to r^13 (truncation error below 2e-17 on |r| <= ln2 / 2)
+    double p = 1.0 / 6227020800.0;
+    p = p * r + 1.0 / 479001600.0;
+    p = p * r + 1.0 / 39916800.0;
+    p = p * r + 1.0 / 3628800.0;
+    p = p * r + 1.0 / 362880.0;
+    p = p * r + 1.0 / 40320.0;
+    p = p * r + 1.0 / 5040.0;
+    p = p * r + 1.0 / 720.0;
+    p = p * r + 1.0 / 120.0;
+    p = p * r + 1.0 / 24.0;
+    p = p * r + 1.0 / 6.0;
+    p = p * r + 0.5;
+    p = p * r + 1.0;
+    p = p * r + 1.0;
+
+    // Scale by 2^n through the exponent field (n is in [-1022, 1023])
+    int64_t shifted_bits;
+    std::memcpy(&shifted_bits, &shifted, sizeof(shifted_bits));
+    int64_t scale_bits = (shifted_bits - 0x4338000000000000 + 1023) << 52;
+    double scale;
+    std::memcpy(&scale, &scale_bits, sizeof(scale));
+    return p * scale;
+}
+
+// log(x) for finite x >= 1
+inline double fast_log(double x) {
+    // x = m * 2^e with m in [1, 2), then m moved into [sqrt(1/2), sqrt(2))
+    uint64_t bits;
+    std::memcpy(&bits, &x, sizeof(bits));
+    int64_t exponent = static_cast<int64_t>(bits >> 52) - 1023;
+    uint64_t mantissa_bits = (bits & ((uint64_t(1) << 52) - 1)) | (uint64_t(1023) << 52);
+    double m;
+    std::memcpy(&m, &mantissa_bits, sizeof(m));
+    exponent = m > SQRT2 ? exponent + 1 : exponent;
+    m = m > SQRT2 ? m * 0.5 : m;
+
+    // log(m) = 2 atanh(s) with s = (m - 1) / (m + 1), |s| <= 0.172
+    double s = (m - 1.0) / (m + 1.0);
+    double z = s * s;
+    double p = 2.0 / 21.0;
+    p = p * z + 2.0 / 19.0;
+    p = p * z + 2.0 / 17.0;
+    p = p * z + 2.0 / 15.0;
+    p = p * z + 2.0 / 13.0;
+    p = p * z + 2.0 / 11.0;
+    p = p * z + 2.0 / 9.0;
+    p = p * z + 2.0 / 7.0;
+    p = p * z + 2.0 / 5.0;
+    p = p * z + 2.0 / 3.0;
+    double log_m = 2.0 * s + s * z * p;
+
+    int64_t exponent_bits = exponent + 0x4338000000000000;
+    double e;
+    std::memcpy(&e, &exponent_bits, sizeof(e));
+    e -= ROUND_SHIFT;
+    return e * LN2_HI + (log_m + e * LN2_LO);
+}
+
+} // namespace zerocost
+
+#endif // FAST_MATH_H
@@ -1,41 +1,234 @@
 #ifndef HTTP_SERVER_H
 #define HTTP_SERVER_H
 
+#include "deadline.h"
 #include <string>
 #include <functional>
 #include <map>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <sys/uio.h>
 
 namespace zerocost {
 
+/**
+ * I/O backend used by HttpServer to accept connections and move bytes.
+ */
+enum class IoBackend {
+    Threaded,   // Blocking accept loop feeding a bounded worker pool
+    IoUring     // io_uring event loops reading requests for the same worker pool (only when
+                // built with ZEROCOST_HAVE_IO_URING)
+};
+
+/**
+ * Server tuning. Zero values mean "use the default" where noted.
+ */
+struct ServerOptions {
+    IoBackend backend = IoBackend::Threaded;
+    unsigned worker_threads = 0;                          // 0 = hardware concurrency
+    size_t max_queue_depth = 1024;                        // Accepted but unstarted connections
+    std::chrono::milliseconds max_queue_time{200};        // Shed if queued longer than this
+    std::chrono::milliseconds default_timeout{0};         // 0 = no deadline unless the client sends one
+    std::chrono::milliseconds read_timeout{5000};         // Close if the request isn't read by then
+};
+
+/**
+ * Parsed request passed to routes. Header names are lowercased.
+ */
+struct HttpRequest {
+    std::string method;
+    std::string path;
+    std::string query;      // After the '?' of the target, still percent-encoded
+    std::map<std::string, std::string> headers;
+    std::string body;
+    Deadline deadline;
+
+    std::string header(const std::string& name, const std::string& fallback = "") const {
+        auto it = headers.find(name);
+        return it != headers.end() ? it->second : fallback;
+    }
+
+    /**
+     * Value of a query string parameter, percent-decoded ('+' is a space).
+     */
+    std::string query_param(const std::string& name, const std::string& fallback = "") const;
+};
+
+/**
+ * Response produced by a route. The body is written to the socket as-is,
+ * without being copied into a combined header+body buffer.
+ */
+struct HttpResponse {
+    int status_code = 200;
+    std::string content_type = "application/json";
+    std::string body;
+};
+
+/**
+ * Load-shedding and timeout counters, readable while the server runs.
+ */
+struct ServerStats {
+    std::atomic<uint64_t> requests_total{0};
+    std::atomic<uint64_t> shed_queue_full{0};
+    std::atomic<uint64_t> shed_queue_timeout{0};
+    std::atomic<uint64_t> deadline_exceeded{0};
+    std::atomic<uint64_t> read_timeouts{0};
+};
+
 class HttpServer {
 public:
     using Handler = std::function<std::string(const std::string& body)>;
-    
-    HttpServer(int port);
+    using RequestHandler = std::function<HttpResponse(const HttpRequest& request)>;
+
+    // Number of iovecs a response is written with (see prepare_response)
+    static constexpr int RESPONSE_IOV_COUNT = 4;
+
+    // Client-supplied time budget in milliseconds, measured from accept. It
+    // can shorten the default deadline but not lift it; without a default it
+    // is capped at MAX_REQUEST_TIMEOUT
+    static constexpr const char* TIMEOUT_HEADER = "x-request-timeout-ms";
+    static constexpr std::chrono::milliseconds MAX_REQUEST_TIMEOUT{60 * 60 * 1000};
+
+    // Largest request (headers and body) and header block accepted; larger
+    // requests are answered 413 without being read any further
+    static constexpr size_t MAX_REQUEST_BYTES = 64 * 1024 * 1024;
+    static constexpr size_t MAX_HEADER_BYTES = 64 * 1024;
+
+    // Request buffers that grew past this are released rather than reused
+    static constexpr size_t RETAINED_BUFFER_BYTES = 1024 * 1024;
+
+    enum class RequestState {
+        Incomplete,     // More bytes needed
+        Complete,       // Headers and Content-Length bytes of body received
+        TooLarge        // Over MAX_HEADER_BYTES or MAX_REQUEST_BYTES
+    };
+
+    HttpServer(int port, const ServerOptions& options = ServerOptions());
     ~HttpServer();
-    
+
     void add_route(const std::string& method, const std::string& path, Handler handler);
+    void add_route(const std::string& method, const std::string& path, RequestHandler handler);
     void run();
+
+    /**
+     * Stop accepting new connections. Safe to call from any thread;
+     * queued and in-flight requests still complete.
+     */
     void stop();
-    
+
+    /**
+     * Stop accepting, serve every connection already accepted (including
+     * those waiting in the kernel backlog), and wait until all responses
+     * have been written.
+     *
+     * @param timeout Maximum time to wait for in-flight requests
+     * @return true if fully drained, false if the timeout expired first
+     */
+    bool drain(std::chrono::milliseconds timeout);
+
+    const ServerStats& stats() const { return stats_; }
+    size_t queue_depth();
+
+    /**
+     * Check whether the io_uring backend was compiled in and the running
+     * kernel supports the features it needs (multishot accept, provided
+     * buffer rings). Used to fall back to the threaded backend at startup.
+     */
+    static bool io_uring_supported();
+
 private:
+    /**
+     * Work for the pool. The threaded backend queues the bare socket; the
+     * io_uring backend reads the request on its ring and queues it with
+     * respond, which hands the response back to the ring to send.
+     */
+    struct PendingConnection {
+        int socket;
+        Deadline::Clock::time_point accepted_at;
+        std::string request;
+        std::function<void(HttpResponse response)> respond;
+    };
+
     int port_;
     int server_socket_;
-    bool running_;
-    std::map<std::string, Handler> routes_;
-    
-    void handle_client(int client_socket);
-    std::string parse_http_request(const std::string& request, 
-                                   std::string& method, 
-                                   std::string& path,
-                                   std::string& body);
-    std::string build_http_response(int status_code, 
-                                   const std::string& content_type,
-                                   const std::string& body);
+    ServerOptions options_;
+    std::atomic<bool> running_;
+    std::map<std::string, RequestHandler> routes_;
+    ServerStats stats_;
+
+    // Drain tracking: open listening sockets and accepted, unclosed connections
+    std::atomic<int> listeners_;
+    std::atomic<size_t> active_connections_;
+    std::mutex drain_mutex_;
+    std::condition_variable drain_cv_;
+    int wake_pipe_[2];
+
+    // Accept loop (threaded) or rings (io_uring) -> bounded queue -> worker pool
+    std::deque<PendingConnection> queue_;
+    std::mutex queue_mutex_;
+    std::condition_variable queue_cv_;
+    bool accepting_;  // Guarded by queue_mutex_
+    std::vector<std::thread> workers_;
+
+    int open_listen_socket(bool reuse_port);
+    void run_threaded();
+    bool run_io_uring();
+    void start_workers();
+    void stop_workers();
+    void worker_loop();
+    bool accept_connection();
+    bool enqueue(PendingConnection& connection);
+    void connection_closed();
+    void notify_drain();
+
+    /**
+     * How long after accept a connection may take to send its request:
+     * read_timeout, or the default deadline if that is shorter.
+     */
+    std::chrono::milliseconds read_timeout() const;
+
+    void handle_client(const PendingConnection& connection);
+    void reject_overloaded(int client_socket);
+    static HttpResponse error_response(int status_code, const std::string& message);
+    HttpResponse handle_request(const std::string& raw_request,
+                                Deadline::Clock::time_point received_at);
+
+    /**
+     * The request's time budget: TIMEOUT_HEADER if it holds a positive
+     * integer, bounded by the default deadline (or MAX_REQUEST_TIMEOUT),
+     * else the default. Zero means no deadline.
+     */
+    std::chrono::milliseconds request_budget(const HttpRequest& request) const;
+
+    /**
+     * Whether data holds a whole request. The declared Content-Length is
+     * checked against MAX_REQUEST_BYTES as soon as the headers are in, so
+     * an oversized body is refused before any of it is buffered.
+     */
+    static RequestState request_state(const std::string& data);
+    static bool parse_http_request(const std::string& raw_request, HttpRequest& request);
+
+    /**
+     * Fill iov with status line, variable headers (formatted into head),
+     * the static header block and the body. Returns the iovec count.
+     */
+    static int prepare_response(const HttpResponse& response,
+                                std::string& head,
+                                struct iovec* iov);
+
+    /**
+     * Write every iovec to fd, resuming after short writes and waiting
+     * for writability on EAGAIN. Returns false on error or timeout.
+     */
+    static bool write_all(int fd, struct iovec* iov, int iovcnt);
 };
 
 } // namespace zerocost
 
 #endif // HTTP_SERVER_H
-
-
@@ -0,0 +1,151 @@
+#ifndef INTERACTION_COUNTERS_H
+#define INTERACTION_COUNTERS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace zerocost {
+
+/**
+ * Live view and save counts of one event, alone on its cache line so
+ * increments to neighbouring events never contend.
+ */
+struct alignas(64) CounterSlot {
+    std::atomic<int64_t> views{0};
+    std::atomic<int64_t> saves{0};
+};
+
+static_assert(sizeof(CounterSlot) == 64, "CounterSlot must fill exactly one cache line");
+
+/**
+ * Counter table indexed by a dense per-event slot number. Slots live in
+ * fixed-size chunks that never move once allocated, so readers and
+ * incrementers index the table without locks while the store grows it.
+ * Only events whose counts changed since the snapshot hold a slot, and
+ * freed slots are handed out again, so the table tracks the peak number
+ * of such events rather than the corpus size.
+ */
+class InteractionCounters {
+public:
+    static constexpr size_t CHUNK_BITS = 12;
+    static constexpr size_t CHUNK_SLOTS = size_t(1) << CHUNK_BITS;   // 256 KiB per chunk
+    static constexpr size_t MAX_CHUNKS = size_t(1) << 16;            // 268M slots
+
+    InteractionCounters();
+    ~InteractionCounters();
+    InteractionCounters(const InteractionCounters&) = delete;
+    InteractionCounters& operator=(const InteractionCounters&) = delete;
+
+    /**
+     * Take a free slot (or add one) holding the given counts. Callers must
+     * serialize allocation (the store does it under its writer lock); the
+     * slot may be used by other threads once it has been published to them.
+     *
+     * @return The slot number
+     * @throws std::length_error if the table is full
+     */
+    uint32_t allocate(int64_t views, int64_t saves);
+
+    /**
+     * Replace the list of slots allocate() may reuse. Serialized with
+     * allocate().
+     */
+    void set_free_slots(std::vector<uint32_t> slots) { free_ = std::move(slots); }
+
+    /**
+     * Increment a slot. Safe from any thread.
+     */
+    void add(uint32_t slot, int64_t views, int64_t saves) {
+        CounterSlot& counter = at(slot);
+        if (views != 0) {
+            counter.views.fetch_add(views, std::memory_order_relaxed);
+        }
+        if (saves != 0) {
+            counter.saves.fetch_add(saves, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * Raise a slot to at least the given counts (counts never go down when
+     * an event is re-sent with stale values).
+     */
+    void raise(uint32_t slot, int64_t views, int64_t saves);
+
+    /**
+     * Current counts, clamped to the int range used by Event.
+     */
+    int views(uint32_t slot) const { return clamp(at(slot).views.load(std::memory_order_relaxed)); }
+    int saves(uint32_t slot) const { return clamp(at(slot).saves.load(std::memory_order_relaxed)); }
+
+    size_t size() const { return size_.load(std::memory_order_acquire); }
+
+private:
+    CounterSlot& at(uint32_t slot) const {
+        return chunks_[slot >> CHUNK_BITS].load(std::memory_order_acquire)[slot & (CHUNK_SLOTS - 1)];
+    }
+
+    static int clamp(int64_t value) {
+        return value > INT32_MAX ? INT32_MAX : static_cast<int>(value);
+    }
+
+    std::unique_ptr<std::atomic<CounterSlot*>[]> chunks_;
+    std::atomic<size_t> size_{0};
+    std::vector<uint32_t> free_;       // Guarded like allocate()
+};
+
+/**
+ * Counter slot of each row of one snapshot, or NONE while the row's counts
+ * are still the snapshot's view/save columns. Rows get a slot on their
+ * first interaction, and the index is allocated in chunks as rows are
+ * assigned, so a freshly mapped snapshot costs nothing per row. Lookups
+ * never lock; assign() must be serialized like InteractionCounters::allocate.
+ */
+class RowSlots {
+public:
+    static constexpr uint32_t NONE = UINT32_MAX;
+    static constexpr size_t CHUNK_BITS = 12;
+    static constexpr size_t CHUNK_ROWS = size_t(1) << CHUNK_BITS;   // 16 KiB per chunk
+
+    explicit RowSlots(size_t rows);
+    ~RowSlots();
+    RowSlots(const RowSlots&) = delete;
+    RowSlots& operator=(const RowSlots&) = delete;
+
+    uint32_t find(size_t row) const {
+        const std::atomic<uint32_t>* chunk = chunks_[row >> CHUNK_BITS].load(std::memory_order_acquire);
+        return chunk ? chunk[row & (CHUNK_ROWS - 1)].load(std::memory_order_acquire) : NONE;
+    }
+
+    /**
+     * Give row a slot. Readers see either NONE or the slot.
+     */
+    void assign(size_t row, uint32_t slot);
+
+    /**
+     * Call fn(row, slot) for every row with a slot, in row order.
+     */
+    template <typename Fn>
+    void for_each(Fn fn) const {
+        for (size_t chunk = 0; chunk < chunk_count_; ++chunk) {
+            const std::atomic<uint32_t>* slots = chunks_[chunk].load(std::memory_order_acquire);
+            for (size_t i = 0; slots && i < CHUNK_ROWS; ++i) {
+                uint32_t slot = slots[i].load(std::memory_order_relaxed);
+                if (slot != NONE) {
+                    fn((chunk << CHUNK_BITS) + i, slot);
+                }
+            }
+        }
+    }
+
+private:
+    std::unique_ptr<std::atomic<std::atomic<uint32_t>*>[]> chunks_;
+    size_t chunk_count_;
+};
+
+} // namespace zerocost
+
+#endif // INTERACTION_COUNTERS_H
@@ -1,14 +1,30 @@
 #ifndef RANKING_SERVICE_H
 #define RANKING_SERVICE_H
 
+#include "embedding.h"
 #include "event.h"
+#include "event_columns.h"
+#include "event_store.h"
+#include "scoring.h"
 #include <vector>
 #include <string>
 
 namespace zerocost {
 
+/**
+ * Ranks with each of the request's scoring profiles in a single pass: when
+ * it names several, response.variants holds every profile's ranking and
+ * ranked_events is the first profile's.
+ */
 class RankingService {
 public:
+    /**
+     * @param approximate_distance Filter and score with approximate_distance
+     *        when the request radius allows it (see distance.h)
+     */
+    explicit RankingService(bool approximate_distance = true)
+        : approximate_distance_(approximate_distance) {}
+    
     /**
      * Rank events based on multiple factors:
      * - Distance from user
@@ -19,28 +35,73 @@ public:
      * 
      * @param request Ranking request with events and user context
      * @return Ranked and filtered events
+     * @throws DeadlineExceeded if request.deadline passes between stages
      */
     RankingResponse rank_events(const RankingRequest& request);
     
     /**
-     * Search and rank events based on query
+     * Search and rank events based on query. Text relevance is BM25F
+     * (text_index.h) with the request's events in range as the corpus; only
+     * events containing at least one query term are kept.
      * 
      * @param request Ranking request
      * @param query Search query string
      * @return Ranked events matching query
+     * @throws DeadlineExceeded if request.deadline passes between stages
      */
     RankingResponse search_and_rank(const RankingRequest& request, 
                                     const std::string& query);
+    /**
+     * Rank a columnar request without materializing every candidate. Scores
+     * are computed straight from the columns; only the top rows are copied
+     * into Events for deduplication and the response.
+     * 
+     * @param request Columnar ranking request (columns must outlive the call)
+     * @return Ranked events; total_count is the number of events in range
+     * @throws DeadlineExceeded if request.deadline passes between stages
+     */
+    RankingResponse rank_columns(const ColumnarRankingRequest& request);
+    
+    /**
+     * Rank the resident event store (used when a request carries no events).
+     * Only snapshot rows in grid cells that can be within max_distance_km are
+     * scored, and only the returned rows are materialized. A query is scored
+     * by BM25F against the store's term statistics, from each row's
+     * precomputed term vector.
+     * 
+     * @param request Ranking request (events ignored)
+     * @param store View pinned for the duration of the call
+     * @param query Search query, or empty to rank without text matching
+     * @return Ranked events; total_count is the number of matches in range
+     * @throws DeadlineExceeded if request.deadline passes between stages
+     */
+    RankingResponse rank_resident(const RankingRequest& request,
+                                  const StoreView& store,
+                                  const std::string& query = "");
+    
 private:
+    void filter_by_start_window(std::vector<Event>& events, const StartWindow& window);
+    
     void calculate_distances(std::vector<Event>& events, 
                             const UserLocation& user_location,
                             double max_distance_km);
     
     void calculate_scores(std::vector<Event>& events, 
                          const UserLocation& user_location,
-                         const std::string& query = "");
+                         const std::vector<const ScoringProfile*>& profiles,
+                         std::vector<double>& variant_scores,
+                         const std::vector<double>* text_similarity = nullptr,  // Per event; null: 0.5
+                         const EmbeddingQuery* embedding = nullptr);
+    
+    void rank_variants(const std::vector<Event>& events,
+                       const std::vector<double>& variant_scores,
+                       const std::vector<const ScoringProfile*>& profiles,
+                       int limit,
+                       RankingResponse& response);
     
     void sort_by_score(std::vector<Event>& events);
+    
+    bool approximate_distance_;
 };
 
 } // namespace zerocost
@@ -0,0 +1,126 @@
+#ifndef REQUEST_CODEC_H
+#define REQUEST_CODEC_H
+
+#include "event.h"
+#include "suggest_index.h"
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace zerocost {
+
+/**
+ * Body encodings accepted on /rank and /search.
+ */
+enum class WireFormat {
+    Json,       // application/json (timestamps as ISO-8601 strings or epoch seconds)
+    MsgPack,    // application/msgpack (timestamps as epoch seconds)
+    Cbor        // application/cbor (timestamps as untagged epoch seconds)
+};
+
+/**
+ * Thrown when a request body is well-formed but does not describe a
+ * valid ranking request (wrong field types, missing user location).
+ */
+class DecodeError : public std::runtime_error {
+public:
+    explicit DecodeError(const std::string& message) : std::runtime_error(message) {}
+};
+
+/**
+ * Map a Content-Type header to a wire format. Unknown or missing types
+ * are treated as JSON.
+ */
+WireFormat wire_format_from_content_type(const std::string& content_type);
+
+/**
+ * Pick the response format: the Accept header if it names a supported
+ * format, otherwise the request's own format.
+ */
+WireFormat negotiate_response_format(const std::string& accept, WireFormat request_format);
+
+const char* content_type_for(WireFormat format);
+const char* wire_format_name(WireFormat format);
+
+/**
+ * Decode a ranking request body directly into RankingRequest using a
+ * streaming (SAX) reader, without building an intermediate document.
+ * Unknown fields are skipped.
+ *
+ * @param body Raw request body
+ * @param format Body encoding
+ * @param query Receives the optional "query" field (may be nullptr)
+ * @return Decoded request (deadline is left unset)
+ * @throws DecodeError or nlohmann::json::exception on malformed input
+ */
+RankingRequest decode_ranking_request(const std::string& body,
+                                      WireFormat format,
+                                      std::string* query = nullptr);
+
+/**
+ * Writes for the resident event store: events to insert or replace, and
+ * ids to delete.
+ */
+struct EventBatch {
+    std::vector<Event> upserts;
+    std::vector<std::string> deletes;
+};
+
+/**
+ * Decode a POST /events body: {"events": [...], "delete": ["id", ...]}.
+ * Events use the same fields as in ranking requests and must have an id.
+ *
+ * @throws DecodeError or nlohmann::json::exception on malformed input
+ */
+EventBatch decode_event_batch(const std::string& body, WireFormat format);
+
+/**
+ * Decode a POST /events/interactions body:
+ * {"interactions": [{"id": "...", "views": 1, "saves": 0}, ...]}.
+ * views and saves are increments and default to 0.
+ *
+ * @throws DecodeError or nlohmann::json::exception on malformed input
+ */
+std::vector<Interaction> decode_interactions(const std::string& body, WireFormat format);
+
+/**
+ * Encode a ranking response in the given format.
+ *
+ * @param response Ranking result
+ * @param format Output encoding
+ * @param query Search query to echo back (nullptr for /rank)
+ */
+std::string encode_ranking_response(const RankingResponse& response,
+                                    WireFormat format,
+                                    const std::string* query = nullptr);
+
+/**
+ * Encode the {"upserted", "deleted", "event_count"} reply to POST /events.
+ */
+std::string encode_event_batch_result(size_t upserted, size_t deleted, size_t event_count, WireFormat format);
+
+/**
+ * Encode the {"received", "applied"} reply to POST /events/interactions.
+ */
+std::string encode_interaction_result(size_t received, size_t applied, WireFormat format);
+
+/**
+ * Encode the {"query", "suggestions", "processing_time_ms"} reply to GET
+ * /suggest; each suggestion is {"text", "kind", "weight"}.
+ */
+std::string encode_suggestions(const std::string& query, const std::vector<Suggestion>& suggestions,
+                               double processing_time_ms, WireFormat format);
+
+/**
+ * Encode an {"error", "message"} object in the given format.
+ */
+std::string encode_error(const std::string& error, const std::string& message, WireFormat format);
+
+/**
+ * Parse an ISO-8601 "YYYY-MM-DDTHH:MM:SS" timestamp (local time).
+ */
+std::time_t parse_iso8601(const std::string& datetime);
+
+} // namespace zerocost
+
+#endif // REQUEST_CODEC_H
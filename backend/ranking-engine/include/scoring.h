@@ -1,12 +1,18 @@
 #ifndef SCORING_H
 #define SCORING_H
 
+#include "category_dictionary.h"
 #include "event.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
 #include <vector>
 #include <string>
 
 namespace zerocost {
 
+class TreeEnsemble;
+
 /**
  * Calculate urgency score based on time until event starts
  * Events starting soon score higher
@@ -17,6 +23,19 @@ namespace zerocost {
  */
 double calculate_urgency_score(std::time_t start_time, std::time_t current_time);
 
+/**
+ * Batch form of calculate_urgency_score over a column of start times.
+ * Branch-free and vectorized; results equal the scalar function's
+ * exactly (timestamps beyond +-2^49 s are clamped in both).
+ * 
+ * @param start_times Event start times (epoch seconds)
+ * @param count Number of events
+ * @param current_time Current time
+ * @param scores Output, count entries
+ */
+void calculate_urgency_scores(const int64_t* start_times, size_t count,
+                              std::time_t current_time, double* scores);
+
 /**
  * Calculate popularity score based on views and saves
  * 
@@ -36,9 +55,24 @@ double calculate_popularity_score(int view_count, int save_count);
  */
 double calculate_freshness_score(std::time_t created_at, std::time_t current_time);
 
+/**
+ * Batch form of calculate_freshness_score over a column of creation times.
+ * Branch-free and vectorized; results equal the scalar function's
+ * exactly (timestamps beyond +-2^49 s are clamped in both).
+ * 
+ * @param created_at Event creation times (epoch seconds)
+ * @param count Number of events
+ * @param current_time Current time
+ * @param scores Output, count entries
+ */
+void calculate_freshness_scores(const int64_t* created_at, size_t count,
+                                std::time_t current_time, double* scores);
+
 /**
  * Calculate text similarity score between query and event
- * Using simple word overlap and fuzzy matching
+ * Using simple word overlap (exact tokens only). Needs no corpus, so it is
+ * kept for scoring a lone event; rankings use Bm25Scorer (text_index.h),
+ * which also tolerates typos.
  * 
  * @param query Search query
  * @param text Event text (title + description)
@@ -47,7 +81,9 @@ double calculate_freshness_score(std::time_t created_at, std::time_t current_tim
 double calculate_text_similarity(const std::string& query, const std::string& text);
 
 /**
- * Calculate category preference score
+ * Calculate category preference score by comparing names. Ranking uses
+ * CategoryMask::score on interned ids; this is the fallback for categories
+ * the dictionary could not intern.
  * 
  * @param event_category Event's category
  * @param preferred_categories User's preferred categories
@@ -57,7 +93,142 @@ double calculate_category_score(const std::string& event_category,
                                 const std::vector<std::string>& preferred_categories);
 
 /**
- * Calculate final composite score for an event
+ * Weights and shape constants of the final score. The defaults are the
+ * built-in ranking; named profiles (see scoring_profiles.h) override them
+ * per request.
+ * 
+ * A profile with a model scores events with it instead: the components
+ * are still computed (with the shape constants) and become the model's
+ * features, and the weights and boost are unused.
+ */
+struct ScoringProfile {
+    std::string name = "default";
+    
+    double weight_distance = 0.30;
+    double weight_urgency = 0.25;
+    double weight_popularity = 0.15;
+    double weight_freshness = 0.15;
+    double weight_category = 0.10;
+    double weight_text_similarity = 0.05;
+    double weight_embedding = 0.0;     // Off unless a profile sets it
+    
+    double distance_scale_km = 50.0;   // Distance score reaches 0 here
+    double boost_radius_km = 1.0;      // Events closer than this are boosted
+    double boost_factor = 1.2;
+    double popularity_scale = 1000.0;  // Weighted engagement that scores 1.0
+    
+    std::shared_ptr<const TreeEnsemble> model;  // Optional learned ranking stage
+};
+
+/**
+ * Combine component scores into the final weighted score, including the
+ * boost for nearby events.
+ * 
+ * @param distance_km Distance from the user (for the proximity boost)
+ * @param distance_score Result of calculate_distance_score
+ * @param urgency_score Result of calculate_urgency_score
+ * @param popularity_score Result of calculate_popularity_score
+ * @param freshness_score Result of calculate_freshness_score
+ * @param category_score Result of calculate_category_score
+ * @param text_similarity Query relevance in [0, 1] (0.5 without a query)
+ * @param embedding_similarity EmbeddingQuery::similarity (0.5 without a query embedding)
+ * @param profile Weights and boost to apply
+ * @return Final score (higher is better)
+ */
+double combine_component_scores(double distance_km,
+                                double distance_score,
+                                double urgency_score,
+                                double popularity_score,
+                                double freshness_score,
+                                double category_score,
+                                double text_similarity,
+                                double embedding_similarity,
+                                const ScoringProfile& profile = ScoringProfile());
+
+/**
+ * Per-event inputs of calculate_final_scores, as parallel arrays.
+ */
+struct ScoreColumns {
+    const double* distance_km;
+    const int64_t* start_time;
+    const int64_t* created_at;
+    const int* view_count;
+    const int* save_count;
+    const double* category_score;   // Already resolved (CategoryMask::score)
+    const double* text_similarity;  // 0.5 without a query
+    const double* embedding_similarity;  // 0.5 without a query embedding
+};
+
+/**
+ * Final scores of a block of events: every component plus the weighted
+ * sum, in one loop that vectorizes (AVX-512 or AVX2 when the CPU has it).
+ * exp and log are polynomial approximations within 2 ulp of libm, so
+ * scores match the scalar component functions to about 1e-15.
+ * 
+ * Components the profile gives zero weight are not computed: each subset
+ * of the distance, urgency, popularity and freshness terms has its own
+ * kernel instantiation, and the profile picks one per call. A profile with
+ * a model computes every component and returns the model's scores.
+ * 
+ * @param columns Component inputs, count entries each
+ * @param count Number of events
+ * @param current_time Current time
+ * @param profile Weights and shape constants
+ * @param scores Output, count entries
+ */
+void calculate_final_scores(const ScoreColumns& columns, size_t count,
+                            std::time_t current_time, const ScoringProfile& profile,
+                            double* scores);
+
+/**
+ * Output of calculate_component_scores: the profile-weighted terms of the
+ * final score, before weighting. Category, text and embedding similarity
+ * are already columns of ScoreColumns.
+ */
+struct ComponentScores {
+    double* distance;
+    double* urgency;
+    double* popularity;
+    double* freshness;
+};
+
+/**
+ * Distance, urgency, popularity and freshness scores of a block of events.
+ * Only the profile's distance_scale_km and popularity_scale are used, so
+ * the result serves every profile sharing those (see same_component_shape).
+ * 
+ * @param columns Component inputs, count entries each
+ * @param count Number of events
+ * @param current_time Current time
+ * @param profile Supplies the distance and popularity scales
+ * @param components Output arrays, count entries each
+ */
+void calculate_component_scores(const ScoreColumns& columns, size_t count,
+                                std::time_t current_time, const ScoringProfile& profile,
+                                const ComponentScores& components);
+
+/**
+ * True if calculate_component_scores gives the same result for both profiles.
+ */
+bool same_component_shape(const ScoringProfile& a, const ScoringProfile& b);
+
+/**
+ * Weigh precomputed components into final scores (or run the profile's
+ * model on them). Gives exactly the result of calculate_final_scores with
+ * the same profile, so one component pass can be shared by several
+ * profiles (A/B variants).
+ * 
+ * @param columns Inputs (distance_km and the category, text and embedding scores are read)
+ * @param components Result of calculate_component_scores
+ * @param count Number of events
+ * @param profile Weights and boost
+ * @param scores Output, count entries
+ */
+void combine_component_scores(const ScoreColumns& columns, const ComponentScores& components,
+                              size_t count, const ScoringProfile& profile, double* scores);
+
+/**
+ * Calculate final composite score for an event with the default profile
  * 
  * @param event Event to score
  * @param user_location User's location and preferences
@@ -68,6 +239,46 @@ double calculate_final_score(const Event& event,
                              const UserLocation& user_location,
                              const std::string& query = "");
 
+/**
+ * Calculate final composite score for an event against preferences already
+ * resolved to a mask (build the mask once per request, not per event)
+ * 
+ * @param event Event to score
+ * @param user_location User's location
+ * @param preferred CategoryMask of user_location.preferred_categories
+ * @param profile Weights and shape constants
+ * @param text_similarity Query relevance in [0, 1] (0.5 without a query)
+ * @param embedding_similarity EmbeddingQuery::similarity (0.5 without a query embedding)
+ * @return Final score (higher is better)
+ */
+double calculate_final_score(const Event& event, 
+                             const UserLocation& user_location,
+                             const CategoryMask& preferred,
+                             const ScoringProfile& profile,
+                             double text_similarity = 0.5,
+                             double embedding_similarity = 0.5);
+
+/**
+ * Break an event's final score down into its components. Computed the way
+ * calculate_final_score computes the score, for the few events a response
+ * explains; ranking itself never builds explanations.
+ * 
+ * @param event Event to explain (distance_km set)
+ * @param user_location User's location
+ * @param preferred CategoryMask of user_location.preferred_categories
+ * @param profile Weights and shape constants
+ * @param text_similarity Query relevance in [0, 1] (0.5 without a query)
+ * @param embedding_similarity EmbeddingQuery::similarity (0.5 without a query embedding)
+ * @return Component scores, weights, boost and the final score (with a
+ *         model, its name in place of weights and boost)
+ */
+ScoreExplanation explain_final_score(const Event& event,
+                                     const UserLocation& user_location,
+                                     const CategoryMask& preferred,
+                                     const ScoringProfile& profile,
+                                     double text_similarity = 0.5,
+                                     double embedding_similarity = 0.5);
+
 /**
  * Check if two events are duplicates based on title, location, and time similarity
  * 
@@ -0,0 +1,133 @@
+#ifndef SCORING_PROFILES_H
+#define SCORING_PROFILES_H
+
+#include "scoring.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <sys/types.h>
+
+namespace zerocost {
+
+/**
+ * Named scoring profiles, read from a JSON file and selected per request:
+ *
+ *   {"profiles": {"nearby": {"weights": {"distance": 0.6, "popularity": 0},
+ *                            "distance_scale_km": 10, "boost_factor": 1.5}}}
+ *
+ * Weights are distance, urgency, popularity, freshness, category, text and
+ * embedding (0 unless set); the other keys are distance_scale_km,
+ * boost_radius_km, boost_factor and popularity_scale. Anything omitted
+ * keeps the built-in value. "default" always exists and may itself be
+ * overridden. "model" names a tree ensemble file (see tree_ensemble.h),
+ * relative to the profile file, that scores events in place of the weights.
+ *
+ * An optional "experiments" object maps experiment ids to the profiles
+ * they compare, e.g. {"ranking-v2": ["default", "nearby"]}; the first is
+ * the control.
+ *
+ * The profile set is immutable and replaced whole: readers take it with
+ * std::atomic_load, and a watcher thread re-reads the file when its or a
+ * model's modification time changes. A file that fails to parse is
+ * reported and the previous set stays in use.
+ */
+class ScoringProfiles {
+public:
+    // Most profiles one request can be ranked with side by side
+    static constexpr size_t MAX_VARIANTS = 8;
+
+    /**
+     * @param path Profile file, or empty for only the built-in default
+     */
+    explicit ScoringProfiles(std::string path = "");
+    ~ScoringProfiles();
+
+    /**
+     * Read the profile file (no-op without one).
+     *
+     * @throws std::runtime_error if the file cannot be read or is invalid
+     */
+    void load();
+
+    /**
+     * Start re-reading the file whenever it changes, checked every interval.
+     */
+    void start(std::chrono::milliseconds interval);
+
+    void stop();
+
+    /**
+     * Look up a profile. The result stays valid after a reload replaces it.
+     *
+     * @param name Profile name, or empty for "default"
+     * @return The profile, or nullptr if there is none by that name
+     */
+    std::shared_ptr<const ScoringProfile> find(const std::string& name) const;
+
+    /**
+     * Profiles a request asks for: the experiment's if it names one, else
+     * each of names, else the single profile name. Resolved against one
+     * version of the set, so a concurrent reload cannot mix two.
+     *
+     * @throws std::invalid_argument for an unknown profile or experiment,
+     *         or more than MAX_VARIANTS profiles
+     */
+    std::vector<std::shared_ptr<const ScoringProfile>> resolve(const std::string& name,
+                                                               const std::vector<std::string>& names,
+                                                               const std::string& experiment) const;
+
+    size_t size() const;
+
+    uint64_t reloads() const { return reloads_.load(); }
+
+    // A file the current set was read from, as it was when read
+    struct WatchedFile {
+        std::string path;
+        struct timespec modified;
+        off_t size;
+    };
+
+private:
+    using ProfileMap = std::unordered_map<std::string, std::shared_ptr<const ScoringProfile>>;
+
+    struct ProfileSet {
+        ProfileMap profiles;
+        std::unordered_map<std::string, std::vector<std::shared_ptr<const ScoringProfile>>> experiments;
+    };
+
+    /**
+     * load() that appends each file it reads to files as it goes, so the
+     * caller still learns which files were involved when it throws.
+     */
+    void load(std::vector<WatchedFile>& files);
+
+    bool file_changed() const;
+    void watch_loop(std::chrono::milliseconds interval);
+
+    std::string path_;
+
+    // Current set; only accessed through std::atomic_load/atomic_store
+    std::shared_ptr<const ProfileSet> profiles_;
+
+    // The profile file and its models, as last read (watcher thread)
+    std::vector<WatchedFile> watched_;
+    std::atomic<uint64_t> reloads_{0};
+
+    std::mutex watch_mutex_;
+    std::condition_variable watch_cv_;
+    bool stopping_ = false;
+    std::thread watcher_;
+};
+
+} // namespace zerocost
+
+#endif // SCORING_PROFILES_H
@@ -0,0 +1,165 @@
+#ifndef SHARDED_MAP_H
+#define SHARDED_MAP_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+
+namespace zerocost {
+
+/**
+ * Hash map or set split into a fixed number of shards that copies share.
+ * Copying the table copies SHARD_COUNT pointers; the first write to a
+ * shard that another copy still refers to clones just that shard. A
+ * copy-on-write structure that takes a few writes per generation therefore
+ * pays for the shards it touches rather than for the whole table.
+ *
+ * Iteration order is unspecified. Writes may invalidate iterators. Like
+ * std::unordered_map, concurrent reads are safe but a write needs
+ * exclusive access to this copy (other copies are unaffected).
+ */
+template <typename Shard>
+class ShardedTable {
+public:
+    static constexpr int SHARD_BITS = 8;
+    static constexpr size_t SHARD_COUNT = size_t(1) << SHARD_BITS;
+
+    using key_type = typename Shard::key_type;
+    using value_type = typename Shard::value_type;
+
+    class const_iterator {
+    public:
+        const value_type& operator*() const { return *position_; }
+        const value_type* operator->() const { return &*position_; }
+
+        const_iterator& operator++() {
+            ++position_;
+            settle();
+            return *this;
+        }
+
+        bool operator==(const const_iterator& other) const {
+            return shard_ == other.shard_ && (shard_ == SHARD_COUNT || position_ == other.position_);
+        }
+        bool operator!=(const const_iterator& other) const { return !(*this == other); }
+
+    private:
+        friend class ShardedTable;
+
+        const_iterator(const ShardedTable* table, size_t shard) : table_(table), shard_(shard) {
+            if (shard_ < SHARD_COUNT) {
+                position_ = table_->shards_[shard_] ? table_->shards_[shard_]->begin() : position_;
+                settle();
+            }
+        }
+
+        const_iterator(const ShardedTable* table, size_t shard, typename Shard::const_iterator position)
+            : table_(table), shard_(shard), position_(position) {}
+
+        // Move past exhausted or empty shards
+        void settle() {
+            while (shard_ < SHARD_COUNT &&
+                   (!table_->shards_[shard_] || position_ == table_->shards_[shard_]->end())) {
+                if (++shard_ < SHARD_COUNT && table_->shards_[shard_]) {
+                    position_ = table_->shards_[shard_]->begin();
+                }
+            }
+        }
+
+        const ShardedTable* table_;
+        size_t shard_;
+        typename Shard::const_iterator position_{};
+    };
+
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, SHARD_COUNT); }
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    const_iterator find(const key_type& key) const {
+        size_t shard = shard_of(key);
+        if (shards_[shard]) {
+            auto position = shards_[shard]->find(key);
+            if (position != shards_[shard]->end()) {
+                return const_iterator(this, shard, position);
+            }
+        }
+        return end();
+    }
+
+    /**
+     * The value for key, default-constructed if absent (maps only).
+     */
+    template <typename S = Shard>
+    typename S::mapped_type& operator[](const key_type& key) {
+        Shard& shard = writable(shard_of(key));
+        size_t before = shard.size();
+        auto& value = shard[key];
+        size_ += shard.size() - before;
+        return value;
+    }
+
+    /**
+     * Insert unless key is present.
+     *
+     * @return true if inserted
+     */
+    template <typename... Args>
+    bool emplace(const key_type& key, Args&&... args) {
+        bool inserted = writable(shard_of(key)).emplace(key, std::forward<Args>(args)...).second;
+        size_ += inserted ? 1 : 0;
+        return inserted;
+    }
+
+    /**
+     * @return Number of values removed (0 or 1)
+     */
+    size_t erase(const key_type& key) {
+        size_t shard = shard_of(key);
+        if (!shards_[shard] || shards_[shard]->find(key) == shards_[shard]->end()) {
+            return 0;
+        }
+        writable(shard).erase(key);
+        --size_;
+        return 1;
+    }
+
+private:
+    static size_t shard_of(const key_type& key) {
+        // Top bits of a multiplicative mix, so the low bits the shard's own
+        // buckets use stay spread out
+        uint64_t hash = static_cast<uint64_t>(typename Shard::hasher()(key));
+        return static_cast<size_t>((hash * 0x9E3779B97F4A7C15ull) >> (64 - SHARD_BITS));
+    }
+
+    Shard& writable(size_t shard) {
+        std::shared_ptr<Shard>& pointer = shards_[shard];
+        if (!pointer) {
+            pointer = std::make_shared<Shard>();
+        } else if (pointer.use_count() > 1) {
+            // Only this copy can reach a shard with a single owner, so it can
+            // be changed in place; otherwise this copy gets its own
+            pointer = std::make_shared<Shard>(*pointer);
+        }
+        return *pointer;
+    }
+
+    std::array<std::shared_ptr<Shard>, SHARD_COUNT> shards_;
+    size_t size_ = 0;
+};
+
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+using ShardedMap = ShardedTable<std::unordered_map<Key, Value, Hash>>;
+
+template <typename Key, typename Hash = std::hash<Key>>
+using ShardedSet = ShardedTable<std::unordered_set<Key, Hash>>;
+
+} // namespace zerocost
+
+#endif // SHARDED_MAP_H
@@ -0,0 +1,154 @@
+#ifndef SUGGEST_INDEX_H
+#define SUGGEST_INDEX_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace zerocost {
+
+class EventSnapshot;
+class EventStore;
+struct StoreOverlay;
+
+enum class SuggestionKind : uint8_t {
+    Term,       // A word of event titles
+    Category    // A category name
+};
+
+/**
+ * A completion and how popular the events behind it are.
+ */
+struct Suggestion {
+    std::string text;           // Tokenized like event text: lowercase, no punctuation
+    SuggestionKind kind;
+    double weight;              // Sum of 1 + views + 3 * saves over its events
+};
+
+/**
+ * Prefix completion over title terms and category names: a path-compressed
+ * trie in flat arrays, each node holding its TOP_N heaviest suggestions.
+ * Completing a prefix walks at most one node per prefix byte and copies a
+ * precomputed list, so lookups take microseconds whatever the vocabulary.
+ * Immutable once built.
+ */
+class SuggestIndex {
+public:
+    static constexpr size_t TOP_N = 10;
+    static constexpr size_t MAX_LENGTH = 255;   // Longer suggestions are left out
+
+    /**
+     * Build an index. Suggestions with the same text and kind are combined
+     * by adding their weights; those whose total is not positive are
+     * dropped.
+     */
+    static std::shared_ptr<const SuggestIndex> build(std::vector<Suggestion> suggestions);
+
+    /**
+     * Heaviest suggestions starting with prefix, heaviest first.
+     *
+     * @param prefix Tokenized like Suggestion::text
+     * @param limit At most TOP_N
+     * @param completions Appended to; valid while the index is
+     */
+    void complete(std::string_view prefix, size_t limit, std::vector<const Suggestion*>& completions) const;
+
+    /**
+     * Completions for what a search box holds: its last word completed to
+     * title terms (keeping the words before it) and categories, and the
+     * whole query to multi-word category names. Heaviest first.
+     *
+     * @param limit At most TOP_N
+     */
+    std::vector<Suggestion> suggest(std::string_view query, size_t limit) const;
+
+    size_t size() const { return suggestions_.size(); }
+
+private:
+    struct Node {
+        uint32_t label_offset;  // Edge label from the parent, in keys_
+        uint32_t first_child;   // Children are contiguous, ordered by first label byte
+        uint32_t top_offset;    // Heaviest suggestions at or below the node, in top_
+        uint16_t child_count;
+        uint8_t label_length;
+        uint8_t top_count;
+    };
+
+    SuggestIndex() = default;
+    void build_node(uint32_t node, size_t begin, size_t end, size_t depth);
+
+    std::vector<Suggestion> suggestions_;   // Sorted by text, then kind
+    std::string keys_;                      // Texts of suggestions_, concatenated
+    std::vector<uint32_t> key_offsets_;
+    std::vector<Node> nodes_;               // Root first
+    std::vector<uint32_t> top_;             // Indices into suggestions_
+};
+
+/**
+ * Keeps a SuggestIndex of the resident store current. A background thread
+ * checks the store every interval and rebuilds when its generation has
+ * moved on. A snapshot's weights are aggregated once per snapshot
+ * generation; later rebuilds only add what the overlay's writes changed
+ * before laying out the trie again.
+ *
+ * Snapshot rows are weighed by the counts they were compacted with,
+ * recent writes by their live counts.
+ */
+class Autocomplete {
+public:
+    explicit Autocomplete(const EventStore& store);
+    ~Autocomplete();
+
+    /**
+     * Rebuild now if the store changed since the last build.
+     *
+     * @return true if a new index was published
+     */
+    bool refresh();
+
+    /**
+     * Build the first index, then refresh every interval.
+     */
+    void start(std::chrono::milliseconds interval);
+
+    void stop();
+
+    /**
+     * The current index. Never waits for a rebuild.
+     */
+    std::shared_ptr<const SuggestIndex> index() const { return std::atomic_load(&index_); }
+
+    uint64_t rebuilds() const { return rebuilds_.load(); }
+
+private:
+    void refresh_loop(std::chrono::milliseconds interval);
+
+    const EventStore& store_;
+
+    // Current index; only accessed through std::atomic_load/atomic_store
+    std::shared_ptr<const SuggestIndex> index_;
+    std::atomic<uint64_t> rebuilds_{0};
+
+    // What the current index was built from (refresh only)
+    std::mutex refresh_mutex_;
+    std::shared_ptr<const EventSnapshot> snapshot_;
+    std::shared_ptr<const StoreOverlay> overlay_;
+    std::vector<Suggestion> snapshot_suggestions_;
+
+    std::mutex loop_mutex_;
+    std::condition_variable loop_cv_;
+    bool stopping_ = false;
+    std::thread refresher_;
+};
+
+} // namespace zerocost
+
+#endif // SUGGEST_INDEX_H
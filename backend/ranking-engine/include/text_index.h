@@ -0,0 +1,254 @@
+#ifndef TEXT_INDEX_H
+#define TEXT_INDEX_H
+
+#include "sharded_map.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace zerocost {
+
+/**
+ * One distinct term of an event and how often it occurs in each field.
+ * Terms are whitespace-separated words, lowercased with punctuation
+ * removed, identified by a 64-bit FNV-1a hash. An event's entries are
+ * sorted by hash. Part of the snapshot file format.
+ */
+struct TermEntry {
+    uint64_t hash;
+    uint16_t title_count;        // Saturates at 65535
+    uint16_t description_count;
+    uint32_t reserved;
+};
+
+/**
+ * Number of events containing a term. Part of the snapshot file format.
+ */
+struct DocumentFrequency {
+    uint64_t hash;
+    uint32_t documents;
+    uint32_t reserved;
+};
+
+/**
+ * Corpus-wide counts BM25 normalizes by. Part of the snapshot file format.
+ */
+struct TextTotals {
+    uint64_t documents;
+    uint64_t title_terms;        // Sum of title lengths, in terms
+    uint64_t description_terms;
+    uint64_t reserved;
+};
+
+/**
+ * A trigram's run of term ids in TermVocabulary::postings. Part of the
+ * snapshot file format.
+ */
+struct TrigramEntry {
+    uint32_t trigram;            // Three bytes, the first in the high byte
+    uint32_t first;              // Start of its term ids in postings
+};
+
+static_assert(sizeof(TermEntry) == 16, "TermEntry layout is part of the file format");
+static_assert(sizeof(DocumentFrequency) == 16, "DocumentFrequency layout is part of the file format");
+static_assert(sizeof(TextTotals) == 32, "TextTotals layout is part of the file format");
+static_assert(sizeof(TrigramEntry) == 8, "TrigramEntry layout is part of the file format");
+
+/**
+ * Term vector of an event's title and description.
+ *
+ * @param terms Replaced with the event's entries, sorted by hash
+ */
+void extract_terms(std::string_view title, std::string_view description, std::vector<TermEntry>& terms);
+
+/**
+ * Append the terms of a title as text (lowercased, punctuation removed),
+ * in order and with repeats.
+ */
+void extract_title_terms(std::string_view title, std::vector<std::string>& terms);
+
+/**
+ * Edits a query term of this many bytes may be away from the terms it
+ * matches: none below 4 bytes, 1 up to 7 bytes, 2 from 8.
+ */
+uint32_t max_fuzzy_edits(size_t length);
+
+/**
+ * A vocabulary term within a query term's edit budget.
+ */
+struct SimilarTerm {
+    std::string_view term;       // Borrowed from the vocabulary searched
+    uint32_t edits;              // At least 1; exact matches are not reported
+};
+
+/**
+ * Find the terms within max_edits edits of term by scanning a set (for
+ * the few terms written since a snapshot). Edits are as in TermVocabulary.
+ */
+void find_similar_terms(const ShardedSet<std::string>& terms, std::string_view term, uint32_t max_edits,
+                        std::vector<SimilarTerm>& similar);
+
+/**
+ * Distinct title terms of a set of events, sorted by length and then
+ * bytes, with a character trigram index for finding the terms a few edits
+ * away from a misspelled query term. Each term is padded with a space at both ends, so a term of
+ * n bytes has n trigrams; a term listing a trigram appears once in its
+ * postings.
+ *
+ * A read-only view over arrays it does not own (a snapshot's sections or
+ * a VocabularyData).
+ */
+struct TermVocabulary {
+    size_t term_count = 0;
+    const uint32_t* term_offsets = nullptr;   // term_count + 1 entries into text
+    const char* text = nullptr;
+    size_t trigram_count = 0;
+    const TrigramEntry* trigrams = nullptr;   // Sorted, plus one entry ending the last run
+    const uint32_t* postings = nullptr;       // Ascending term ids per trigram
+
+    std::string_view term(size_t i) const {
+        return std::string_view(text + term_offsets[i], term_offsets[i + 1] - term_offsets[i]);
+    }
+
+    bool contains(std::string_view term) const;
+
+    /**
+     * Find the terms within max_edits of term. Candidates must share
+     * enough trigrams with it that max_edits edits could explain the rest
+     * (at least one), then are verified by a bit-parallel (Myers/Hyyrö)
+     * optimal string alignment distance: insertions, deletions,
+     * substitutions and transpositions of adjacent bytes. Terms longer
+     * than 64 bytes are neither expanded nor indexed.
+     *
+     * @param similar Appended to, in vocabulary order
+     */
+    void find_similar(std::string_view term, uint32_t max_edits, std::vector<SimilarTerm>& similar) const;
+};
+
+/**
+ * Arrays behind a TermVocabulary built in memory.
+ */
+struct VocabularyData {
+    std::vector<uint32_t> term_offsets;
+    std::string text;
+    std::vector<TrigramEntry> trigrams;
+    std::vector<uint32_t> postings;
+
+    TermVocabulary view() const;
+};
+
+/**
+ * Build a vocabulary from terms, which may repeat.
+ *
+ * @throws std::length_error if the terms exceed 2^32 bytes
+ */
+VocabularyData build_vocabulary(std::vector<std::string> terms);
+
+/**
+ * Change in corpus statistics from events added and removed since a
+ * snapshot, kept up to date write by write. Over an empty base it is
+ * simply the statistics of the events added. Copies share the frequency
+ * shards they have not written to.
+ */
+struct TextCorpusDelta {
+    ShardedMap<uint64_t, int64_t> document_frequency;
+    int64_t documents = 0;
+    int64_t title_terms = 0;
+    int64_t description_terms = 0;
+
+    void add(const std::vector<TermEntry>& terms) { apply(terms.data(), terms.size(), 1); }
+    void add(const TermEntry* terms, size_t count) { apply(terms, count, 1); }
+    void remove(const std::vector<TermEntry>& terms) { apply(terms.data(), terms.size(), -1); }
+    void remove(const TermEntry* terms, size_t count) { apply(terms, count, -1); }
+
+private:
+    void apply(const TermEntry* terms, size_t count, int64_t sign);
+};
+
+/**
+ * Document frequencies and lengths of a corpus: a snapshot's sorted table
+ * plus an optional delta. Both are borrowed and must outlive the view.
+ */
+class TextCorpus {
+public:
+    TextCorpus() = default;
+    TextCorpus(const DocumentFrequency* frequencies, size_t frequency_count, const TextTotals& totals,
+               const TextCorpusDelta* delta = nullptr);
+
+    uint64_t documents() const { return documents_; }
+    uint64_t document_frequency(uint64_t hash) const;
+    double average_title_terms() const;
+    double average_description_terms() const;
+
+private:
+    const DocumentFrequency* frequencies_ = nullptr;
+    size_t frequency_count_ = 0;
+    const TextCorpusDelta* delta_ = nullptr;
+    uint64_t documents_ = 0;
+    uint64_t title_terms_ = 0;
+    uint64_t description_terms_ = 0;
+};
+
+/**
+ * Query relevance by BM25F: title matches count TITLE_WEIGHT times a
+ * description match, each field is length-normalized against its corpus
+ * average, and the result is divided by the score an ideal event would
+ * reach, so it falls in [0, 1). An event matching no query term scores 0.
+ *
+ * Given vocabularies, each query term also matches up to MAX_EXPANSIONS
+ * terms within max_fuzzy_edits of it, fewest edits and most events first.
+ * A query term and its expansions share one idf (from the most frequent
+ * of them, so a typo weighs like the word it misspells); an expansion's
+ * weight is scaled by 1 - edits / term length, and an event is credited
+ * with its best match per query term.
+ *
+ * Built once per request; scoring an event is a merge of its sorted term
+ * vector with the query's terms, with no tokenizing or allocation.
+ */
+class Bm25Scorer {
+public:
+    static constexpr double K1 = 1.2;
+    static constexpr double B = 0.75;
+    static constexpr double TITLE_WEIGHT = 2.0;
+    static constexpr double DESCRIPTION_WEIGHT = 1.0;
+    static constexpr size_t MAX_QUERY_TERMS = 32;   // Later distinct terms are ignored
+    static constexpr size_t MAX_EXPANSIONS = 8;     // Fuzzy matches per query term
+
+    /**
+     * @param query Search query (tokenized like event text)
+     * @param corpus Statistics to weigh terms by (read only here)
+     * @param vocabulary Terms to expand query terms to (read only here)
+     * @param recent_terms Further terms to expand to, scanned one by one
+     */
+    Bm25Scorer(const std::string& query, const TextCorpus& corpus,
+               const TermVocabulary* vocabulary = nullptr,
+               const ShardedSet<std::string>* recent_terms = nullptr);
+
+    /**
+     * Score an event by its term vector (sorted by hash).
+     */
+    double score(const TermEntry* terms, size_t count) const;
+
+    /**
+     * Score an event from its text (for events without a stored vector).
+     */
+    double score(std::string_view title, std::string_view description) const;
+
+private:
+    struct QueryTerm {
+        uint64_t hash;
+        double weight;  // Query term's idf / sum of the query's idfs, times the fuzzy penalty
+        uint32_t group; // Query term it stands for
+    };
+
+    std::vector<QueryTerm> terms_;      // Sorted by hash; a hash may repeat across groups
+    size_t groups_ = 0;
+    double title_length_factor_;        // B / average title length
+    double description_length_factor_;
+};
+
+} // namespace zerocost
+
+#endif // TEXT_INDEX_H
@@ -0,0 +1,60 @@
+#ifndef TIMING_WHEEL_H
+#define TIMING_WHEEL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace zerocost {
+
+/**
+ * Hierarchical timing wheel of event ids keyed on an expiry time in epoch
+ * seconds. Level l has 64 slots, each 64^l seconds wide; a timer sits in
+ * the lowest level whose span covers it and is cascaded one level down as
+ * its slot comes due, so scheduling is O(1) and advancing costs O(1) per
+ * elapsed second plus the timers that fire. Not thread-safe.
+ *
+ * Timers cannot be cancelled: callers check, when an id fires, that the
+ * event still exists and still ends by then.
+ */
+class TimingWheel {
+public:
+    static constexpr int LEVELS = 4;                  // 64^4 s ~ 194 days before re-cascading
+    static constexpr int SLOT_BITS = 6;
+    static constexpr int64_t SLOTS = int64_t(1) << SLOT_BITS;
+
+    /**
+     * @param now Current time; timers at or before it fire on the next advance
+     */
+    explicit TimingWheel(int64_t now);
+
+    /**
+     * Fire id once the wheel has advanced to when.
+     */
+    void schedule(std::string id, int64_t when);
+
+    /**
+     * Move the wheel to now, appending the ids of timers that came due.
+     */
+    void advance(int64_t now, std::vector<std::string>& due);
+
+    size_t size() const { return size_; }
+
+private:
+    struct Timer {
+        std::string id;
+        int64_t when;
+    };
+
+    void place(Timer timer);
+    void cascade(int level);
+
+    std::vector<Timer> slots_[LEVELS][SLOTS];
+    int64_t current_;       // Last second processed
+    size_t size_ = 0;
+};
+
+} // namespace zerocost
+
+#endif // TIMING_WHEEL_H
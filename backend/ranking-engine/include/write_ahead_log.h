@@ -0,0 +1,145 @@
+#ifndef WRITE_AHEAD_LOG_H
+#define WRITE_AHEAD_LOG_H
+
+#include "event.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace zerocost {
+
+/**
+ * Thrown when the log cannot be written or synced. Once raised, every
+ * later append fails too: the store refuses writes it cannot make durable.
+ */
+class WalError : public std::runtime_error {
+public:
+    explicit WalError(const std::string& message) : std::runtime_error(message) {}
+};
+
+enum class WalRecordType : uint8_t {
+    Upsert = 1,         // event holds the full event
+    Delete = 2,         // only event.id is set
+    Interactions = 3    // interactions holds view/save increments to add
+};
+
+struct WalRecord {
+    WalRecordType type;
+    uint64_t sequence;
+    Event event;
+    std::vector<Interaction> interactions;
+};
+
+struct WalStats {
+    std::atomic<uint64_t> records{0};
+    std::atomic<uint64_t> syncs{0};       // records / syncs is the group commit batch size
+};
+
+/**
+ * Append-only log of store writes, split into segments named
+ * "<base>.wal-<first sequence>". Each record is framed as
+ *
+ *   uint32 length | uint32 crc32c(payload) | payload
+ *   payload = uint8 type | uint64 sequence | body
+ *
+ * Upsert and delete bodies start with the event id. An upsert's body ends
+ * with the event's embedding (uint32 length, then the int8 codes) only
+ * when it has one, so records written before embeddings existed still
+ * replay. An interactions body is a uint32 count followed by that many
+ * (id, int32 views, int32 saves) increments.
+ *
+ * A single flusher thread writes whatever has accumulated and covers it
+ * with one fdatasync, so concurrent writers share the cost of a sync.
+ */
+class WriteAheadLog {
+public:
+    explicit WriteAheadLog(std::string base_path);
+    ~WriteAheadLog();
+
+    /**
+     * Replay every segment on disk in order, then start a new segment and
+     * the flusher. Replay of a segment stops at the first torn or corrupt
+     * record (the tail of a crashed write).
+     *
+     * @param base_sequence Sequence already covered by the snapshot; older
+     *                      records are skipped and numbering continues above it
+     * @param apply Called for each newer intact record, in sequence order
+     * @return Highest sequence seen (at least base_sequence)
+     * @throws WalError if a segment cannot be read or created
+     */
+    uint64_t open(uint64_t base_sequence, const std::function<void(const WalRecord&)>& apply);
+
+    /**
+     * Queue a record without waiting. Records must be appended in
+     * sequence order.
+     *
+     * @throws WalError if the log has failed
+     */
+    void append(const WalRecord& record);
+
+    /**
+     * Block until every record up to sequence is on stable storage.
+     *
+     * @throws WalError if the write or sync failed
+     */
+    void wait_durable(uint64_t sequence);
+
+    /**
+     * Close the current segment and start a new one, so records written
+     * before this call can later be dropped as a unit.
+     */
+    void rotate();
+
+    /**
+     * Delete closed segments whose records are all at or below sequence
+     * (called once a snapshot includes them).
+     */
+    void truncate_through(uint64_t sequence);
+
+    /**
+     * Flush outstanding records and stop the flusher.
+     */
+    void close();
+
+    const WalStats& stats() const { return stats_; }
+    uint64_t durable_sequence() const;
+
+private:
+    struct Segment {
+        std::string path;
+        uint64_t last_sequence;
+    };
+
+    void flush_loop();
+    void open_segment(uint64_t first_sequence);
+    void wait_idle(std::unique_lock<std::mutex>& lock);
+
+    std::string base_path_;
+    std::vector<Segment> closed_segments_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable work_cv_;
+    std::condition_variable durable_cv_;
+    std::string pending_;              // Encoded records not yet written
+    uint64_t pending_sequence_ = 0;    // Highest sequence in pending_ or earlier
+    uint64_t durable_sequence_ = 0;
+    bool flushing_ = false;
+    bool stopping_ = false;
+    std::string error_;                // Set once a write or sync fails
+
+    int fd_ = -1;
+    std::string segment_path_;
+    uint64_t segment_first_sequence_ = 0;
+    std::thread flusher_;
+    WalStats stats_;
+};
+
+} // namespace zerocost
+
+#endif // WRITE_AHEAD_LOG_H
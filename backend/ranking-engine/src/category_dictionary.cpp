@@ -0,0 +1,75 @@
+#include "category_dictionary.h"
+#include <cctype>
+#include <mutex>
+
+namespace zerocost {
+
+CategoryDictionary& CategoryDictionary::global() {
+    static CategoryDictionary dictionary;
+    return dictionary;
+}
+
+bool CategoryDictionary::fold(std::string_view name, std::string& key) {
+    if (name.size() > MAX_NAME_LENGTH) {
+        return false;
+    }
+    key.resize(name.size());
+    for (size_t i = 0; i < name.size(); ++i) {
+        key[i] = static_cast<char>(std::tolower(static_cast<unsigned char>(name[i])));
+    }
+    return true;
+}
+
+uint32_t CategoryDictionary::intern(std::string_view name) {
+    std::string key;
+    if (!fold(name, key)) {
+        return NONE;
+    }
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        auto it = ids_.find(key);
+        if (it != ids_.end()) {
+            return it->second;
+        }
+    }
+
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    if (ids_.size() >= MAX_CATEGORIES) {
+        auto it = ids_.find(key);
+        return it != ids_.end() ? it->second : NONE;
+    }
+    return ids_.emplace(std::move(key), static_cast<uint32_t>(ids_.size())).first->second;
+}
+
+uint32_t CategoryDictionary::find(std::string_view name) const {
+    std::string key;
+    if (!fold(name, key)) {
+        return NONE;
+    }
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    auto it = ids_.find(key);
+    return it != ids_.end() ? it->second : NONE;
+}
+
+size_t CategoryDictionary::size() const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return ids_.size();
+}
+
+CategoryMask::CategoryMask(const std::vector<std::string>& preferred_categories)
+    : active_(!preferred_categories.empty()) {
+    const CategoryDictionary& dictionary = CategoryDictionary::global();
+    for (const auto& name : preferred_categories) {
+        uint32_t id = dictionary.find(name);
+        if (id == CategoryDictionary::NONE) {
+            continue;
+        }
+        size_t word = id >> 6;
+        if (word >= words_.size()) {
+            words_.resize(word + 1, 0);
+        }
+        words_[word] |= uint64_t(1) << (id & 63);
+    }
+}
+
+} // namespace zerocost
@@ -1,11 +1,9 @@
 #include "distance.h"
+#include <algorithm>
 #include <cmath>
 
 namespace zerocost {
 
-constexpr double EARTH_RADIUS_KM = 6371.0;
-constexpr double PI = 3.14159265358979323846;
-
 double to_radians(double degrees) {
     return degrees * PI / 180.0;
 }
@@ -30,6 +28,32 @@ double haversine_distance(double lat1, double lon1, double lat2, double lon2) {
     return EARTH_RADIUS_KM * c;
 }
 
+UnitVector to_unit_vector(double latitude, double longitude) {
+    double lat = to_radians(latitude);
+    double lon = to_radians(longitude);
+    return UnitVector{std::cos(lat) * std::cos(lon), std::cos(lat) * std::sin(lon), std::sin(lat)};
+}
+
+double max_chord_squared(double distance_km) {
+    double angle = distance_km / EARTH_RADIUS_KM;
+    if (angle >= PI) {
+        return 4.0;  // The whole sphere (the diameter is the longest chord)
+    }
+    double chord = 2.0 * std::sin(angle / 2.0);
+    return chord * chord;
+}
+
+double chord_distance(double chord_sq) {
+    // Haversine's a is (chord / 2)^2, so the central angle is 2 asin(chord / 2)
+    double half_chord = std::min(std::sqrt(chord_sq) / 2.0, 1.0);
+    return EARTH_RADIUS_KM * 2.0 * std::asin(half_chord);
+}
+
+LocalProjection make_local_projection(double latitude, double longitude) {
+    double lat = to_radians(latitude);
+    return LocalProjection{lat, to_radians(longitude), std::cos(lat), std::sin(lat)};
+}
+
 double calculate_distance_score(double distance_km, double max_distance_km) {
     if (distance_km >= max_distance_km) {
         return 0.0;
@@ -0,0 +1,146 @@
+#include "event_columns.h"
+#include "request_codec.h"
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+
+namespace zerocost {
+
+namespace {
+
+size_t align8(size_t offset) {
+    return (offset + 7) & ~static_cast<size_t>(7);
+}
+
+/**
+ * Walks the blob handing out aligned, bounds-checked array views.
+ */
+class SectionReader {
+public:
+    SectionReader(const char* data, size_t size, size_t offset)
+        : data_(data), size_(size), offset_(offset) {}
+
+    template <typename T>
+    const T* take(uint64_t count, const char* section) {
+        offset_ = align8(offset_);
+        if (count > (size_ - std::min(offset_, size_)) / sizeof(T)) {
+            throw DecodeError(std::string("columnar blob truncated in ") + section);
+        }
+        const T* array = reinterpret_cast<const T*>(data_ + offset_);
+        offset_ += count * sizeof(T);
+        return array;
+    }
+
+private:
+    const char* data_;
+    size_t size_;
+    size_t offset_;
+};
+
+// Offsets must be non-decreasing and stay inside the heap
+void check_offsets(const uint32_t* offsets, size_t count, size_t heap_size, const char* section) {
+    bool valid = offsets[count - 1] <= heap_size;
+    for (size_t i = 1; i < count; ++i) {
+        valid &= offsets[i - 1] <= offsets[i];
+    }
+    if (!valid) {
+        throw DecodeError(std::string("columnar blob has out-of-range ") + section);
+    }
+}
+
+} // namespace
+
+Event EventColumns::materialize(size_t i) const {
+    Event event;
+    event.id = std::string(id(i));
+    event.title = std::string(title(i));
+    event.description = std::string(description(i));
+    event.latitude = latitude[i];
+    event.longitude = longitude[i];
+    event.start_time = static_cast<std::time_t>(start_time[i]);
+    event.end_time = static_cast<std::time_t>(end_time[i]);
+    event.category = std::string(category_name(category_id[i]));
+    event.view_count = view_count[i];
+    event.save_count = save_count[i];
+    event.created_at = static_cast<std::time_t>(created_at[i]);
+    if (embeddings) {
+        event.embedding.assign(row_embedding(i), row_embedding(i) + row_embedding_size(i));
+    }
+    event.distance_km = 0.0;
+    event.score = 0.0;
+    return event;
+}
+
+ColumnarRankingRequest decode_columnar_request(const char* data, size_t size) {
+    if (size < sizeof(ColumnarHeader)) {
+        throw DecodeError("columnar blob shorter than its header");
+    }
+    if (reinterpret_cast<uintptr_t>(data) % alignof(double) != 0) {
+        throw DecodeError("columnar blob is not 8-byte aligned");
+    }
+
+    ColumnarHeader header;
+    std::memcpy(&header, data, sizeof(header));
+    if (header.magic != COLUMNAR_MAGIC) {
+        throw DecodeError("columnar blob has wrong magic");
+    }
+    if (header.version != COLUMNAR_VERSION) {
+        throw DecodeError("unsupported columnar blob version " + std::to_string(header.version));
+    }
+    if (header.event_count > UINT32_MAX / EventColumns::STRINGS_PER_EVENT) {
+        throw DecodeError("columnar blob has too many events");
+    }
+
+    size_t n = header.event_count;
+    SectionReader reader(data, size, sizeof(ColumnarHeader));
+
+    ColumnarRankingRequest request;
+    EventColumns& columns = request.columns;
+    columns.count = n;
+    columns.latitude = reader.take<double>(n, "latitude");
+    columns.longitude = reader.take<double>(n, "longitude");
+    columns.start_time = reader.take<int64_t>(n, "start_time");
+    columns.end_time = reader.take<int64_t>(n, "end_time");
+    columns.created_at = reader.take<int64_t>(n, "created_at");
+    columns.view_count = reader.take<int32_t>(n, "view_count");
+    columns.save_count = reader.take<int32_t>(n, "save_count");
+    columns.category_id = reader.take<uint32_t>(n, "category_id");
+    columns.string_offsets = reader.take<uint32_t>(n * EventColumns::STRINGS_PER_EVENT + 1, "string_offsets");
+    columns.category_count = header.category_count;
+    columns.category_offsets = reader.take<uint32_t>(static_cast<uint64_t>(header.category_count) + 1,
+                                                     "category_offsets");
+    const uint32_t* preferred = reader.take<uint32_t>(header.preferred_count, "preferred_category_ids");
+    columns.string_heap = reader.take<char>(header.string_heap_size, "string_heap");
+    columns.string_heap_size = header.string_heap_size;
+
+    // Bounds checks: one branch-free pass per index array
+    uint32_t max_category = 0;
+    for (size_t i = 0; i < n; ++i) {
+        max_category = std::max(max_category, columns.category_id[i]);
+    }
+    if (n > 0 && max_category >= header.category_count) {
+        throw DecodeError("columnar blob has out-of-range category_id");
+    }
+    check_offsets(columns.string_offsets, n * EventColumns::STRINGS_PER_EVENT + 1,
+                  columns.string_heap_size, "string_offsets");
+    check_offsets(columns.category_offsets, header.category_count + 1,
+                  columns.string_heap_size, "category_offsets");
+
+    request.preferred_category_ids.assign(preferred, preferred + header.preferred_count);
+    for (uint32_t category : request.preferred_category_ids) {
+        if (category >= header.category_count) {
+            throw DecodeError("columnar blob has out-of-range preferred category");
+        }
+    }
+
+    request.user_location.latitude = header.user_latitude;
+    request.user_location.longitude = header.user_longitude;
+    request.user_location.current_time = header.current_time != 0
+        ? static_cast<std::time_t>(header.current_time)
+        : std::time(nullptr);
+    request.max_distance_km = header.max_distance_km;
+    request.limit = header.limit;
+    return request;
+}
+
+} // namespace zerocost
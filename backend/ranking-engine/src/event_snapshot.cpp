@@ -0,0 +1,621 @@
+#include "event_snapshot.h"
+#include "category_dictionary.h"
+#include "distance.h"
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <ctime>
+#include <unordered_map>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace zerocost {
+
+namespace {
+
+constexpr double CELL_DEGREES = 0.1;
+constexpr uint32_t LAT_CELLS = 1800;
+constexpr uint32_t LON_CELLS = 3600;
+constexpr double SNAPSHOT_EARTH_RADIUS_KM = 6371.0;
+constexpr double DEGREES_PER_RADIAN = 57.29577951308232;
+
+uint32_t lat_cell(double latitude) {
+    double cell = std::floor((latitude + 90.0) / CELL_DEGREES);
+    return static_cast<uint32_t>(std::min(std::max(cell, 0.0), LAT_CELLS - 1.0));
+}
+
+uint32_t lon_cell(double longitude) {
+    double cell = std::floor((longitude + 180.0) / CELL_DEGREES);
+    return static_cast<uint32_t>(std::min(std::max(cell, 0.0), LON_CELLS - 1.0));
+}
+
+uint32_t cell_key(double latitude, double longitude) {
+    return lat_cell(latitude) * LON_CELLS + lon_cell(longitude);
+}
+
+// FNV-1a, stable across processes (unlike std::hash)
+uint64_t hash_id(const char* data, size_t size) {
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+std::string errno_message(const std::string& what, const std::string& path) {
+    return what + " " + path + ": " + std::strerror(errno);
+}
+
+/**
+ * Appends 8-byte-aligned sections after the header and section table.
+ */
+class SnapshotWriter {
+public:
+    explicit SnapshotWriter(size_t section_count)
+        : image_(sizeof(SnapshotHeader) + section_count * sizeof(SnapshotSection), 0) {}
+
+    template <typename T>
+    void add(SnapshotSectionKind kind, const std::vector<T>& values) {
+        add(kind, values.data(), values.size(), sizeof(T));
+    }
+
+    void add(SnapshotSectionKind kind, const void* data, size_t count, size_t element_size) {
+        image_.resize((image_.size() + 7) & ~static_cast<size_t>(7), 0);
+        sections_.push_back(SnapshotSection{static_cast<uint32_t>(kind), static_cast<uint32_t>(element_size),
+                                            image_.size(), count});
+        const char* bytes = static_cast<const char*>(data);
+        image_.insert(image_.end(), bytes, bytes + count * element_size);
+    }
+
+    std::vector<char> finish(SnapshotHeader header) {
+        image_.resize((image_.size() + 7) & ~static_cast<size_t>(7), 0);
+        header.section_count = static_cast<uint32_t>(sections_.size());
+        header.file_size = image_.size();
+        std::memcpy(image_.data(), &header, sizeof(header));
+        std::memcpy(image_.data() + sizeof(header), sections_.data(), sections_.size() * sizeof(SnapshotSection));
+        return std::move(image_);
+    }
+
+private:
+    std::vector<char> image_;
+    std::vector<SnapshotSection> sections_;
+};
+
+std::vector<char> serialize_snapshot(std::vector<Event>& events, uint64_t generation, uint64_t sequence) {
+    // Order rows by grid cell so a radius query reads a few contiguous runs,
+    // and by start time within a cell so time blocks stay narrow
+    std::vector<uint32_t> keys(events.size());
+    std::vector<uint32_t> order(events.size());
+    for (size_t i = 0; i < events.size(); ++i) {
+        keys[i] = cell_key(events[i].latitude, events[i].longitude);
+        order[i] = static_cast<uint32_t>(i);
+    }
+    std::stable_sort(order.begin(), order.end(), [&keys, &events](uint32_t a, uint32_t b) {
+        return keys[a] < keys[b] || (keys[a] == keys[b] && events[a].start_time < events[b].start_time);
+    });
+
+    size_t n = events.size();
+    std::vector<double> latitude(n), longitude(n), unit_x(n), unit_y(n), unit_z(n);
+    std::vector<int64_t> start_time(n), end_time(n), created_at(n);
+    std::vector<int32_t> view_count(n), save_count(n);
+    std::vector<uint32_t> category_id(n), cell_keys(n);
+    std::vector<uint32_t> string_offsets;
+    std::vector<IdIndexEntry> id_index(n);
+    std::vector<std::string> category_names;
+    std::unordered_map<std::string, uint32_t> category_ids;
+    std::string heap;
+    std::vector<uint32_t> term_offsets;
+    std::vector<TermEntry> terms, row_terms;
+    TextCorpusDelta text;   // Statistics of the rows, over an empty base
+    std::vector<std::string> title_terms;
+    std::vector<uint64_t> embedding_offsets;
+    std::vector<int8_t> embeddings;
+
+    string_offsets.reserve(n * EventColumns::STRINGS_PER_EVENT + 1);
+    string_offsets.push_back(0);
+    term_offsets.reserve(n + 1);
+    term_offsets.push_back(0);
+    embedding_offsets.reserve(n + 1);
+    embedding_offsets.push_back(0);
+    auto append_string = [&heap](const std::string& value) {
+        heap += value;
+        if (heap.size() > UINT32_MAX) {
+            throw SnapshotError("snapshot string heap exceeds 4 GiB");
+        }
+        return static_cast<uint32_t>(heap.size());
+    };
+
+    for (size_t row = 0; row < n; ++row) {
+        const Event& event = events[order[row]];
+        latitude[row] = event.latitude;
+        longitude[row] = event.longitude;
+        UnitVector unit = to_unit_vector(event.latitude, event.longitude);
+        unit_x[row] = unit.x;
+        unit_y[row] = unit.y;
+        unit_z[row] = unit.z;
+        start_time[row] = event.start_time;
+        end_time[row] = event.end_time;
+        created_at[row] = event.created_at;
+        view_count[row] = event.view_count;
+        save_count[row] = event.save_count;
+        cell_keys[row] = keys[order[row]];
+
+        auto category = category_ids.emplace(event.category, static_cast<uint32_t>(category_names.size()));
+        if (category.second) {
+            category_names.push_back(event.category);
+        }
+        category_id[row] = category.first->second;
+
+        id_index[row] = IdIndexEntry{hash_id(event.id.data(), event.id.size()), static_cast<uint32_t>(row), 0};
+        string_offsets.push_back(append_string(event.id));
+        string_offsets.push_back(append_string(event.title));
+        string_offsets.push_back(append_string(event.description));
+
+        extract_terms(event.title, event.description, row_terms);
+        terms.insert(terms.end(), row_terms.begin(), row_terms.end());
+        if (terms.size() > UINT32_MAX) {
+            throw SnapshotError("snapshot term vectors exceed 2^32 entries");
+        }
+        term_offsets.push_back(static_cast<uint32_t>(terms.size()));
+        text.add(row_terms);
+        extract_title_terms(event.title, title_terms);
+
+        embeddings.insert(embeddings.end(), event.embedding.begin(), event.embedding.end());
+        embedding_offsets.push_back(embeddings.size());
+    }
+    VocabularyData vocabulary = build_vocabulary(std::move(title_terms));
+
+    std::vector<DocumentFrequency> document_frequencies;
+    document_frequencies.reserve(text.document_frequency.size());
+    for (const auto& term : text.document_frequency) {
+        document_frequencies.push_back(DocumentFrequency{term.first, static_cast<uint32_t>(term.second), 0});
+    }
+    std::sort(document_frequencies.begin(), document_frequencies.end(),
+              [](const DocumentFrequency& a, const DocumentFrequency& b) { return a.hash < b.hash; });
+    TextTotals text_totals = {static_cast<uint64_t>(text.documents), static_cast<uint64_t>(text.title_terms),
+                              static_cast<uint64_t>(text.description_terms), 0};
+
+    std::vector<uint32_t> category_offsets;
+    category_offsets.push_back(static_cast<uint32_t>(heap.size()));
+    for (const auto& name : category_names) {
+        category_offsets.push_back(append_string(name));
+    }
+
+    std::sort(id_index.begin(), id_index.end(), [](const IdIndexEntry& a, const IdIndexEntry& b) {
+        return a.hash < b.hash || (a.hash == b.hash && a.row < b.row);
+    });
+
+    std::vector<uint32_t> expiry_order(n);
+    for (size_t row = 0; row < n; ++row) {
+        expiry_order[row] = static_cast<uint32_t>(row);
+    }
+    std::stable_sort(expiry_order.begin(), expiry_order.end(), [&end_time](uint32_t a, uint32_t b) {
+        return end_time[a] < end_time[b];
+    });
+
+    std::vector<StartTimeBlock> start_blocks((n + SNAPSHOT_BLOCK_ROWS - 1) / SNAPSHOT_BLOCK_ROWS);
+    for (size_t row = 0; row < n; ++row) {
+        StartTimeBlock& block = start_blocks[row / SNAPSHOT_BLOCK_ROWS];
+        if (row % SNAPSHOT_BLOCK_ROWS == 0) {
+            block.min = block.max = start_time[row];
+        }
+        block.min = std::min(block.min, start_time[row]);
+        block.max = std::max(block.max, start_time[row]);
+    }
+
+    SnapshotWriter writer(28);
+    writer.add(SnapshotSectionKind::Latitude, latitude);
+    writer.add(SnapshotSectionKind::Longitude, longitude);
+    writer.add(SnapshotSectionKind::StartTime, start_time);
+    writer.add(SnapshotSectionKind::EndTime, end_time);
+    writer.add(SnapshotSectionKind::CreatedAt, created_at);
+    writer.add(SnapshotSectionKind::ViewCount, view_count);
+    writer.add(SnapshotSectionKind::SaveCount, save_count);
+    writer.add(SnapshotSectionKind::CategoryId, category_id);
+    writer.add(SnapshotSectionKind::StringOffsets, string_offsets);
+    writer.add(SnapshotSectionKind::CategoryOffsets, category_offsets);
+    writer.add(SnapshotSectionKind::StringHeap, heap.data(), heap.size(), 1);
+    writer.add(SnapshotSectionKind::CellKey, cell_keys);
+    writer.add(SnapshotSectionKind::IdIndex, id_index);
+    writer.add(SnapshotSectionKind::ExpiryOrder, expiry_order);
+    writer.add(SnapshotSectionKind::StartTimeBlocks, start_blocks);
+    writer.add(SnapshotSectionKind::UnitX, unit_x);
+    writer.add(SnapshotSectionKind::UnitY, unit_y);
+    writer.add(SnapshotSectionKind::UnitZ, unit_z);
+    writer.add(SnapshotSectionKind::TermOffsets, term_offsets);
+    writer.add(SnapshotSectionKind::Terms, terms);
+    writer.add(SnapshotSectionKind::DocumentFrequencies, document_frequencies);
+    writer.add(SnapshotSectionKind::TextTotals, &text_totals, 1, sizeof(text_totals));
+    writer.add(SnapshotSectionKind::VocabularyOffsets, vocabulary.term_offsets);
+    writer.add(SnapshotSectionKind::VocabularyText, vocabulary.text.data(), vocabulary.text.size(), 1);
+    writer.add(SnapshotSectionKind::Trigrams, vocabulary.trigrams);
+    writer.add(SnapshotSectionKind::TrigramPostings, vocabulary.postings);
+    writer.add(SnapshotSectionKind::EmbeddingOffsets, embedding_offsets);
+    writer.add(SnapshotSectionKind::Embeddings, embeddings);
+
+    SnapshotHeader header = {};
+    header.magic = SNAPSHOT_MAGIC;
+    header.version = SNAPSHOT_VERSION;
+    header.generation = generation;
+    header.sequence = sequence;
+    header.event_count = n;
+    header.category_count = static_cast<uint32_t>(category_names.size());
+    header.created_at = static_cast<int64_t>(std::time(nullptr));
+    return writer.finish(header);
+}
+
+void write_fully(int fd, const char* data, size_t size, const std::string& path) {
+    while (size > 0) {
+        ssize_t written = ::write(fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw SnapshotError(errno_message("cannot write", path));
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+}
+
+void sync_parent_directory(const std::string& path) {
+    size_t slash = path.find_last_of('/');
+    std::string directory = slash == std::string::npos ? "." : path.substr(0, std::max<size_t>(slash, 1));
+    int fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd >= 0) {
+        ::fsync(fd);
+        ::close(fd);
+    }
+}
+
+} // namespace
+
+std::shared_ptr<const EventSnapshot> EventSnapshot::open(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw SnapshotError(errno_message("cannot open", path));
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(SnapshotHeader))) {
+        ::close(fd);
+        throw SnapshotError("snapshot " + path + " is truncated");
+    }
+
+    size_t size = static_cast<size_t>(st.st_size);
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        throw SnapshotError(errno_message("cannot map", path));
+    }
+    // Start readahead without waiting for it
+    madvise(mapping, size, MADV_WILLNEED);
+
+    std::shared_ptr<EventSnapshot> snapshot(new EventSnapshot());
+    snapshot->mapping_ = mapping;
+    snapshot->mapping_size_ = size;
+    try {
+        snapshot->attach(static_cast<const char*>(mapping), size);
+    } catch (const SnapshotError& e) {
+        throw SnapshotError("snapshot " + path + ": " + e.what());
+    }
+    return snapshot;
+}
+
+std::shared_ptr<const EventSnapshot> EventSnapshot::build(std::vector<Event> events, uint64_t generation,
+                                                          uint64_t sequence) {
+    std::vector<char> image = serialize_snapshot(events, generation, sequence);
+
+    std::shared_ptr<EventSnapshot> snapshot(new EventSnapshot());
+    snapshot->buffer_.resize(image.size() / sizeof(uint64_t));
+    std::memcpy(snapshot->buffer_.data(), image.data(), image.size());
+    snapshot->attach(reinterpret_cast<const char*>(snapshot->buffer_.data()), image.size());
+    return snapshot;
+}
+
+std::shared_ptr<const EventSnapshot> EventSnapshot::empty() {
+    return build({}, 0, 0);
+}
+
+EventSnapshot::~EventSnapshot() {
+    if (mapping_) {
+        munmap(mapping_, mapping_size_);
+    }
+}
+
+void EventSnapshot::attach(const char* data, size_t size) {
+    std::memcpy(&header_, data, sizeof(header_));
+    if (header_.magic != SNAPSHOT_MAGIC) {
+        throw SnapshotError("wrong magic");
+    }
+    if (header_.version != SNAPSHOT_VERSION) {
+        throw SnapshotError("unsupported version " + std::to_string(header_.version));
+    }
+    if (header_.file_size != size) {
+        throw SnapshotError("size does not match header");
+    }
+    if (header_.section_count > (size - sizeof(SnapshotHeader)) / sizeof(SnapshotSection)) {
+        throw SnapshotError("section table truncated");
+    }
+
+    size_t n = header_.event_count;
+    const SnapshotSection* sections = reinterpret_cast<const SnapshotSection*>(data + sizeof(SnapshotHeader));
+
+    auto find_section = [&](SnapshotSectionKind kind, size_t element_size, uint64_t count) -> const void* {
+        for (uint32_t i = 0; i < header_.section_count; ++i) {
+            const SnapshotSection& s = sections[i];
+            if (s.kind != static_cast<uint32_t>(kind)) {
+                continue;
+            }
+            if (s.element_size != element_size || s.count != count || s.offset % 8 != 0 ||
+                s.offset > size || s.count > (size - s.offset) / element_size) {
+                throw SnapshotError("malformed section " + std::to_string(s.kind));
+            }
+            return data + s.offset;
+        }
+        return nullptr;
+    };
+    auto section = [&](SnapshotSectionKind kind, size_t element_size, uint64_t count) -> const void* {
+        const void* found = find_section(kind, element_size, count);
+        if (!found) {
+            throw SnapshotError("missing section " + std::to_string(static_cast<uint32_t>(kind)));
+        }
+        return found;
+    };
+
+    // Element count of a section sized by its contents, 0 if absent
+    auto section_count = [&](SnapshotSectionKind kind) -> uint64_t {
+        for (uint32_t i = 0; i < header_.section_count; ++i) {
+            if (sections[i].kind == static_cast<uint32_t>(kind)) {
+                return sections[i].count;
+            }
+        }
+        return 0;
+    };
+
+    const SnapshotSection* heap_section = nullptr;
+    for (uint32_t i = 0; i < header_.section_count; ++i) {
+        if (sections[i].kind == static_cast<uint32_t>(SnapshotSectionKind::StringHeap)) {
+            heap_section = &sections[i];
+        }
+    }
+    if (!heap_section) {
+        throw SnapshotError("missing string heap");
+    }
+
+    columns_.count = n;
+    columns_.latitude = static_cast<const double*>(section(SnapshotSectionKind::Latitude, sizeof(double), n));
+    columns_.longitude = static_cast<const double*>(section(SnapshotSectionKind::Longitude, sizeof(double), n));
+    columns_.start_time = static_cast<const int64_t*>(section(SnapshotSectionKind::StartTime, sizeof(int64_t), n));
+    columns_.end_time = static_cast<const int64_t*>(section(SnapshotSectionKind::EndTime, sizeof(int64_t), n));
+    columns_.created_at = static_cast<const int64_t*>(section(SnapshotSectionKind::CreatedAt, sizeof(int64_t), n));
+    columns_.view_count = static_cast<const int32_t*>(section(SnapshotSectionKind::ViewCount, sizeof(int32_t), n));
+    columns_.save_count = static_cast<const int32_t*>(section(SnapshotSectionKind::SaveCount, sizeof(int32_t), n));
+    columns_.category_id = static_cast<const uint32_t*>(section(SnapshotSectionKind::CategoryId, sizeof(uint32_t), n));
+    columns_.string_offsets = static_cast<const uint32_t*>(
+        section(SnapshotSectionKind::StringOffsets, sizeof(uint32_t), n * EventColumns::STRINGS_PER_EVENT + 1));
+    columns_.category_count = header_.category_count;
+    columns_.category_offsets = static_cast<const uint32_t*>(
+        section(SnapshotSectionKind::CategoryOffsets, sizeof(uint32_t), static_cast<uint64_t>(header_.category_count) + 1));
+    columns_.string_heap = static_cast<const char*>(section(SnapshotSectionKind::StringHeap, 1, heap_section->count));
+    columns_.string_heap_size = heap_section->count;
+    cell_keys_ = static_cast<const uint32_t*>(section(SnapshotSectionKind::CellKey, sizeof(uint32_t), n));
+    id_index_ = static_cast<const IdIndexEntry*>(section(SnapshotSectionKind::IdIndex, sizeof(IdIndexEntry), n));
+    expiry_order_ = static_cast<const uint32_t*>(find_section(SnapshotSectionKind::ExpiryOrder, sizeof(uint32_t), n));
+    start_blocks_ = static_cast<const StartTimeBlock*>(find_section(
+        SnapshotSectionKind::StartTimeBlocks, sizeof(StartTimeBlock), (n + SNAPSHOT_BLOCK_ROWS - 1) / SNAPSHOT_BLOCK_ROWS));
+    columns_.unit_x = static_cast<const double*>(find_section(SnapshotSectionKind::UnitX, sizeof(double), n));
+    columns_.unit_y = static_cast<const double*>(find_section(SnapshotSectionKind::UnitY, sizeof(double), n));
+    columns_.unit_z = static_cast<const double*>(find_section(SnapshotSectionKind::UnitZ, sizeof(double), n));
+    if (!columns_.unit_x || !columns_.unit_y || !columns_.unit_z) {
+        columns_.unit_x = columns_.unit_y = columns_.unit_z = nullptr;
+    }
+
+    // Text sections are used together or not at all
+    const uint32_t* term_offsets = static_cast<const uint32_t*>(
+        find_section(SnapshotSectionKind::TermOffsets, sizeof(uint32_t), n + 1));
+    const TermEntry* terms = static_cast<const TermEntry*>(find_section(
+        SnapshotSectionKind::Terms, sizeof(TermEntry), section_count(SnapshotSectionKind::Terms)));
+    uint64_t frequency_count = section_count(SnapshotSectionKind::DocumentFrequencies);
+    const DocumentFrequency* frequencies = static_cast<const DocumentFrequency*>(find_section(
+        SnapshotSectionKind::DocumentFrequencies, sizeof(DocumentFrequency), frequency_count));
+    const TextTotals* totals = static_cast<const TextTotals*>(
+        find_section(SnapshotSectionKind::TextTotals, sizeof(TextTotals), 1));
+    if (term_offsets && terms && frequencies && totals) {
+        if (term_offsets[n] != section_count(SnapshotSectionKind::Terms)) {
+            throw SnapshotError("term offsets do not match the term vectors");
+        }
+        columns_.term_offsets = term_offsets;
+        columns_.terms = terms;
+        document_frequencies_ = frequencies;
+        document_frequency_count_ = frequency_count;
+        text_totals_ = *totals;
+    }
+
+    // Likewise the vocabulary; its term and trigram counts come from the section table
+    uint64_t vocabulary_terms = section_count(SnapshotSectionKind::VocabularyOffsets);
+    uint64_t trigram_entries = section_count(SnapshotSectionKind::Trigrams);
+    const uint32_t* vocabulary_offsets = static_cast<const uint32_t*>(
+        find_section(SnapshotSectionKind::VocabularyOffsets, sizeof(uint32_t), vocabulary_terms));
+    const char* vocabulary_text = static_cast<const char*>(find_section(
+        SnapshotSectionKind::VocabularyText, 1, section_count(SnapshotSectionKind::VocabularyText)));
+    const TrigramEntry* trigrams = static_cast<const TrigramEntry*>(
+        find_section(SnapshotSectionKind::Trigrams, sizeof(TrigramEntry), trigram_entries));
+    uint64_t posting_count = section_count(SnapshotSectionKind::TrigramPostings);
+    const uint32_t* postings = static_cast<const uint32_t*>(
+        find_section(SnapshotSectionKind::TrigramPostings, sizeof(uint32_t), posting_count));
+    if (vocabulary_offsets && vocabulary_text && trigrams && postings && vocabulary_terms > 0 &&
+        trigram_entries > 0) {
+        if (vocabulary_offsets[vocabulary_terms - 1] != section_count(SnapshotSectionKind::VocabularyText) ||
+            trigrams[trigram_entries - 1].first != posting_count) {
+            throw SnapshotError("vocabulary sections do not match");
+        }
+        vocabulary_.term_count = vocabulary_terms - 1;
+        vocabulary_.term_offsets = vocabulary_offsets;
+        vocabulary_.text = vocabulary_text;
+        vocabulary_.trigram_count = trigram_entries - 1;
+        vocabulary_.trigrams = trigrams;
+        vocabulary_.postings = postings;
+    }
+
+    // Embeddings likewise; rows without one have an empty span
+    const uint64_t* embedding_offsets = static_cast<const uint64_t*>(
+        find_section(SnapshotSectionKind::EmbeddingOffsets, sizeof(uint64_t), n + 1));
+    const int8_t* embeddings = static_cast<const int8_t*>(find_section(
+        SnapshotSectionKind::Embeddings, 1, section_count(SnapshotSectionKind::Embeddings)));
+    if (embedding_offsets && embeddings) {
+        if (embedding_offsets[n] != section_count(SnapshotSectionKind::Embeddings)) {
+            throw SnapshotError("embedding offsets do not match the embeddings");
+        }
+        columns_.embedding_offsets = embedding_offsets;
+        columns_.embeddings = embeddings;
+    }
+
+    // Snapshots are only produced by write_snapshot and published by rename,
+    // so the per-row arrays are trusted; checking just the end offsets keeps
+    // open() from touching every page
+    if (columns_.string_offsets[n * EventColumns::STRINGS_PER_EVENT] > columns_.string_heap_size ||
+        columns_.category_offsets[header_.category_count] > columns_.string_heap_size) {
+        throw SnapshotError("string offsets exceed the heap");
+    }
+
+    // Category tables are small, so interning them here touches few pages
+    dictionary_ids_.resize(header_.category_count);
+    for (uint32_t category = 0; category < header_.category_count; ++category) {
+        dictionary_ids_[category] = CategoryDictionary::global().intern(columns_.category_name(category));
+    }
+}
+
+TextCorpus EventSnapshot::text_corpus(const TextCorpusDelta* delta) const {
+    return TextCorpus(document_frequencies_, document_frequency_count_, text_totals_, delta);
+}
+
+int64_t EventSnapshot::find(const std::string& id) const {
+    uint64_t hash = hash_id(id.data(), id.size());
+    const IdIndexEntry* end = id_index_ + columns_.count;
+    const IdIndexEntry* entry = std::lower_bound(id_index_, end, hash, [](const IdIndexEntry& e, uint64_t h) {
+        return e.hash < h;
+    });
+    for (; entry != end && entry->hash == hash; ++entry) {
+        if (columns_.id(entry->row) == id) {
+            return entry->row;
+        }
+    }
+    return -1;
+}
+
+void EventSnapshot::rows_near(double latitude, double longitude, double radius_km,
+                              std::vector<RowRange>& ranges) const {
+    if (columns_.count == 0) {
+        return;
+    }
+
+    // Bounding box of the spherical cap (same earth radius as haversine)
+    double angular = radius_km / SNAPSHOT_EARTH_RADIUS_KM;
+    double lat_min = latitude - angular * DEGREES_PER_RADIAN;
+    double lat_max = latitude + angular * DEGREES_PER_RADIAN;
+    if (lat_min <= -90.0 || lat_max >= 90.0) {
+        // Cap reaches a pole: every longitude is in range
+        ranges.emplace_back(
+            std::lower_bound(cell_keys_, cell_keys_ + columns_.count, lat_cell(lat_min) * LON_CELLS) - cell_keys_,
+            std::upper_bound(cell_keys_, cell_keys_ + columns_.count, lat_cell(lat_max) * LON_CELLS + LON_CELLS - 1) - cell_keys_);
+        return;
+    }
+
+    double lat_radians = latitude / DEGREES_PER_RADIAN;
+    double ratio = std::sin(angular) / std::cos(lat_radians);
+    double lon_delta = ratio >= 1.0 ? 180.0 : std::asin(ratio) * DEGREES_PER_RADIAN;
+
+    // Longitude intervals in cell units, split at the antimeridian
+    std::pair<uint32_t, uint32_t> lon_spans[2];
+    size_t span_count = 0;
+    if (lon_delta >= 180.0) {
+        lon_spans[span_count++] = {0, LON_CELLS - 1};
+    } else {
+        double lon_min = longitude - lon_delta;
+        double lon_max = longitude + lon_delta;
+        if (lon_min < -180.0) {
+            lon_spans[span_count++] = {lon_cell(lon_min + 360.0), LON_CELLS - 1};
+            lon_spans[span_count++] = {0, lon_cell(lon_max)};
+        } else if (lon_max > 180.0) {
+            lon_spans[span_count++] = {lon_cell(lon_min), LON_CELLS - 1};
+            lon_spans[span_count++] = {0, lon_cell(lon_max - 360.0)};
+        } else {
+            lon_spans[span_count++] = {lon_cell(lon_min), lon_cell(lon_max)};
+        }
+    }
+
+    const uint32_t* begin = cell_keys_;
+    const uint32_t* end = cell_keys_ + columns_.count;
+    for (uint32_t row = lat_cell(lat_min); row <= lat_cell(lat_max); ++row) {
+        for (size_t s = 0; s < span_count; ++s) {
+            size_t first = std::lower_bound(begin, end, row * LON_CELLS + lon_spans[s].first) - cell_keys_;
+            size_t last = std::upper_bound(begin, end, row * LON_CELLS + lon_spans[s].second) - cell_keys_;
+            if (first == last) {
+                continue;
+            }
+            if (!ranges.empty() && ranges.back().second == first) {
+                ranges.back().second = last;
+            } else {
+                ranges.emplace_back(first, last);
+            }
+        }
+    }
+}
+
+void EventSnapshot::restrict_to_window(const StartWindow& window, std::vector<RowRange>& ranges) const {
+    if (!start_blocks_ || !window.bounded()) {
+        return;
+    }
+
+    std::vector<RowRange> kept;
+    for (const auto& range : ranges) {
+        for (size_t row = range.first; row < range.second;) {
+            const StartTimeBlock& block = start_blocks_[row / SNAPSHOT_BLOCK_ROWS];
+            size_t block_end = std::min(range.second, (row / SNAPSHOT_BLOCK_ROWS + 1) * SNAPSHOT_BLOCK_ROWS);
+            if (block.max >= window.after && block.min <= window.before) {
+                if (!kept.empty() && kept.back().second == row) {
+                    kept.back().second = block_end;
+                } else {
+                    kept.emplace_back(row, block_end);
+                }
+            }
+            row = block_end;
+        }
+    }
+    ranges.swap(kept);
+}
+
+void write_snapshot(const std::string& path, std::vector<Event> events, uint64_t generation,
+                    uint64_t sequence) {
+    std::vector<char> image = serialize_snapshot(events, generation, sequence);
+
+    std::string temp_path = path + ".tmp";
+    int fd = ::open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        throw SnapshotError(errno_message("cannot create", temp_path));
+    }
+    try {
+        write_fully(fd, image.data(), image.size(), temp_path);
+        if (fdatasync(fd) != 0) {
+            throw SnapshotError(errno_message("cannot sync", temp_path));
+        }
+    } catch (...) {
+        ::close(fd);
+        ::unlink(temp_path.c_str());
+        throw;
+    }
+    ::close(fd);
+
+    if (::rename(temp_path.c_str(), path.c_str()) != 0) {
+        ::unlink(temp_path.c_str());
+        throw SnapshotError(errno_message("cannot publish", path));
+    }
+    sync_parent_directory(path);
+}
+
+} // namespace zerocost
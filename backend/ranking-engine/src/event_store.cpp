@@ -0,0 +1,675 @@
+#include "event_store.h"
+#include "category_dictionary.h"
+#include <algorithm>
+#include <ctime>
+#include <iostream>
+#include <sys/stat.h>
+
+namespace zerocost {
+
+namespace {
+
+constexpr std::chrono::seconds EXPIRY_TICK(1);
+constexpr size_t EXPIRY_BATCH = 1024;   // Events removed per generation, to keep rounds short
+
+// Take a snapshot row out of the overlay's term statistics (a no-op for
+// snapshots without term vectors, whose statistics are empty)
+void remove_row_terms(const EventSnapshot& snapshot, int64_t row, TextCorpusDelta& text) {
+    const EventColumns& columns = snapshot.columns();
+    if (columns.terms) {
+        text.remove(columns.row_terms(static_cast<size_t>(row)), columns.row_term_count(static_cast<size_t>(row)));
+    }
+}
+
+// Mask a snapshot row, keeping masked_rows sorted and unique
+void mask_row(std::vector<uint32_t>& masked_rows, int64_t row) {
+    auto position = std::lower_bound(masked_rows.begin(), masked_rows.end(), static_cast<uint32_t>(row));
+    if (position == masked_rows.end() || *position != static_cast<uint32_t>(row)) {
+        masked_rows.insert(position, static_cast<uint32_t>(row));
+    }
+}
+
+// Record the title terms of a write that fuzzy search cannot find in the snapshot's vocabulary
+void add_title_terms(const EventSnapshot& snapshot, const std::string& title, ShardedSet<std::string>& recent) {
+    std::vector<std::string> terms;
+    extract_title_terms(title, terms);
+    for (const std::string& term : terms) {
+        if (recent.find(term) == recent.end() && !snapshot.vocabulary().contains(term)) {
+            recent.emplace(term);
+        }
+    }
+}
+
+} // namespace
+
+bool StoreOverlay::masks(size_t row) const {
+    return !masked_rows.empty() &&
+           std::binary_search(masked_rows.begin(), masked_rows.end(), static_cast<uint32_t>(row));
+}
+
+size_t StoreView::size() const {
+    return snapshot->size() - overlay->masked_rows.size() + overlay->live_entries;
+}
+
+EventStore::EventStore(StoreOptions options)
+    : options_(std::move(options)),
+      generation_(std::make_shared<const StoreView>(
+          StoreView{EventSnapshot::empty(), std::make_shared<const StoreOverlay>(), std::make_shared<RowSlots>(0),
+                    &counters_})),
+      wheel_(std::time(nullptr)) {}
+
+EventStore::~EventStore() {
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        stopping_writer_ = true;
+        stopping_compactor_ = true;
+    }
+    queue_cv_.notify_all();
+    compaction_cv_.notify_all();
+    if (compactor_.joinable()) {
+        compactor_.join();
+    }
+    if (writer_.joinable()) {
+        writer_.join();
+    }
+}
+
+size_t EventStore::load() {
+    struct stat st;
+    std::shared_ptr<const EventSnapshot> snapshot = EventSnapshot::empty();
+    if (!options_.snapshot_path.empty() && stat(options_.snapshot_path.c_str(), &st) == 0) {
+        snapshot = EventSnapshot::open(options_.snapshot_path);
+    }
+
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    sequence_ = snapshot->sequence();
+    auto overlay = std::make_shared<StoreOverlay>();
+
+    // Rows get counter slots as they are interacted with
+    auto row_slots = std::make_shared<RowSlots>(snapshot->size());
+    StoreView base{snapshot, nullptr, row_slots, &counters_};
+
+    if (!options_.snapshot_path.empty() && options_.write_ahead_log) {
+        // Replay only writes the snapshot does not already include
+        wal_.reset(new WriteAheadLog(options_.snapshot_path));
+        sequence_ = wal_->open(snapshot->sequence(), [&](const WalRecord& record) {
+            if (record.type == WalRecordType::Upsert) {
+                apply_upsert(base, *overlay, record.event, record.sequence);
+            } else if (record.type == WalRecordType::Interactions) {
+                for (const auto& interaction : record.interactions) {
+                    int64_t slot = counter_slot(base, *overlay, interaction.event_id);
+                    if (slot >= 0) {
+                        counters_.add(static_cast<uint32_t>(slot), interaction.views, interaction.saves);
+                    }
+                }
+            } else {
+                apply_delete(base, *overlay, record.event.id, record.sequence);
+            }
+        });
+    }
+
+    publish(snapshot, std::move(row_slots), std::move(overlay));
+    return view().size();
+}
+
+void EventStore::start() {
+    writer_ = std::thread(&EventStore::writer_loop, this);
+    compactor_ = std::thread(&EventStore::compaction_loop, this);
+}
+
+void EventStore::stop() {
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        stopping_compactor_ = true;
+    }
+    compaction_cv_.notify_all();
+    if (compactor_.joinable()) {
+        compactor_.join();
+    }
+
+    // The writer drains its queue before exiting
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        stopping_writer_ = true;
+    }
+    queue_cv_.notify_all();
+    if (writer_.joinable()) {
+        writer_.join();
+    }
+
+    compact();
+    if (wal_) {
+        wal_->close();
+    }
+}
+
+StoreView EventStore::view() const {
+    return *std::atomic_load(&generation_);
+}
+
+void EventStore::publish(std::shared_ptr<const EventSnapshot> snapshot, std::shared_ptr<RowSlots> row_slots,
+                         std::shared_ptr<StoreOverlay> overlay) {
+    // Caller holds writer_mutex_
+    std::atomic_store(&generation_, std::make_shared<const StoreView>(
+        StoreView{std::move(snapshot), std::shared_ptr<const StoreOverlay>(std::move(overlay)),
+                  std::move(row_slots), &counters_}));
+}
+
+void EventStore::apply_upsert(const StoreView& base, StoreOverlay& overlay, Event event, uint64_t sequence) {
+    // Decoders only look categories up; a stored event is what adds one
+    event.category_id = CategoryDictionary::global().intern(event.category);
+    int64_t row = base.snapshot->find(event.id);
+    auto existing = overlay.entries.find(event.id);
+
+    // A replaced event keeps its counter slot; re-sent counts only raise it
+    uint32_t slot;
+    bool end_time_changed = true;
+    if (existing != overlay.entries.end() && !existing->second.deleted) {
+        slot = existing->second.slot;
+        counters_.raise(slot, event.view_count, event.save_count);
+        end_time_changed = existing->second.event.end_time != event.end_time;
+    } else if (existing == overlay.entries.end() && row >= 0) {
+        // The entry takes over the row's counter, or starts one from its columns
+        slot = base.row_slots->find(static_cast<size_t>(row));
+        if (slot == RowSlots::NONE) {
+            slot = counters_.allocate(base.snapshot->columns().view_count[row], base.snapshot->columns().save_count[row]);
+        }
+        counters_.raise(slot, event.view_count, event.save_count);
+        end_time_changed = base.snapshot->columns().end_time[row] != event.end_time;
+    } else {
+        slot = counters_.allocate(event.view_count, event.save_count);
+    }
+    if (options_.expire_events && end_time_changed) {
+        wheel_.schedule(event.id, event.end_time);
+    }
+
+    // The replaced version, if any, leaves the term statistics
+    if (existing != overlay.entries.end()) {
+        overlay.text.remove(existing->second.terms);
+    } else if (row >= 0) {
+        remove_row_terms(*base.snapshot, row, overlay.text);
+    }
+
+    if (row >= 0) {
+        mask_row(overlay.masked_rows, row);
+    }
+    if (existing == overlay.entries.end() || existing->second.deleted) {
+        ++overlay.live_entries;
+    }
+    std::string id = event.id;
+    StoreEntry& entry = overlay.entries[id];
+    entry.event = std::move(event);
+    entry.deleted = false;
+    entry.sequence = sequence;
+    entry.slot = slot;
+    extract_terms(entry.event.title, entry.event.description, entry.terms);
+    overlay.text.add(entry.terms);
+    add_title_terms(*base.snapshot, entry.event.title, overlay.title_terms);
+}
+
+int64_t EventStore::counter_slot(const StoreView& view, const StoreOverlay& overlay, const std::string& id) {
+    // Caller holds writer_mutex_
+    auto entry = overlay.entries.find(id);
+    if (entry != overlay.entries.end()) {
+        return entry->second.deleted ? -1 : static_cast<int64_t>(entry->second.slot);
+    }
+    int64_t row = view.snapshot->find(id);
+    if (row < 0) {
+        return -1;
+    }
+    uint32_t slot = view.row_slots->find(static_cast<size_t>(row));
+    if (slot == RowSlots::NONE) {
+        // First interaction with the row: count on from its columns
+        const EventColumns& columns = view.snapshot->columns();
+        slot = counters_.allocate(columns.view_count[row], columns.save_count[row]);
+        view.row_slots->assign(static_cast<size_t>(row), slot);
+    }
+    return slot;
+}
+
+bool EventStore::apply_delete(const StoreView& base, StoreOverlay& overlay, const std::string& id,
+                              uint64_t sequence) const {
+    auto existing = overlay.entries.find(id);
+    bool live_in_overlay = existing != overlay.entries.end() && !existing->second.deleted;
+    int64_t row = base.snapshot->find(id);
+    bool live_in_snapshot = row >= 0 && existing == overlay.entries.end();
+    if (!live_in_overlay && !live_in_snapshot) {
+        return false;
+    }
+    if (live_in_overlay) {
+        overlay.text.remove(existing->second.terms);
+        --overlay.live_entries;
+    } else {
+        remove_row_terms(*base.snapshot, row, overlay.text);
+    }
+
+    if (row < 0) {
+        // Never reached a snapshot: forgetting the write is enough
+        overlay.entries.erase(id);
+        return true;
+    }
+    mask_row(overlay.masked_rows, row);
+    StoreEntry& entry = overlay.entries[id];
+    entry.event = Event();
+    entry.event.id = id;
+    entry.deleted = true;
+    entry.sequence = sequence;
+    entry.terms.clear();
+    return true;
+}
+
+void EventStore::upsert(std::vector<Event> events) {
+    submit(std::move(events), {});
+}
+
+size_t EventStore::remove(std::vector<std::string> ids) {
+    return submit({}, std::move(ids));
+}
+
+size_t EventStore::record_interactions(const std::vector<Interaction>& interactions) {
+    // Serialized with writes: rows may need a counter slot, logged increments
+    // take a sequence number, and compaction reads counts at its folded sequence
+    size_t applied = 0;
+    uint64_t sequence = 0;
+    {
+        std::lock_guard<std::mutex> lock(writer_mutex_);
+        std::shared_ptr<const StoreView> current = std::atomic_load(&generation_);
+        WalRecord record{WalRecordType::Interactions, 0, Event(), {}};
+        std::vector<uint32_t> slots;
+        for (const auto& interaction : interactions) {
+            int64_t slot = counter_slot(*current, *current->overlay, interaction.event_id);
+            if (slot >= 0) {
+                slots.push_back(static_cast<uint32_t>(slot));
+                record.interactions.push_back(interaction);
+            }
+        }
+        if (wal_ && !slots.empty()) {
+            record.sequence = sequence = ++sequence_;
+            wal_->append(record);
+        }
+        for (size_t i = 0; i < slots.size(); ++i) {
+            counters_.add(slots[i], record.interactions[i].views, record.interactions[i].saves);
+        }
+        applied = slots.size();
+        if (!options_.snapshot_path.empty()) {
+            counts_pending_.fetch_add(applied, std::memory_order_relaxed);
+        }
+    }
+    if (sequence > 0) {
+        wal_->wait_durable(sequence);
+        if (counts_pending_.load(std::memory_order_relaxed) >= options_.compact_interactions) {
+            compaction_cv_.notify_one();
+        }
+    }
+
+    interactions_recorded_.fetch_add(applied, std::memory_order_relaxed);
+    return applied;
+}
+
+size_t EventStore::submit(std::vector<Event> upserts, std::vector<std::string> deletes) {
+    std::unique_ptr<PendingWrite> write(new PendingWrite());
+    write->upserts = std::move(upserts);
+    write->deletes = std::move(deletes);
+    std::future<size_t> removed = write->removed.get_future();
+
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        if (writer_.joinable() && !stopping_writer_) {
+            queue_.push_back(std::move(write));
+        }
+    }
+    if (write) {
+        // Writer not running (before start or after stop): apply inline
+        std::vector<std::unique_ptr<PendingWrite>> writes;
+        writes.push_back(std::move(write));
+        apply_writes(writes);
+    } else {
+        queue_cv_.notify_one();
+    }
+    return removed.get();
+}
+
+void EventStore::writer_loop() {
+    std::vector<std::unique_ptr<PendingWrite>> writes;
+    bool expiry_backlog = false;
+    while (true) {
+        {
+            // Wake at least once a tick to expire ended events
+            std::unique_lock<std::mutex> lock(queue_mutex_);
+            queue_cv_.wait_for(lock, expiry_backlog ? std::chrono::seconds(0) : EXPIRY_TICK, [this]() {
+                return stopping_writer_ || !queue_.empty();
+            });
+            if (stopping_writer_ && queue_.empty()) {
+                break;
+            }
+            writes.swap(queue_);
+        }
+
+        if (!writes.empty()) {
+            apply_writes(writes);
+            writes.clear();
+        }
+        if (options_.expire_events) {
+            try {
+                expiry_backlog = expire(std::time(nullptr));
+            } catch (const std::runtime_error& e) {
+                std::cerr << "Expiry failed: " << e.what() << std::endl;
+                expiry_backlog = false;
+            }
+        }
+    }
+}
+
+bool EventStore::expire(int64_t now) {
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    std::shared_ptr<const StoreView> current = std::atomic_load(&generation_);
+    const EventSnapshot& snapshot = *current->snapshot;
+    const EventColumns& columns = snapshot.columns();
+
+    // Candidates: wheel timers that fired, then snapshot rows in end_time order
+    wheel_.advance(now, expiring_);
+    const uint32_t* order = snapshot.expiry_order();
+    while (order && expiry_cursor_ < columns.count && expiring_.size() < EXPIRY_BATCH &&
+           columns.end_time[order[expiry_cursor_]] <= now) {
+        expiring_.emplace_back(columns.id(order[expiry_cursor_++]));
+    }
+    if (expiring_.empty()) {
+        return false;
+    }
+
+    auto overlay = std::make_shared<StoreOverlay>(*current->overlay);
+    size_t expired = 0;
+    std::vector<std::string> taken;
+    try {
+        for (size_t n = 0; n < EXPIRY_BATCH && !expiring_.empty(); ++n) {
+            taken.push_back(std::move(expiring_.back()));
+            expiring_.pop_back();
+            const std::string& id = taken.back();
+
+            // Timers are never cancelled: skip ids since deleted or moved to a later end
+            auto entry = overlay->entries.find(id);
+            if (entry != overlay->entries.end()) {
+                if (entry->second.deleted || entry->second.event.end_time > now) {
+                    continue;
+                }
+            } else {
+                int64_t row = snapshot.find(id);
+                if (row < 0 || columns.end_time[row] > now) {
+                    continue;
+                }
+            }
+
+            if (!apply_delete(*current, *overlay, id, sequence_ + 1)) {
+                continue;
+            }
+            ++sequence_;
+            ++expired;
+            if (wal_) {
+                Event tombstone = Event();
+                tombstone.id = id;
+                wal_->append(WalRecord{WalRecordType::Delete, sequence_, tombstone, {}});
+            }
+        }
+    } catch (...) {
+        // Nothing is published, so re-arm the whole batch for the next tick;
+        // deletes already logged for it are replayed idempotently
+        expiring_.insert(expiring_.end(), std::make_move_iterator(taken.rbegin()),
+                         std::make_move_iterator(taken.rend()));
+        throw;
+    }
+
+    if (expired > 0) {
+        publish(current->snapshot, current->row_slots, std::move(overlay));
+        events_expired_.fetch_add(expired, std::memory_order_relaxed);
+    }
+    return !expiring_.empty() ||
+           (order && expiry_cursor_ < columns.count && columns.end_time[order[expiry_cursor_]] <= now);
+}
+
+void EventStore::apply_writes(std::vector<std::unique_ptr<PendingWrite>>& writes) {
+    // Everything queued while the previous round synced becomes one
+    // generation (one overlay copy) and one WAL group commit
+    std::vector<size_t> removed(writes.size(), 0);
+    size_t pending_writes;
+    try {
+        uint64_t last_sequence;
+        {
+            std::lock_guard<std::mutex> lock(writer_mutex_);
+            std::shared_ptr<const StoreView> current = std::atomic_load(&generation_);
+            auto overlay = std::make_shared<StoreOverlay>(*current->overlay);
+
+            // Log before applying: a failed log leaves the published generation untouched
+            for (size_t i = 0; i < writes.size(); ++i) {
+                for (auto& event : writes[i]->upserts) {
+                    uint64_t sequence = ++sequence_;
+                    if (wal_) {
+                        wal_->append(WalRecord{WalRecordType::Upsert, sequence, event, {}});
+                    }
+                    apply_upsert(*current, *overlay, std::move(event), sequence);
+                }
+                for (const auto& id : writes[i]->deletes) {
+                    if (!apply_delete(*current, *overlay, id, sequence_ + 1)) {
+                        continue;
+                    }
+                    ++sequence_;
+                    ++removed[i];
+                    if (wal_) {
+                        Event tombstone = Event();
+                        tombstone.id = id;
+                        wal_->append(WalRecord{WalRecordType::Delete, sequence_, tombstone, {}});
+                    }
+                }
+            }
+            last_sequence = sequence_;
+            pending_writes = overlay->entries.size();
+            publish(current->snapshot, current->row_slots, std::move(overlay));
+        }
+
+        // Acknowledge only after the group commit covering these writes
+        if (wal_) {
+            wal_->wait_durable(last_sequence);
+        }
+    } catch (...) {
+        for (auto& write : writes) {
+            write->removed.set_exception(std::current_exception());
+        }
+        return;
+    }
+
+    for (size_t i = 0; i < writes.size(); ++i) {
+        writes[i]->removed.set_value(removed[i]);
+    }
+    if (pending_writes >= options_.compact_threshold) {
+        compaction_cv_.notify_one();
+    }
+}
+
+bool EventStore::compact() {
+    std::lock_guard<std::mutex> compaction_lock(compaction_mutex_);
+
+    std::shared_ptr<const StoreView> base;
+    uint64_t folded_sequence;
+    std::vector<std::pair<int, int>> counts;            // By counter slot
+    std::vector<std::pair<size_t, uint32_t>> counted_rows;  // Snapshot rows with a slot, in row order
+    uint64_t folded_counts;
+    {
+        std::lock_guard<std::mutex> lock(writer_mutex_);
+        base = std::atomic_load(&generation_);
+        folded_sequence = sequence_;
+        folded_counts = counts_pending_.load(std::memory_order_relaxed);
+        if (base->overlay->entries.empty() && folded_counts == 0) {
+            return false;
+        }
+
+        // Logged increments past folded_sequence are replayed on top of the
+        // snapshot, so it must hold the counts as of that sequence exactly
+        base->row_slots->for_each([&](size_t row, uint32_t slot) {
+            counted_rows.emplace_back(row, slot);
+        });
+        counts.resize(counters_.size());
+        for (size_t slot = 0; slot < counts.size(); ++slot) {
+            counts[slot] = {counters_.views(static_cast<uint32_t>(slot)), counters_.saves(static_cast<uint32_t>(slot))};
+        }
+    }
+
+    // Later writes go to a fresh log segment; once the snapshot below is
+    // published, segments holding only folded writes can be dropped
+    if (wal_) {
+        wal_->rotate();
+    }
+
+    // Merge without holding writer_mutex_; writes keep landing in newer
+    // overlays. Live counts are written as the events' view/save counts and
+    // events that have ended are left out.
+    int64_t now = std::time(nullptr);
+    size_t dropped = 0;
+    auto ended = [&](std::time_t end_time) {
+        bool expired = options_.expire_events && end_time <= now;
+        dropped += expired ? 1 : 0;
+        return expired;
+    };
+    std::vector<Event> events;
+    events.reserve(base->size());
+    auto add_event = [&](Event event, uint32_t slot) {
+        if (slot != RowSlots::NONE) {
+            event.view_count = counts[slot].first;
+            event.save_count = counts[slot].second;
+        }
+        events.push_back(std::move(event));
+    };
+    const EventColumns& columns = base->snapshot->columns();
+    auto counted = counted_rows.begin();
+    for (size_t row = 0; row < columns.count; ++row) {
+        uint32_t slot = RowSlots::NONE;
+        if (counted != counted_rows.end() && counted->first == row) {
+            slot = (counted++)->second;
+        }
+        if (!base->overlay->masks(row) && !ended(columns.end_time[row])) {
+            add_event(columns.materialize(row), slot);
+        }
+    }
+    for (const auto& entry : base->overlay->entries) {
+        if (!entry.second.deleted && !ended(entry.second.event.end_time)) {
+            add_event(entry.second.event, entry.second.slot);
+        }
+    }
+
+    uint64_t generation = base->snapshot->generation() + 1;
+    std::shared_ptr<const EventSnapshot> next;
+    if (options_.snapshot_path.empty()) {
+        next = EventSnapshot::build(std::move(events), generation, folded_sequence);
+    } else {
+        write_snapshot(options_.snapshot_path, std::move(events), generation, folded_sequence);
+        next = EventSnapshot::open(options_.snapshot_path);
+    }
+
+    // Keep only writes that arrived after the merge started, re-targeted at
+    // the new snapshot's rows
+    {
+        std::lock_guard<std::mutex> lock(writer_mutex_);
+        std::shared_ptr<const StoreView> current = std::atomic_load(&generation_);
+
+        // Rows are reordered by the snapshot, so counters follow their events
+        // by id. One whose counts the new columns already hold is dropped, as
+        // are those of events left out.
+        auto row_slots = std::make_shared<RowSlots>(next->size());
+        const EventColumns& next_columns = next->columns();
+        auto carry = [&](const std::string& id, uint32_t slot) {
+            int64_t row = next->find(id);
+            if (row >= 0 && (counters_.views(slot) != next_columns.view_count[row] ||
+                             counters_.saves(slot) != next_columns.save_count[row])) {
+                row_slots->assign(static_cast<size_t>(row), slot);
+            }
+        };
+        base->row_slots->for_each([&](size_t row, uint32_t slot) {
+            if (!base->overlay->masks(row)) {
+                carry(std::string(columns.id(row)), slot);
+            }
+        });
+        for (const auto& entry : base->overlay->entries) {
+            if (!entry.second.deleted) {
+                carry(entry.first, entry.second.slot);
+            }
+        }
+
+        auto overlay = std::make_shared<StoreOverlay>();
+        for (const auto& entry : current->overlay->entries) {
+            if (entry.second.sequence <= folded_sequence) {
+                continue;
+            }
+            int64_t row = next->find(entry.first);
+            if (row >= 0) {
+                mask_row(overlay->masked_rows, row);
+                remove_row_terms(*next, row, overlay->text);
+            } else if (entry.second.deleted) {
+                continue;
+            }
+            overlay->text.add(entry.second.terms);
+            if (!entry.second.deleted) {
+                add_title_terms(*next, entry.second.event.title, overlay->title_terms);
+                ++overlay->live_entries;
+            }
+            overlay->entries.emplace(entry.first, entry.second);
+        }
+
+        // Slots no live event refers to any more can be handed out again
+        std::vector<bool> used(counters_.size(), false);
+        row_slots->for_each([&](size_t, uint32_t slot) {
+            used[slot] = true;
+        });
+        for (const auto& entry : overlay->entries) {
+            if (!entry.second.deleted) {
+                used[entry.second.slot] = true;
+            }
+        }
+        std::vector<uint32_t> free_slots;
+        for (size_t slot = 0; slot < used.size(); ++slot) {
+            if (!used[slot]) {
+                free_slots.push_back(static_cast<uint32_t>(slot));
+            }
+        }
+        counters_.set_free_slots(std::move(free_slots));
+
+        expiry_cursor_ = 0;
+        counts_pending_.fetch_sub(folded_counts, std::memory_order_relaxed);
+        publish(next, std::move(row_slots), std::move(overlay));
+    }
+    events_expired_.fetch_add(dropped, std::memory_order_relaxed);
+
+    if (wal_) {
+        wal_->truncate_through(folded_sequence);
+    }
+    return true;
+}
+
+void EventStore::compaction_loop() {
+    std::unique_lock<std::mutex> lock(queue_mutex_);
+    while (!stopping_compactor_) {
+        compaction_cv_.wait_for(lock, options_.compact_interval, [this]() {
+            return stopping_compactor_ ||
+                   std::atomic_load(&generation_)->overlay->entries.size() >= options_.compact_threshold ||
+                   (wal_ && counts_pending_.load(std::memory_order_relaxed) >= options_.compact_interactions);
+        });
+        if (stopping_compactor_) {
+            break;
+        }
+
+        // Logged increments are already durable, so on their own they only
+        // warrant a snapshot rewrite once replaying them would slow a restart
+        uint64_t counts = counts_pending_.load(std::memory_order_relaxed);
+        if (std::atomic_load(&generation_)->overlay->entries.empty() &&
+            (counts == 0 || (wal_ && counts < options_.compact_interactions))) {
+            continue;
+        }
+
+        lock.unlock();
+        try {
+            compact();
+        } catch (const std::runtime_error& e) {
+            std::cerr << "Compaction failed: " << e.what() << std::endl;
+        }
+        lock.lock();
+    }
+}
+
+} // namespace zerocost
@@ -2,183 +2,633 @@
 #include <iostream>
 #include <sstream>
 #include <cstring>
+#include <cstdlib>
+#include <strings.h>
+#include <cerrno>
 #include <unistd.h>
+#include <poll.h>
+#include <fcntl.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
-#include <thread>
+#include <algorithm>
 
 namespace zerocost {
 
-HttpServer::HttpServer(int port) 
-    : port_(port), server_socket_(-1), running_(false) {}
+namespace {
+
+constexpr char STATUS_LINE_200[] = "HTTP/1.1 200 OK\r\n";
+constexpr char STATUS_LINE_400[] = "HTTP/1.1 400 Bad Request\r\n";
+constexpr char STATUS_LINE_404[] = "HTTP/1.1 404 Not Found\r\n";
+constexpr char STATUS_LINE_413[] = "HTTP/1.1 413 Payload Too Large\r\n";
+constexpr char STATUS_LINE_500[] = "HTTP/1.1 500 Internal Server Error\r\n";
+constexpr char STATUS_LINE_503[] = "HTTP/1.1 503 Service Unavailable\r\n";
+constexpr char STATUS_LINE_504[] = "HTTP/1.1 504 Gateway Timeout\r\n";
+
+constexpr char STATIC_HEADERS[] =
+    "Access-Control-Allow-Origin: *\r\n"
+    "Access-Control-Allow-Methods: GET, POST, OPTIONS\r\n"
+    "Access-Control-Allow-Headers: Content-Type\r\n"
+    "Connection: close\r\n"
+    "\r\n";
+
+constexpr int WRITE_TIMEOUT_MS = 5000;
+
+std::string percent_decode(const std::string& value, size_t begin, size_t end) {
+    auto hex = [](char c) -> int {
+        return c >= '0' && c <= '9' ? c - '0'
+             : c >= 'a' && c <= 'f' ? c - 'a' + 10
+             : c >= 'A' && c <= 'F' ? c - 'A' + 10
+             : -1;
+    };
+    std::string decoded;
+    for (size_t i = begin; i < end; ++i) {
+        if (value[i] == '+') {
+            decoded += ' ';
+        } else if (value[i] == '%' && i + 2 < end && hex(value[i + 1]) >= 0 && hex(value[i + 2]) >= 0) {
+            decoded += static_cast<char>(hex(value[i + 1]) * 16 + hex(value[i + 2]));
+            i += 2;
+        } else {
+            decoded += value[i];
+        }
+    }
+    return decoded;
+}
+
+} // namespace
+
+std::string HttpRequest::query_param(const std::string& name, const std::string& fallback) const {
+    size_t pos = 0;
+    while (pos <= query.size()) {
+        size_t end = query.find('&', pos);
+        if (end == std::string::npos) {
+            end = query.size();
+        }
+        size_t equals = query.find('=', pos);
+        size_t name_end = equals < end ? equals : end;
+        if (percent_decode(query, pos, name_end) == name) {
+            return equals < end ? percent_decode(query, equals + 1, end) : "";
+        }
+        pos = end + 1;
+    }
+    return fallback;
+}
+
+HttpServer::HttpServer(int port, const ServerOptions& options)
+    : port_(port), server_socket_(-1), options_(options), running_(false),
+      listeners_(0), active_connections_(0), accepting_(false) {
+    if (options_.worker_threads == 0) {
+        options_.worker_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    if (pipe2(wake_pipe_, O_CLOEXEC | O_NONBLOCK) < 0) {
+        wake_pipe_[0] = wake_pipe_[1] = -1;
+    }
+}
 
 HttpServer::~HttpServer() {
     stop();
+    for (int fd : wake_pipe_) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
 }
 
 void HttpServer::add_route(const std::string& method, const std::string& path, Handler handler) {
+    add_route(method, path, RequestHandler([handler](const HttpRequest& request) {
+        HttpResponse response;
+        response.body = handler(request.body);
+        return response;
+    }));
+}
+
+void HttpServer::add_route(const std::string& method, const std::string& path, RequestHandler handler) {
     std::string key = method + ":" + path;
     routes_[key] = handler;
 }
 
-void HttpServer::run() {
+size_t HttpServer::queue_depth() {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    return queue_.size();
+}
+
+int HttpServer::open_listen_socket(bool reuse_port) {
     // Create socket
-    server_socket_ = socket(AF_INET, SOCK_STREAM, 0);
-    if (server_socket_ < 0) {
+    int listen_socket = socket(AF_INET, SOCK_STREAM, 0);
+    if (listen_socket < 0) {
         std::cerr << "Error creating socket" << std::endl;
-        return;
+        return -1;
     }
     
     // Allow port reuse
     int opt = 1;
-    if (setsockopt(server_socket_, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
+    if (setsockopt(listen_socket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0 ||
+        (reuse_port && setsockopt(listen_socket, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0)) {
         std::cerr << "Error setting socket options" << std::endl;
-        close(server_socket_);
-        return;
+        close(listen_socket);
+        return -1;
     }
     
     // Bind socket
     struct sockaddr_in address;
+    std::memset(&address, 0, sizeof(address));
     address.sin_family = AF_INET;
     address.sin_addr.s_addr = INADDR_ANY;
     address.sin_port = htons(port_);
     
-    if (bind(server_socket_, (struct sockaddr*)&address, sizeof(address)) < 0) {
+    if (bind(listen_socket, (struct sockaddr*)&address, sizeof(address)) < 0) {
         std::cerr << "Error binding socket to port " << port_ << std::endl;
-        close(server_socket_);
-        return;
+        close(listen_socket);
+        return -1;
     }
     
     // Listen
-    if (listen(server_socket_, 10) < 0) {
+    if (listen(listen_socket, SOMAXCONN) < 0) {
         std::cerr << "Error listening on socket" << std::endl;
-        close(server_socket_);
+        close(listen_socket);
+        return -1;
+    }
+    
+    return listen_socket;
+}
+
+void HttpServer::run() {
+    if (options_.backend == IoBackend::IoUring) {
+        if (run_io_uring()) {
+            return;
+        }
+        std::cerr << "io_uring backend unavailable, falling back to threaded backend" << std::endl;
+    }
+    run_threaded();
+}
+
+void HttpServer::run_threaded() {
+    server_socket_ = open_listen_socket(false);
+    if (server_socket_ < 0) {
         return;
     }
     
+    listeners_++;
     running_ = true;
-    std::cout << "HTTP Server listening on port " << port_ << std::endl;
+    start_workers();
+    std::cout << "HTTP Server listening on port " << port_ << " (threaded backend, "
+              << options_.worker_threads << " workers)" << std::endl;
     
-    // Accept connections
+    // Accept connections until stop() writes to the wake pipe
     while (running_) {
-        struct sockaddr_in client_address;
-        socklen_t client_len = sizeof(client_address);
-        
-        int client_socket = accept(server_socket_, 
-                                   (struct sockaddr*)&client_address, 
-                                   &client_len);
+        struct pollfd fds[2] = {{server_socket_, POLLIN, 0}, {wake_pipe_[0], POLLIN, 0}};
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            std::cerr << "Error polling listening socket" << std::endl;
+            break;
+        }
+        if (fds[1].revents) {
+            break;
+        }
+        if ((fds[0].revents & POLLIN) && !accept_connection()) {
+            std::cerr << "Error accepting connection" << std::endl;
+        }
+    }
+    
+    // Connections that already completed the handshake are in the backlog;
+    // accept and serve them rather than resetting them on close
+    fcntl(server_socket_, F_SETFL, fcntl(server_socket_, F_GETFL) | O_NONBLOCK);
+    while (accept_connection()) {
+    }
+    close(server_socket_);
+    server_socket_ = -1;
+    listeners_--;
+    notify_drain();
+    
+    stop_workers();
+}
+
+void HttpServer::start_workers() {
+    accepting_ = true;
+    for (unsigned i = 0; i < options_.worker_threads; ++i) {
+        workers_.emplace_back([this]() { worker_loop(); });
+    }
+}
+
+void HttpServer::stop_workers() {
+    // Workers exit once the queue is empty and nothing more can arrive
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        accepting_ = false;
+    }
+    queue_cv_.notify_all();
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+    workers_.clear();
+}
+
+bool HttpServer::accept_connection() {
+    struct sockaddr_in client_address;
+    socklen_t client_len = sizeof(client_address);
+    
+    int client_socket = accept4(server_socket_, 
+                                (struct sockaddr*)&client_address, 
+                                &client_len, SOCK_CLOEXEC);
+    if (client_socket < 0) {
+        return false;
+    }
+    active_connections_++;
+    
+    PendingConnection connection{client_socket, Deadline::Clock::now(), {}, nullptr};
+    if (!enqueue(connection)) {
+        reject_overloaded(client_socket);
+    }
+    return true;
+}
+
+bool HttpServer::enqueue(PendingConnection& connection) {
+    // Admission control: refuse immediately rather than queue without bound.
+    // While draining, everything already accepted is served.
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        if (queue_.size() >= options_.max_queue_depth && running_) {
+            stats_.shed_queue_full++;
+            return false;
+        }
+        queue_.push_back(std::move(connection));
+    }
+    queue_cv_.notify_one();
+    return true;
+}
+
+void HttpServer::worker_loop() {
+    while (true) {
+        PendingConnection connection;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex_);
+            queue_cv_.wait(lock, [this]() { return !queue_.empty() || !accepting_; });
+            if (queue_.empty()) {
+                return;
+            }
+            connection = std::move(queue_.front());
+            queue_.pop_front();
+        }
         
-        if (client_socket < 0) {
-            if (running_) {
-                std::cerr << "Error accepting connection" << std::endl;
+        // Queue time is the overload signal: a request that waited this long
+        // has likely already timed out upstream, so don't spend CPU on it.
+        // Not applied while draining, where every accepted request is served.
+        if (running_ &&
+            Deadline::Clock::now() - connection.accepted_at > options_.max_queue_time) {
+            stats_.shed_queue_timeout++;
+            if (connection.respond) {
+                connection.respond(error_response(503, "Server overloaded"));
+            } else {
+                reject_overloaded(connection.socket);
             }
             continue;
         }
         
-        // Handle client in a separate thread
-        std::thread([this, client_socket]() {
-            handle_client(client_socket);
-        }).detach();
+        if (connection.respond) {
+            connection.respond(handle_request(connection.request, connection.accepted_at));
+        } else {
+            handle_client(connection);
+        }
     }
 }
 
+HttpResponse HttpServer::error_response(int status_code, const std::string& message) {
+    HttpResponse response;
+    response.status_code = status_code;
+    response.body = "{\"error\": \"" + message + "\"}";
+    return response;
+}
+
+void HttpServer::reject_overloaded(int client_socket) {
+    HttpResponse response = error_response(503, "Server overloaded");
+    
+    std::string head;
+    struct iovec iov[RESPONSE_IOV_COUNT];
+    int iovcnt = prepare_response(response, head, iov);
+    write_all(client_socket, iov, iovcnt);
+    shutdown(client_socket, SHUT_WR);
+    close(client_socket);
+    connection_closed();
+}
+
 void HttpServer::stop() {
     running_ = false;
-    if (server_socket_ >= 0) {
-        close(server_socket_);
-        server_socket_ = -1;
+    queue_cv_.notify_all();
+    if (wake_pipe_[1] >= 0) {
+        char byte = 0;
+        (void)!write(wake_pipe_[1], &byte, 1);
+    }
+}
+
+bool HttpServer::drain(std::chrono::milliseconds timeout) {
+    stop();
+    std::unique_lock<std::mutex> lock(drain_mutex_);
+    return drain_cv_.wait_for(lock, timeout, [this]() {
+        return listeners_ == 0 && active_connections_ == 0;
+    });
+}
+
+void HttpServer::connection_closed() {
+    if (--active_connections_ == 0) {
+        notify_drain();
     }
 }
 
-void HttpServer::handle_client(int client_socket) {
+void HttpServer::notify_drain() {
+    // Taking the lock orders this wakeup after a waiter's predicate check
+    { std::lock_guard<std::mutex> lock(drain_mutex_); }
+    drain_cv_.notify_all();
+}
+
+#ifndef ZEROCOST_HAVE_IO_URING
+bool HttpServer::io_uring_supported() {
+    return false;
+}
+
+bool HttpServer::run_io_uring() {
+    return false;
+}
+#endif
+
+std::chrono::milliseconds HttpServer::read_timeout() const {
+    std::chrono::milliseconds timeout = options_.read_timeout;
+    if (options_.default_timeout.count() > 0) {
+        timeout = std::min(timeout, options_.default_timeout);
+    }
+    return timeout;
+}
+
+void HttpServer::handle_client(const PendingConnection& connection) {
+    int client_socket = connection.socket;
+    // Per-thread buffers keep their capacity across connections
+    thread_local std::string request;
+    thread_local std::string head;
     char buffer[8192];
-    ssize_t bytes_read = read(client_socket, buffer, sizeof(buffer) - 1);
     
-    if (bytes_read < 0) {
+    // A client that sends slowly or not at all must not hold the worker past
+    // the read timeout
+    Deadline::Clock::time_point read_deadline = connection.accepted_at + read_timeout();
+    
+    request.clear();
+    RequestState state;
+    while ((state = request_state(request)) == RequestState::Incomplete) {
+        auto remaining = std::chrono::ceil<std::chrono::milliseconds>(read_deadline - Deadline::Clock::now());
+        struct pollfd pfd = {client_socket, POLLIN, 0};
+        int ready = remaining.count() > 0 ? poll(&pfd, 1, static_cast<int>(remaining.count())) : 0;
+        if (ready < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ready == 0) {
+            stats_.read_timeouts++;
+            request.clear();
+            break;
+        }
+        ssize_t bytes_read = read(client_socket, buffer, sizeof(buffer));
+        if (bytes_read < 0 && errno == EINTR) {
+            continue;
+        }
+        if (bytes_read <= 0) {
+            break;
+        }
+        request.append(buffer, bytes_read);
+    }
+    
+    if (request.empty()) {
         close(client_socket);
+        connection_closed();
         return;
     }
     
-    buffer[bytes_read] = '\0';
-    std::string request(buffer);
+    HttpResponse response = state == RequestState::TooLarge
+        ? error_response(413, "Request too large")
+        : handle_request(request, connection.accepted_at);
+    if (request.capacity() > RETAINED_BUFFER_BYTES) {
+        std::string().swap(request);
+    }
     
-    std::string method, path, body;
-    parse_http_request(request, method, path, body);
+    struct iovec iov[RESPONSE_IOV_COUNT];
+    int iovcnt = prepare_response(response, head, iov);
+    write_all(client_socket, iov, iovcnt);
+    if (state == RequestState::TooLarge) {
+        // The rest of the body is never read; don't reset the response with it
+        shutdown(client_socket, SHUT_WR);
+    }
+    close(client_socket);
+    connection_closed();
+}
+
+std::chrono::milliseconds HttpServer::request_budget(const HttpRequest& request) const {
+    std::chrono::milliseconds limit = options_.default_timeout.count() > 0
+        ? options_.default_timeout
+        : MAX_REQUEST_TIMEOUT;
+    std::string timeout = request.header(TIMEOUT_HEADER);
     
-    std::string key = method + ":" + path;
-    std::string response_body;
-    std::string response;
+    // Anything but a positive integer is ignored, so clients cannot opt out
+    // of the default deadline (or of shedding) with 0, -1 or garbage
+    char* end = nullptr;
+    errno = 0;
+    long long value = std::strtoll(timeout.c_str(), &end, 10);
+    if (timeout.empty() || *end != '\0' || errno == ERANGE || value <= 0) {
+        return options_.default_timeout;
+    }
+    return std::chrono::milliseconds(std::min<long long>(value, limit.count()));
+}
+
+HttpResponse HttpServer::handle_request(const std::string& raw_request,
+                                        Deadline::Clock::time_point received_at) {
+    stats_.requests_total++;
+    
+    HttpRequest request;
+    HttpResponse response;
+    if (!parse_http_request(raw_request, request)) {
+        response.status_code = 400;
+        response.body = "{\"error\": \"Bad Request\"}";
+        return response;
+    }
+    
+    std::chrono::milliseconds budget = request_budget(request);
+    if (budget.count() > 0) {
+        request.deadline = Deadline::after(received_at, budget);
+    }
+    
+    std::string key = request.method + ":" + request.path;
     
     auto it = routes_.find(key);
     if (it != routes_.end()) {
         try {
-            response_body = it->second(body);
-            response = build_http_response(200, "application/json", response_body);
+            request.deadline.check("handler");
+            response = it->second(request);
+        } catch (const DeadlineExceeded& e) {
+            stats_.deadline_exceeded++;
+            response.status_code = 504;
+            response.content_type = "application/json";
+            response.body = "{\"error\": \"" + std::string(e.what()) + "\"}";
         } catch (const std::exception& e) {
-            response_body = "{\"error\": \"" + std::string(e.what()) + "\"}";
-            response = build_http_response(500, "application/json", response_body);
+            response.status_code = 500;
+            response.content_type = "application/json";
+            response.body = "{\"error\": \"" + std::string(e.what()) + "\"}";
         }
-    } else {
-        response_body = "{\"error\": \"Not Found\"}";
-        response = build_http_response(404, "application/json", response_body);
+        return response;
     }
     
-    write(client_socket, response.c_str(), response.length());
-    close(client_socket);
+    response.status_code = 404;
+    response.body = "{\"error\": \"Not Found\"}";
+    return response;
 }
 
-std::string HttpServer::parse_http_request(const std::string& request, 
-                                          std::string& method, 
-                                          std::string& path,
-                                          std::string& body) {
-    std::istringstream stream(request);
-    std::string line;
+HttpServer::RequestState HttpServer::request_state(const std::string& data) {
+    size_t header_end = data.find("\r\n\r\n");
+    if (header_end == std::string::npos) {
+        return data.size() > MAX_HEADER_BYTES ? RequestState::TooLarge : RequestState::Incomplete;
+    }
+    if (header_end > MAX_HEADER_BYTES) {
+        return RequestState::TooLarge;
+    }
     
-    // Parse request line
-    if (std::getline(stream, line)) {
-        std::istringstream line_stream(line);
-        line_stream >> method >> path;
+    // Requests without a body (GET, HEAD) are complete once headers end
+    size_t content_length = 0;
+    size_t pos = 0;
+    while (pos < header_end) {
+        size_t line_end = data.find("\r\n", pos);
+        if (line_end == std::string::npos || line_end > header_end) {
+            line_end = header_end;
+        }
+        constexpr char CONTENT_LENGTH[] = "content-length:";
+        constexpr size_t CONTENT_LENGTH_LEN = sizeof(CONTENT_LENGTH) - 1;
+        if (line_end - pos > CONTENT_LENGTH_LEN &&
+            strncasecmp(data.c_str() + pos, CONTENT_LENGTH, CONTENT_LENGTH_LEN) == 0) {
+            // Anything unparsable or past the limit (including "-1") is too large
+            const char* value = data.c_str() + pos + CONTENT_LENGTH_LEN;
+            value += std::strspn(value, " \t");
+            if (*value < '0' || *value > '9') {
+                return RequestState::TooLarge;
+            }
+            content_length = std::strtoull(value, nullptr, 10);
+            break;
+        }
+        pos = line_end + 2;
     }
     
-    // Skip headers
-    while (std::getline(stream, line) && line != "\r" && !line.empty()) {
-        // Could parse headers here if needed
+    if (content_length > MAX_REQUEST_BYTES - header_end - 4) {
+        return RequestState::TooLarge;
+    }
+    return data.size() >= header_end + 4 + content_length ? RequestState::Complete : RequestState::Incomplete;
+}
+
+bool HttpServer::parse_http_request(const std::string& raw_request, HttpRequest& request) {
+    size_t header_end = raw_request.find("\r\n\r\n");
+    if (header_end == std::string::npos) {
+        return false;
     }
     
-    // Read body
-    std::string body_line;
-    while (std::getline(stream, body_line)) {
-        body += body_line;
+    // Parse request line
+    size_t line_end = raw_request.find("\r\n");
+    std::istringstream line_stream(raw_request.substr(0, line_end));
+    line_stream >> request.method >> request.path;
+    if (request.method.empty() || request.path.empty()) {
+        return false;
+    }
+    size_t query_start = request.path.find('?');
+    if (query_start != std::string::npos) {
+        request.query = request.path.substr(query_start + 1);
+        request.path.resize(query_start);
+    }
+    
+    // Parse headers
+    size_t pos = line_end + 2;
+    while (pos < header_end) {
+        line_end = raw_request.find("\r\n", pos);
+        size_t colon = raw_request.find(':', pos);
+        if (colon != std::string::npos && colon < line_end) {
+            std::string name = raw_request.substr(pos, colon - pos);
+            std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+            size_t value_start = raw_request.find_first_not_of(" \t", colon + 1);
+            if (value_start > line_end) {
+                value_start = line_end;
+            }
+            request.headers[name] = raw_request.substr(value_start, line_end - value_start);
+        }
+        pos = line_end + 2;
     }
     
-    return body;
+    // Body is everything after the blank line, byte for byte
+    request.body = raw_request.substr(header_end + 4);
+    return true;
 }
 
-std::string HttpServer::build_http_response(int status_code, 
-                                           const std::string& content_type,
-                                           const std::string& body) {
-    std::ostringstream response;
+int HttpServer::prepare_response(const HttpResponse& response,
+                                 std::string& head,
+                                 struct iovec* iov) {
+    const char* status_line = nullptr;
+    switch (response.status_code) {
+        case 200: status_line = STATUS_LINE_200; break;
+        case 400: status_line = STATUS_LINE_400; break;
+        case 404: status_line = STATUS_LINE_404; break;
+        case 413: status_line = STATUS_LINE_413; break;
+        case 500: status_line = STATUS_LINE_500; break;
+        case 503: status_line = STATUS_LINE_503; break;
+        case 504: status_line = STATUS_LINE_504; break;
+        default: break;
+    }
     
-    std::string status_text;
-    switch (status_code) {
-        case 200: status_text = "OK"; break;
-        case 400: status_text = "Bad Request"; break;
-        case 404: status_text = "Not Found"; break;
-        case 500: status_text = "Internal Server Error"; break;
-        default: status_text = "Unknown"; break;
+    // Only Content-Type and Content-Length vary; everything else is static
+    head.clear();
+    if (!status_line) {
+        head.append("HTTP/1.1 ").append(std::to_string(response.status_code)).append(" Unknown\r\n");
+        status_line = "";
     }
+    head.append("Content-Type: ").append(response.content_type).append("\r\n");
+    head.append("Content-Length: ").append(std::to_string(response.body.size())).append("\r\n");
+    
+    iov[0].iov_base = const_cast<char*>(status_line);
+    iov[0].iov_len = std::strlen(status_line);
+    iov[1].iov_base = const_cast<char*>(head.data());
+    iov[1].iov_len = head.size();
+    iov[2].iov_base = const_cast<char*>(STATIC_HEADERS);
+    iov[2].iov_len = sizeof(STATIC_HEADERS) - 1;
+    iov[3].iov_base = const_cast<char*>(response.body.data());
+    iov[3].iov_len = response.body.size();
+    return RESPONSE_IOV_COUNT;
+}
+
+bool HttpServer::write_all(int fd, struct iovec* iov, int iovcnt) {
+    struct msghdr msg;
+    std::memset(&msg, 0, sizeof(msg));
     
-    response << "HTTP/1.1 " << status_code << " " << status_text << "\r\n";
-    response << "Content-Type: " << content_type << "\r\n";
-    response << "Content-Length: " << body.length() << "\r\n";
-    response << "Access-Control-Allow-Origin: *\r\n";
-    response << "Access-Control-Allow-Methods: GET, POST, OPTIONS\r\n";
-    response << "Access-Control-Allow-Headers: Content-Type\r\n";
-    response << "Connection: close\r\n";
-    response << "\r\n";
-    response << body;
+    while (iovcnt > 0) {
+        msg.msg_iov = iov;
+        msg.msg_iovlen = iovcnt;
+        ssize_t written = sendmsg(fd, &msg, MSG_NOSIGNAL);
+        
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                struct pollfd pfd = {fd, POLLOUT, 0};
+                if (poll(&pfd, 1, WRITE_TIMEOUT_MS) <= 0) {
+                    return false;
+                }
+                continue;
+            }
+            return false;
+        }
+        
+        // Skip fully written vectors, then trim the partially written one
+        size_t remaining = static_cast<size_t>(written);
+        while (iovcnt > 0 && remaining >= iov->iov_len) {
+            remaining -= iov->iov_len;
+            ++iov;
+            --iovcnt;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = static_cast<char*>(iov->iov_base) + remaining;
+            iov->iov_len -= remaining;
+        }
+    }
     
-    return response.str();
+    return true;
 }
 
 } // namespace zerocost
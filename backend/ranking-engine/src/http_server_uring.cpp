@@ -0,0 +1,627 @@
+#include "http_server.h"
+#include <liburing.h>
+#include <iostream>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+
+namespace zerocost {
+
+namespace {
+
+constexpr unsigned RING_ENTRIES = 1024;
+constexpr unsigned BUFFER_COUNT = 512;              // Must be a power of two
+constexpr unsigned BUFFER_SIZE = 4096;
+constexpr int BUFFER_GROUP_ID = 0;
+constexpr long WAIT_TIMEOUT_NS = 100 * 1000 * 1000;  // Re-check running flag every 100ms
+constexpr size_t LINGER_BYTES = size_t(1) << 20;     // Input discarded after a 413 before closing
+
+// user_data layout: operation in the upper 32 bits, file descriptor in the lower 32
+enum class Op : uint32_t { Accept = 1, Recv = 2, Send = 3, Close = 4, Cancel = 5, Wake = 6, Shutdown = 7 };
+
+uint64_t make_user_data(Op op, int fd) {
+    return (static_cast<uint64_t>(op) << 32) | static_cast<uint32_t>(fd);
+}
+
+struct Connection {
+    std::string in;
+    Deadline::Clock::time_point accepted_at;
+    HttpResponse response;
+    std::string head;
+    struct iovec iov[HttpServer::RESPONSE_IOV_COUNT];
+    struct msghdr msg;
+    enum class Phase {
+        Reading,     // Receiving the request
+        Responding,  // Dispatched or sending; nothing is read
+        Lingering,   // Response sent and write side shut; input is discarded
+        Closing      // Timed out; input is discarded until the pending receive ends
+    };
+    Phase phase = Phase::Reading;
+    size_t lingered = 0;  // Bytes discarded while lingering
+};
+
+/**
+ * Responses finished by worker threads for one ring's connections. A
+ * worker posts its response and signals the eventfd the ring is reading;
+ * shared with queued requests so a worker that finishes after the ring
+ * has gone never touches freed memory.
+ */
+struct Mailbox {
+    std::mutex mutex;
+    std::vector<std::pair<int, HttpResponse>> responses;
+    int event_fd = -1;
+
+    ~Mailbox() {
+        if (event_fd >= 0) {
+            close(event_fd);
+        }
+    }
+
+    void post(int fd, HttpResponse response) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            responses.emplace_back(fd, std::move(response));
+        }
+        uint64_t one = 1;
+        (void)!write(event_fd, &one, sizeof(one));
+    }
+};
+
+struct UringCallbacks {
+    // Queues a complete request for the worker pool, whose response comes
+    // back through the mailbox; false if the queue is full
+    std::function<bool(int fd, std::string request, Deadline::Clock::time_point accepted_at,
+                       const std::shared_ptr<Mailbox>& mailbox)> dispatch;
+    // Fills the connection's response iovecs from conn.response
+    std::function<int(Connection& conn)> prepare;
+    std::function<HttpResponse(int status_code, const std::string& message)> error_response;
+    std::function<HttpServer::RequestState(const std::string& data)> request_state;
+    std::function<void()> on_opened;
+    std::function<void()> on_closed;
+    std::function<void()> on_read_timeout;
+    std::chrono::milliseconds read_timeout{0};  // From accept until the request is in
+    std::function<void()> on_listener_closed;
+};
+
+/**
+ * One io_uring event loop with its own SO_REUSEPORT listening socket. The
+ * ring accepts, reads and sends; handlers run on the server's worker pool
+ * so a slow request never stalls the other connections of its ring.
+ */
+class UringLoop {
+public:
+    UringLoop(int listen_fd, UringCallbacks callbacks, const std::atomic<bool>& running)
+        : listen_fd_(listen_fd), callbacks_(std::move(callbacks)), running_(running) {}
+
+    ~UringLoop() {
+        for (size_t fd = 0; fd < open_.size(); ++fd) {
+            if (open_[fd]) {
+                close(static_cast<int>(fd));
+                callbacks_.on_closed();
+            }
+        }
+        if (buf_ring_) {
+            io_uring_free_buf_ring(&ring_, buf_ring_, BUFFER_COUNT, BUFFER_GROUP_ID);
+        }
+        if (ring_initialized_) {
+            io_uring_queue_exit(&ring_);
+        }
+        if (listen_fd_ >= 0) {
+            close(listen_fd_);
+            callbacks_.on_listener_closed();
+        }
+    }
+
+    bool init() {
+        // Cooperative task running avoids IPIs; retry plain setup on older kernels
+        int ret = io_uring_queue_init(RING_ENTRIES, &ring_,
+                                      IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN);
+        if (ret < 0) {
+            ret = io_uring_queue_init(RING_ENTRIES, &ring_, 0);
+        }
+        if (ret < 0) {
+            std::cerr << "io_uring_queue_init failed: " << std::strerror(-ret) << std::endl;
+            return false;
+        }
+        ring_initialized_ = true;
+
+        buf_ring_ = io_uring_setup_buf_ring(&ring_, BUFFER_COUNT, BUFFER_GROUP_ID, 0, &ret);
+        if (!buf_ring_) {
+            std::cerr << "io_uring buffer ring setup failed: " << std::strerror(-ret) << std::endl;
+            return false;
+        }
+
+        buffers_.resize(static_cast<size_t>(BUFFER_COUNT) * BUFFER_SIZE);
+        int mask = io_uring_buf_ring_mask(BUFFER_COUNT);
+        for (unsigned bid = 0; bid < BUFFER_COUNT; ++bid) {
+            io_uring_buf_ring_add(buf_ring_, buffer(bid), BUFFER_SIZE, bid, mask, bid);
+        }
+        io_uring_buf_ring_advance(buf_ring_, BUFFER_COUNT);
+
+        mailbox_->event_fd = eventfd(0, EFD_CLOEXEC);
+        if (mailbox_->event_fd < 0) {
+            std::cerr << "eventfd failed: " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    void run() {
+        arm_accept();
+        arm_wake();
+
+        // Once stopped, keep serving accepted connections until all are closed
+        bool accepting = true;
+        while (accepting || open_count_ > 0) {
+            if (accepting && !running_) {
+                stop_accepting();
+                accepting = false;
+            }
+
+            struct __kernel_timespec timeout = {0, WAIT_TIMEOUT_NS};
+            struct io_uring_cqe* cqe = nullptr;
+            int ret = io_uring_submit_and_wait_timeout(&ring_, &cqe, 1, &timeout, nullptr);
+            if (ret < 0 && ret != -ETIME && ret != -EINTR) {
+                std::cerr << "io_uring wait failed: " << std::strerror(-ret) << std::endl;
+                break;
+            }
+
+            // Reap every completion that is ready in a single pass
+            unsigned head;
+            unsigned reaped = 0;
+            io_uring_for_each_cqe(&ring_, head, cqe) {
+                handle_completion(cqe);
+                ++reaped;
+            }
+            io_uring_cq_advance(&ring_, reaped);
+
+            // Receives that found no buffer wait for one to come back, or
+            // for an idle tick in case it came back before they were parked
+            if (!starved_.empty() && (recycled_ > 0 || ret == -ETIME)) {
+                std::vector<int> starved;
+                starved.swap(starved_);
+                for (int fd : starved) {
+                    arm_recv(fd);
+                }
+            }
+            recycled_ = 0;
+
+            auto now = Deadline::Clock::now();
+            if (now - last_sweep_ >= std::chrono::nanoseconds(WAIT_TIMEOUT_NS)) {
+                sweep_timeouts(now);
+                last_sweep_ = now;
+            }
+        }
+    }
+
+private:
+    int listen_fd_;
+    UringCallbacks callbacks_;
+    const std::atomic<bool>& running_;
+    size_t open_count_ = 0;
+
+    struct io_uring ring_;
+    bool ring_initialized_ = false;
+    struct io_uring_buf_ring* buf_ring_ = nullptr;
+    std::vector<char> buffers_;
+    std::shared_ptr<Mailbox> mailbox_ = std::make_shared<Mailbox>();
+    uint64_t wake_count_ = 0;                   // Read target of the mailbox eventfd
+
+    // Indexed by file descriptor; entries are reused as descriptors are
+    // recycled. Queued sendmsg SQEs point into a Connection, so each one is
+    // its own allocation that growing the table never moves.
+    std::vector<std::unique_ptr<Connection>> connections_;
+    std::vector<bool> open_;
+    std::vector<int> starved_;   // Connections whose receive found every buffer in flight
+    unsigned recycled_ = 0;      // Buffers returned to the ring in this pass
+    Deadline::Clock::time_point last_sweep_ = Deadline::Clock::now();
+
+    char* buffer(unsigned bid) {
+        return buffers_.data() + static_cast<size_t>(bid) * BUFFER_SIZE;
+    }
+
+    struct io_uring_sqe* get_sqe() {
+        struct io_uring_sqe* sqe = io_uring_get_sqe(&ring_);
+        while (!sqe) {
+            io_uring_submit(&ring_);
+            sqe = io_uring_get_sqe(&ring_);
+        }
+        return sqe;
+    }
+
+    Connection& connection(int fd) {
+        if (static_cast<size_t>(fd) >= connections_.size()) {
+            connections_.resize(fd + 1);
+            open_.resize(fd + 1, false);
+        }
+        if (!connections_[fd]) {
+            connections_[fd] = std::make_unique<Connection>();
+        }
+        return *connections_[fd];
+    }
+
+    void arm_accept() {
+        struct io_uring_sqe* sqe = get_sqe();
+        io_uring_prep_multishot_accept(sqe, listen_fd_, nullptr, nullptr, 0);
+        io_uring_sqe_set_data64(sqe, make_user_data(Op::Accept, listen_fd_));
+    }
+
+    void arm_recv(int fd) {
+        // The kernel picks a buffer from the provided ring when data arrives,
+        // so idle connections pin no memory
+        struct io_uring_sqe* sqe = get_sqe();
+        io_uring_prep_recv(sqe, fd, nullptr, BUFFER_SIZE, 0);
+        sqe->flags |= IOSQE_BUFFER_SELECT;
+        sqe->buf_group = BUFFER_GROUP_ID;
+        io_uring_sqe_set_data64(sqe, make_user_data(Op::Recv, fd));
+    }
+
+    void arm_wake() {
+        struct io_uring_sqe* sqe = get_sqe();
+        io_uring_prep_read(sqe, mailbox_->event_fd, &wake_count_, sizeof(wake_count_), 0);
+        io_uring_sqe_set_data64(sqe, make_user_data(Op::Wake, mailbox_->event_fd));
+    }
+
+    void respond(int fd, HttpResponse response) {
+        prepare_send(fd, std::move(response));
+        send_and_close(fd);
+    }
+
+    /*
+     * Respond to a request whose input is not read to the end. Closing with
+     * unread input makes the kernel reset the connection, which can discard
+     * the response before the client reads it; instead shut the write side
+     * after the send and discard input until the client closes (or
+     * LINGER_BYTES), like a lingering close.
+     */
+    void respond_and_linger(int fd, HttpResponse response) {
+        prepare_send(fd, std::move(response));
+        if (io_uring_sq_space_left(&ring_) < 2) {
+            io_uring_submit(&ring_);
+        }
+
+        struct io_uring_sqe* sqe = get_sqe();
+        io_uring_prep_sendmsg(sqe, fd, &connection(fd).msg, MSG_WAITALL | MSG_NOSIGNAL);
+        sqe->flags |= IOSQE_IO_LINK;
+        io_uring_sqe_set_data64(sqe, make_user_data(Op::Send, fd));
+
+        sqe = get_sqe();
+        io_uring_prep_shutdown(sqe, fd, SHUT_WR);
+        io_uring_sqe_set_data64(sqe, make_user_data(Op::Shutdown, fd));
+    }
+
+    void prepare_send(int fd, HttpResponse response) {
+        Connection& conn = connection(fd);
+        conn.response = std::move(response);
+        int iovcnt = callbacks_.prepare(conn);
+        std::memset(&conn.msg, 0, sizeof(conn.msg));
+        conn.msg.msg_iov = conn.iov;
+        conn.msg.msg_iovlen = iovcnt;
+    }
+
+    void send_and_close(int fd) {
+        // Both SQEs must land in the same submission for the link to hold
+        if (io_uring_sq_space_left(&ring_) < 2) {
+            io_uring_submit(&ring_);
+        }
+
+        // Headers and body go out as one scatter-gather send; MSG_WAITALL
+        // makes the kernel retry short sends before completing
+        struct msghdr& msg = connection(fd).msg;
+        struct io_uring_sqe* sqe = get_sqe();
+        io_uring_prep_sendmsg(sqe, fd, &msg, MSG_WAITALL | MSG_NOSIGNAL);
+        sqe->flags |= IOSQE_IO_LINK;
+        io_uring_sqe_set_data64(sqe, make_user_data(Op::Send, fd));
+
+        sqe = get_sqe();
+        io_uring_prep_close(sqe, fd);
+        io_uring_sqe_set_data64(sqe, make_user_data(Op::Close, fd));
+    }
+
+    void stop_accepting() {
+        struct io_uring_sqe* sqe = get_sqe();
+        io_uring_prep_cancel_fd(sqe, listen_fd_, 0);
+        io_uring_sqe_set_data64(sqe, make_user_data(Op::Cancel, listen_fd_));
+        io_uring_submit(&ring_);
+
+        // Connections that already completed the handshake are in the
+        // backlog; accept and serve them rather than resetting them on close
+        fcntl(listen_fd_, F_SETFL, fcntl(listen_fd_, F_GETFL) | O_NONBLOCK);
+        int fd;
+        while ((fd = accept(listen_fd_, nullptr, nullptr)) >= 0 || errno == EINTR) {
+            if (fd >= 0) {
+                open_connection(fd);
+            }
+        }
+        close(listen_fd_);
+        listen_fd_ = -1;
+        callbacks_.on_listener_closed();
+    }
+
+    void open_connection(int fd) {
+        Connection& conn = connection(fd);
+        conn.accepted_at = Deadline::Clock::now();
+        conn.phase = Connection::Phase::Reading;
+        open_[fd] = true;
+        ++open_count_;
+        callbacks_.on_opened();
+        arm_recv(fd);
+    }
+
+    /*
+     * Close connections whose request has not arrived within the read
+     * timeout, so idle or slow clients cannot hold the ring open (and block
+     * drain). Shutting the socket ends its pending receive, whose completion
+     * then closes it; lingering connections get the same bound.
+     */
+    void sweep_timeouts(Deadline::Clock::time_point now) {
+        Deadline::Clock::time_point cutoff = now - callbacks_.read_timeout;
+        for (size_t fd = 0; fd < open_.size(); ++fd) {
+            if (!open_[fd]) {
+                continue;
+            }
+            Connection& conn = *connections_[fd];
+            bool reading = conn.phase == Connection::Phase::Reading;
+            if ((reading || conn.phase == Connection::Phase::Lingering) && conn.accepted_at < cutoff) {
+                if (reading) {
+                    callbacks_.on_read_timeout();
+                }
+                conn.phase = Connection::Phase::Closing;
+                shutdown(static_cast<int>(fd), SHUT_RDWR);
+            }
+        }
+    }
+
+    void close_connection(int fd) {
+        struct io_uring_sqe* sqe = get_sqe();
+        io_uring_prep_close(sqe, fd);
+        io_uring_sqe_set_data64(sqe, make_user_data(Op::Close, fd));
+    }
+
+    void release_connection(int fd) {
+        // Keep string capacity so the next connection on this fd reuses it,
+        // unless an oversized request inflated it
+        Connection& conn = connection(fd);
+        conn.in.clear();
+        if (conn.in.capacity() > HttpServer::RETAINED_BUFFER_BYTES) {
+            std::string().swap(conn.in);
+        }
+        conn.response.body.clear();
+        conn.phase = Connection::Phase::Reading;
+        conn.lingered = 0;
+        open_[fd] = false;
+        --open_count_;
+        callbacks_.on_closed();
+    }
+
+    void recycle_buffer(unsigned bid) {
+        io_uring_buf_ring_add(buf_ring_, buffer(bid), BUFFER_SIZE, bid,
+                              io_uring_buf_ring_mask(BUFFER_COUNT), 0);
+        io_uring_buf_ring_advance(buf_ring_, 1);
+        ++recycled_;
+    }
+
+    void handle_completion(struct io_uring_cqe* cqe) {
+        uint64_t data = io_uring_cqe_get_data64(cqe);
+        Op op = static_cast<Op>(data >> 32);
+        int fd = static_cast<int>(data & 0xffffffffu);
+
+        switch (op) {
+            case Op::Accept:
+                on_accept(cqe);
+                break;
+            case Op::Recv:
+                on_recv(fd, cqe);
+                break;
+            case Op::Send:
+                // Success is followed by the linked close; a failed send
+                // cancels it and is handled in the close completion
+                break;
+            case Op::Close:
+                if (cqe->res == -ECANCELED) {
+                    close(fd);
+                }
+                release_connection(fd);
+                break;
+            case Op::Shutdown:
+                // A failed send cancels the linked shutdown
+                if (cqe->res < 0) {
+                    close_connection(fd);
+                } else {
+                    connection(fd).phase = Connection::Phase::Lingering;
+                    arm_recv(fd);
+                }
+                break;
+            case Op::Cancel:
+                break;
+            case Op::Wake:
+                on_wake(cqe);
+                break;
+        }
+    }
+
+    void on_wake(struct io_uring_cqe* cqe) {
+        std::vector<std::pair<int, HttpResponse>> responses;
+        {
+            std::lock_guard<std::mutex> lock(mailbox_->mutex);
+            responses.swap(mailbox_->responses);
+        }
+        for (auto& response : responses) {
+            respond(response.first, std::move(response.second));
+        }
+        if (cqe->res >= 0 || cqe->res == -EINTR) {
+            arm_wake();
+        }
+    }
+
+    void on_accept(struct io_uring_cqe* cqe) {
+        // Multishot accept stays armed until the kernel clears F_MORE
+        if (!(cqe->flags & IORING_CQE_F_MORE) && running_) {
+            arm_accept();
+        }
+
+        if (cqe->res < 0) {
+            if (cqe->res != -ECANCELED && running_) {
+                std::cerr << "Error accepting connection: " << std::strerror(-cqe->res) << std::endl;
+            }
+            return;
+        }
+
+        open_connection(cqe->res);
+    }
+
+    void on_recv(int fd, struct io_uring_cqe* cqe) {
+        if (cqe->res == -ENOBUFS) {
+            // Every provided buffer is in flight; re-armed by run() once some
+            // are recycled, rather than spinning on resubmits
+            starved_.push_back(fd);
+            return;
+        }
+
+        if (cqe->res <= 0 || !(cqe->flags & IORING_CQE_F_BUFFER)) {
+            close_connection(fd);
+            return;
+        }
+
+        unsigned bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+        Connection& conn = connection(fd);
+        if (conn.phase != Connection::Phase::Reading) {
+            recycle_buffer(bid);
+            conn.lingered += cqe->res;
+            if (conn.phase == Connection::Phase::Closing || conn.lingered > LINGER_BYTES) {
+                close_connection(fd);
+            } else {
+                arm_recv(fd);
+            }
+            return;
+        }
+        conn.in.append(buffer(bid), cqe->res);
+        recycle_buffer(bid);
+
+        HttpServer::RequestState state = callbacks_.request_state(conn.in);
+        if (state == HttpServer::RequestState::Complete) {
+            // Nothing more is read from the connection; it waits for its response
+            conn.phase = Connection::Phase::Responding;
+            std::string request = std::move(conn.in);
+            conn.in.clear();
+            if (!callbacks_.dispatch(fd, std::move(request), conn.accepted_at, mailbox_)) {
+                respond(fd, callbacks_.error_response(503, "Server overloaded"));
+            }
+        } else if (state == HttpServer::RequestState::TooLarge) {
+            conn.phase = Connection::Phase::Responding;
+            respond_and_linger(fd, callbacks_.error_response(413, "Request too large"));
+        } else {
+            arm_recv(fd);
+        }
+    }
+};
+
+} // namespace
+
+bool HttpServer::io_uring_supported() {
+    struct io_uring ring;
+    if (io_uring_queue_init(8, &ring, 0) < 0) {
+        return false;
+    }
+
+    bool supported = false;
+    struct io_uring_probe* probe = io_uring_get_probe_ring(&ring);
+    if (probe) {
+        supported = io_uring_opcode_supported(probe, IORING_OP_ACCEPT) &&
+                    io_uring_opcode_supported(probe, IORING_OP_RECV) &&
+                    io_uring_opcode_supported(probe, IORING_OP_SEND) &&
+                    io_uring_opcode_supported(probe, IORING_OP_CLOSE);
+        io_uring_free_probe(probe);
+    }
+
+    // Provided buffer rings (5.19+) imply multishot accept support as well
+    if (supported) {
+        int ret = 0;
+        struct io_uring_buf_ring* br = io_uring_setup_buf_ring(&ring, 1, BUFFER_GROUP_ID, 0, &ret);
+        if (br) {
+            io_uring_free_buf_ring(&ring, br, 1, BUFFER_GROUP_ID);
+        } else {
+            supported = false;
+        }
+    }
+
+    io_uring_queue_exit(&ring);
+    return supported;
+}
+
+bool HttpServer::run_io_uring() {
+    if (!io_uring_supported()) {
+        return false;
+    }
+
+    unsigned ring_count = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::unique_ptr<UringLoop>> loops;
+
+    for (unsigned i = 0; i < ring_count; ++i) {
+        int listen_fd = open_listen_socket(true);
+        if (listen_fd < 0) {
+            return false;
+        }
+
+        listeners_++;
+        UringCallbacks callbacks;
+        callbacks.dispatch = [this](int fd, std::string request, Deadline::Clock::time_point accepted_at,
+                                    const std::shared_ptr<Mailbox>& mailbox) {
+            // Same admission control and queue-time shedding as the threaded backend
+            PendingConnection connection{fd, accepted_at, std::move(request),
+                                         [mailbox, fd](HttpResponse response) {
+                                             mailbox->post(fd, std::move(response));
+                                         }};
+            return enqueue(connection);
+        };
+        callbacks.prepare = [](Connection& conn) {
+            return prepare_response(conn.response, conn.head, conn.iov);
+        };
+        callbacks.error_response = [](int status_code, const std::string& message) {
+            return error_response(status_code, message);
+        };
+        callbacks.request_state = [](const std::string& data) { return request_state(data); };
+        callbacks.on_opened = [this]() { active_connections_++; };
+        callbacks.on_closed = [this]() { connection_closed(); };
+        callbacks.on_read_timeout = [this]() { stats_.read_timeouts++; };
+        callbacks.read_timeout = read_timeout();
+        callbacks.on_listener_closed = [this]() {
+            listeners_--;
+            notify_drain();
+        };
+
+        auto loop = std::make_unique<UringLoop>(listen_fd, std::move(callbacks), running_);
+        if (!loop->init()) {
+            return false;
+        }
+        loops.push_back(std::move(loop));
+    }
+
+    running_ = true;
+    start_workers();
+    std::cout << "HTTP Server listening on port " << port_
+              << " (io_uring backend, " << ring_count << " rings, "
+              << options_.worker_threads << " workers)" << std::endl;
+
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < loops.size(); ++i) {
+        threads.emplace_back([&loops, i]() { loops[i]->run(); });
+    }
+    loops[0]->run();
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    stop_workers();
+    return true;
+}
+
+} // namespace zerocost
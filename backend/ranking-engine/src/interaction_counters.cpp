@@ -0,0 +1,80 @@
+#include "interaction_counters.h"
+#include <stdexcept>
+
+namespace zerocost {
+
+InteractionCounters::InteractionCounters()
+    : chunks_(new std::atomic<CounterSlot*>[MAX_CHUNKS]) {
+    for (size_t i = 0; i < MAX_CHUNKS; ++i) {
+        chunks_[i].store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+InteractionCounters::~InteractionCounters() {
+    for (size_t i = 0; i < MAX_CHUNKS; ++i) {
+        delete[] chunks_[i].load(std::memory_order_relaxed);
+    }
+}
+
+uint32_t InteractionCounters::allocate(int64_t views, int64_t saves) {
+    if (!free_.empty()) {
+        uint32_t slot = free_.back();
+        free_.pop_back();
+        at(slot).views.store(views, std::memory_order_relaxed);
+        at(slot).saves.store(saves, std::memory_order_relaxed);
+        return slot;
+    }
+
+    size_t slot = size_.load(std::memory_order_relaxed);
+    size_t chunk = slot >> CHUNK_BITS;
+    if (chunk >= MAX_CHUNKS) {
+        throw std::length_error("interaction counter table is full");
+    }
+    if (!chunks_[chunk].load(std::memory_order_relaxed)) {
+        chunks_[chunk].store(new CounterSlot[CHUNK_SLOTS], std::memory_order_release);
+    }
+
+    CounterSlot& counter = chunks_[chunk].load(std::memory_order_relaxed)[slot & (CHUNK_SLOTS - 1)];
+    counter.views.store(views, std::memory_order_relaxed);
+    counter.saves.store(saves, std::memory_order_relaxed);
+    size_.store(slot + 1, std::memory_order_release);
+    return static_cast<uint32_t>(slot);
+}
+
+RowSlots::RowSlots(size_t rows)
+    : chunks_(new std::atomic<std::atomic<uint32_t>*>[(rows + CHUNK_ROWS - 1) >> CHUNK_BITS]),
+      chunk_count_((rows + CHUNK_ROWS - 1) >> CHUNK_BITS) {
+    for (size_t i = 0; i < chunk_count_; ++i) {
+        chunks_[i].store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+RowSlots::~RowSlots() {
+    for (size_t i = 0; i < chunk_count_; ++i) {
+        delete[] chunks_[i].load(std::memory_order_relaxed);
+    }
+}
+
+void RowSlots::assign(size_t row, uint32_t slot) {
+    std::atomic<uint32_t>* chunk = chunks_[row >> CHUNK_BITS].load(std::memory_order_relaxed);
+    if (!chunk) {
+        chunk = new std::atomic<uint32_t>[CHUNK_ROWS];
+        for (size_t i = 0; i < CHUNK_ROWS; ++i) {
+            chunk[i].store(NONE, std::memory_order_relaxed);
+        }
+        chunks_[row >> CHUNK_BITS].store(chunk, std::memory_order_release);
+    }
+    chunk[row & (CHUNK_ROWS - 1)].store(slot, std::memory_order_release);
+}
+
+void InteractionCounters::raise(uint32_t slot, int64_t views, int64_t saves) {
+    CounterSlot& counter = at(slot);
+    int64_t current = counter.views.load(std::memory_order_relaxed);
+    while (current < views && !counter.views.compare_exchange_weak(current, views, std::memory_order_relaxed)) {
+    }
+    current = counter.saves.load(std::memory_order_relaxed);
+    while (current < saves && !counter.saves.compare_exchange_weak(current, saves, std::memory_order_relaxed)) {
+    }
+}
+
+} // namespace zerocost
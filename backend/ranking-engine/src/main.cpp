@@ -1,83 +1,271 @@
 #include "http_server.h"
 #include "ranking_service.h"
+#include "request_codec.h"
+#include "event_store.h"
+#include "scoring_profiles.h"
+#include "suggest_index.h"
 #include "json.hpp"
+#include <algorithm>
 #include <iostream>
 #include <cstdlib>
 #include <csignal>
+#include <cstring>
+#include <cerrno>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <future>
 #include <sstream>
-#include <iomanip>
+#include <stdexcept>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
 
 using json = nlohmann::json;
 using namespace zerocost;
 
-HttpServer* server_ptr = nullptr;
+HttpResponse json_response(const json& body) {
+    HttpResponse response;
+    response.body = body.dump();
+    return response;
+}
+
+std::chrono::milliseconds env_millis(const char* name, std::chrono::milliseconds fallback) {
+    const char* value = std::getenv(name);
+    return value ? std::chrono::milliseconds(std::atol(value)) : fallback;
+}
+
+/**
+ * Items of a comma-separated header value, trimmed of spaces.
+ */
+std::vector<std::string> split_header_list(const std::string& value) {
+    std::vector<std::string> items;
+    std::istringstream stream(value);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        size_t first = item.find_first_not_of(' ');
+        size_t last = item.find_last_not_of(' ');
+        items.push_back(first == std::string::npos ? "" : item.substr(first, last - first + 1));
+    }
+    return items;
+}
 
-void signal_handler(int signal) {
-    if (signal == SIGINT || signal == SIGTERM) {
-        std::cout << "\nShutting down server..." << std::endl;
-        if (server_ptr) {
-            server_ptr->stop();
+json metrics_json(HttpServer& server, const EventStore& store, const ScoringProfiles& profiles,
+                  const Autocomplete& autocomplete) {
+    const ServerStats& stats = server.stats();
+    StoreView view = store.view();
+    return json{
+        {"requests_total", stats.requests_total.load()},
+        {"shed_queue_full", stats.shed_queue_full.load()},
+        {"shed_queue_timeout", stats.shed_queue_timeout.load()},
+        {"deadline_exceeded", stats.deadline_exceeded.load()},
+        {"read_timeouts", stats.read_timeouts.load()},
+        {"queue_depth", server.queue_depth()},
+        {"store_events", view.size()},
+        {"store_generation", view.snapshot->generation()},
+        {"store_pending_writes", view.overlay->entries.size()},
+        {"store_expired", store.events_expired()},
+        {"wal_records", store.wal() ? store.wal()->stats().records.load() : 0},
+        {"wal_syncs", store.wal() ? store.wal()->stats().syncs.load() : 0},
+        {"interactions_recorded", store.interactions_recorded()},
+        {"scoring_profiles", profiles.size()},
+        {"scoring_profile_reloads", profiles.reloads()},
+        {"suggestions", autocomplete.index()->size()},
+        {"suggestion_rebuilds", autocomplete.rebuilds()}
+    };
+}
+
+/**
+ * Block until SIGINT/SIGTERM arrives on signal_fd or the server thread
+ * exits on its own (e.g. the port could not be bound).
+ *
+ * @return true if a termination signal was received
+ */
+bool wait_for_shutdown(int signal_fd, int server_done_fd) {
+    struct pollfd fds[2] = {{signal_fd, POLLIN, 0}, {server_done_fd, POLLIN, 0}};
+    while (poll(fds, 2, -1) < 0) {
+        if (errno != EINTR) {
+            return false;
         }
-        exit(0);
     }
+    if (!(fds[0].revents & POLLIN)) {
+        return false;
+    }
+    
+    struct signalfd_siginfo info;
+    if (read(signal_fd, &info, sizeof(info)) == sizeof(info)) {
+        std::cout << "\nReceived " << strsignal(info.ssi_signo) << ", draining..." << std::endl;
+    }
+    return true;
 }
 
-std::time_t parse_iso8601(const std::string& datetime) {
-    std::tm tm = {};
-    std::istringstream ss(datetime);
-    ss >> std::get_time(&tm, "%Y-%m-%dT%H:%M:%S");
-    return std::mktime(&tm);
+/**
+ * Shared body of /rank and /search: decode the request in whatever format
+ * the client sent, rank it (against the resident store if it carries no
+ * events) with the scoring profile it names, and answer in the negotiated
+ * format.
+ */
+HttpResponse handle_ranking(const HttpRequest& http_request,
+                            RankingService& ranking_service,
+                            const EventStore& store,
+                            const ScoringProfiles& profiles,
+                            bool search) {
+    WireFormat request_format = wire_format_from_content_type(http_request.header("content-type"));
+    WireFormat response_format = negotiate_response_format(http_request.header("accept"), request_format);
+    
+    HttpResponse response;
+    response.content_type = content_type_for(response_format);
+    
+    try {
+        std::string query;
+        RankingRequest request = decode_ranking_request(http_request.body, request_format, &query);
+        request.deadline = http_request.deadline;
+        request.profiles = profiles.resolve(request.scoring_profile, request.scoring_profiles, request.experiment);
+        
+        if (!request.has_events) {
+            RankingResponse ranked = ranking_service.rank_resident(request, store.view(), search ? query : "");
+            response.body = encode_ranking_response(ranked, response_format, search ? &query : nullptr);
+        } else if (search) {
+            RankingResponse ranked = ranking_service.search_and_rank(request, query);
+            response.body = encode_ranking_response(ranked, response_format, &query);
+        } else {
+            RankingResponse ranked = ranking_service.rank_events(request);
+            response.body = encode_ranking_response(ranked, response_format);
+        }
+    } catch (const DecodeError& e) {
+        response.status_code = 400;
+        response.body = encode_error(std::string("Invalid ") + wire_format_name(request_format), e.what(), response_format);
+    } catch (const json::exception& e) {
+        response.status_code = 400;
+        response.body = encode_error(std::string("Invalid ") + wire_format_name(request_format), e.what(), response_format);
+    } catch (const std::invalid_argument& e) {
+        response.status_code = 400;
+        response.body = encode_error("Invalid scoring profile", e.what(), response_format);
+    }
+    
+    return response;
 }
 
-Event parse_event(const json& j) {
-    Event event;
-    event.id = j.value("id", "");
-    event.title = j.value("title", "");
-    event.description = j.value("description", "");
-    event.latitude = j.value("latitude", 0.0);
-    event.longitude = j.value("longitude", 0.0);
-    event.category = j.value("category", "");
-    event.view_count = j.value("view_count", 0);
-    event.save_count = j.value("save_count", 0);
+/**
+ * /rank/columnar: interpret the body in place as a columnar blob. The
+ * response is JSON unless the Accept header asks for a binary format.
+ * Scoring profiles come from the X-Scoring-Profile header (one name, or
+ * several separated by commas) or the X-Experiment header.
+ */
+HttpResponse handle_columnar_ranking(const HttpRequest& http_request,
+                                     RankingService& ranking_service,
+                                     const ScoringProfiles& profiles) {
+    WireFormat response_format = negotiate_response_format(http_request.header("accept"), WireFormat::Json);
     
-    // Parse timestamps
-    if (j.contains("start_time")) {
-        event.start_time = parse_iso8601(j["start_time"]);
-    } else {
-        event.start_time = std::time(nullptr);
+    HttpResponse response;
+    response.content_type = content_type_for(response_format);
+    
+    try {
+        ColumnarRankingRequest request = decode_columnar_request(http_request.body.data(), http_request.body.size());
+        request.deadline = http_request.deadline;
+        request.profiles = profiles.resolve("", split_header_list(http_request.header("x-scoring-profile")),
+                                            http_request.header("x-experiment"));
+        response.body = encode_ranking_response(ranking_service.rank_columns(request), response_format);
+    } catch (const DecodeError& e) {
+        response.status_code = 400;
+        response.body = encode_error("Invalid columnar body", e.what(), response_format);
+    } catch (const std::invalid_argument& e) {
+        response.status_code = 400;
+        response.body = encode_error("Invalid scoring profile", e.what(), response_format);
     }
     
-    if (j.contains("end_time")) {
-        event.end_time = parse_iso8601(j["end_time"]);
-    } else {
-        event.end_time = event.start_time + 3600; // 1 hour default
+    return response;
+}
+
+/**
+ * POST /events: apply a batch of upserts and deletes to the resident store.
+ */
+HttpResponse handle_event_batch(const HttpRequest& http_request, EventStore& store) {
+    WireFormat request_format = wire_format_from_content_type(http_request.header("content-type"));
+    WireFormat response_format = negotiate_response_format(http_request.header("accept"), request_format);
+    
+    HttpResponse response;
+    response.content_type = content_type_for(response_format);
+    
+    try {
+        EventBatch batch = decode_event_batch(http_request.body, request_format);
+        size_t upserted = batch.upserts.size();
+        store.upsert(std::move(batch.upserts));
+        size_t deleted = store.remove(std::move(batch.deletes));
+        response.body = encode_event_batch_result(upserted, deleted, store.view().size(), response_format);
+    } catch (const DecodeError& e) {
+        response.status_code = 400;
+        response.body = encode_error(std::string("Invalid ") + wire_format_name(request_format), e.what(), response_format);
+    } catch (const json::exception& e) {
+        response.status_code = 400;
+        response.body = encode_error(std::string("Invalid ") + wire_format_name(request_format), e.what(), response_format);
     }
     
-    if (j.contains("created_at")) {
-        event.created_at = parse_iso8601(j["created_at"]);
-    } else {
-        event.created_at = std::time(nullptr);
+    return response;
+}
+
+/**
+ * POST /events/interactions: add view/save increments to resident events.
+ */
+HttpResponse handle_interactions(const HttpRequest& http_request, EventStore& store) {
+    WireFormat request_format = wire_format_from_content_type(http_request.header("content-type"));
+    WireFormat response_format = negotiate_response_format(http_request.header("accept"), request_format);
+    
+    HttpResponse response;
+    response.content_type = content_type_for(response_format);
+    
+    try {
+        std::vector<Interaction> interactions = decode_interactions(http_request.body, request_format);
+        size_t applied = store.record_interactions(interactions);
+        response.body = encode_interaction_result(interactions.size(), applied, response_format);
+    } catch (const DecodeError& e) {
+        response.status_code = 400;
+        response.body = encode_error(std::string("Invalid ") + wire_format_name(request_format), e.what(), response_format);
+    } catch (const json::exception& e) {
+        response.status_code = 400;
+        response.body = encode_error(std::string("Invalid ") + wire_format_name(request_format), e.what(), response_format);
     }
     
-    return event;
+    return response;
 }
 
-json event_to_json(const Event& event) {
-    return json{
-        {"id", event.id},
-        {"title", event.title},
-        {"description", event.description},
-        {"latitude", event.latitude},
-        {"longitude", event.longitude},
-        {"category", event.category},
-        {"distance_km", event.distance_km},
-        {"score", event.score}
-    };
+/**
+ * GET /suggest?q=...&limit=...: complete a partly typed query from the
+ * suggestion index. Never waits for a rebuild.
+ */
+HttpResponse handle_suggest(const HttpRequest& http_request, const Autocomplete& autocomplete) {
+    auto start_time = std::chrono::steady_clock::now();
+    WireFormat response_format = negotiate_response_format(http_request.header("accept"), WireFormat::Json);
+    
+    HttpResponse response;
+    response.content_type = content_type_for(response_format);
+    
+    std::string query = http_request.query_param("q");
+    long limit = std::atol(http_request.query_param("limit", "10").c_str());
+    std::vector<Suggestion> suggestions =
+        autocomplete.index()->suggest(query, static_cast<size_t>(std::max(limit, 0L)));
+    
+    auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_time);
+    response.body = encode_suggestions(query, suggestions, duration.count() / 1e6, response_format);
+    return response;
 }
 
 int main() {
     std::cout << "Starting ZeroCost Ranking Engine..." << std::endl;
     
+    // Termination signals are blocked in every thread and consumed through a
+    // signalfd by main, so shutdown runs as ordinary code rather than inside
+    // an async signal handler
+    sigset_t termination_signals;
+    sigemptyset(&termination_signals);
+    sigaddset(&termination_signals, SIGINT);
+    sigaddset(&termination_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &termination_signals, nullptr);
+    int signal_fd = signalfd(-1, &termination_signals, SFD_CLOEXEC);
+    int server_done_fd = eventfd(0, EFD_CLOEXEC);
+    
     // Get port from environment or use default
     int port = 8082;
     const char* port_env = std::getenv("PORT");
@@ -85,125 +273,187 @@ int main() {
         port = std::atoi(port_env);
     }
     
-    HttpServer server(port);
-    server_ptr = &server;
+    ServerOptions options;
     
-    // Set up signal handlers
-    std::signal(SIGINT, signal_handler);
-    std::signal(SIGTERM, signal_handler);
+    // Select I/O backend (threaded or io_uring); falls back when unsupported
+    const char* backend_env = std::getenv("IO_BACKEND");
+    if (backend_env && std::string(backend_env) == "io_uring") {
+        if (HttpServer::io_uring_supported()) {
+            options.backend = IoBackend::IoUring;
+        } else {
+            std::cerr << "io_uring not supported by this build or kernel, using threaded backend" << std::endl;
+        }
+    }
     
-    RankingService ranking_service;
+    // Worker pool, admission control and default request deadline
+    if (const char* workers_env = std::getenv("WORKER_THREADS")) {
+        options.worker_threads = std::atoi(workers_env);
+    }
+    if (const char* depth_env = std::getenv("MAX_QUEUE_DEPTH")) {
+        options.max_queue_depth = std::atol(depth_env);
+    }
+    options.max_queue_time = env_millis("MAX_QUEUE_MS", options.max_queue_time);
+    options.default_timeout = env_millis("REQUEST_TIMEOUT_MS", options.default_timeout);
+    options.read_timeout = env_millis("READ_TIMEOUT_MS", options.read_timeout);
+    
+    // Shutdown: report unhealthy for the grace period so load balancers stop
+    // routing here, then stop accepting and wait for in-flight requests
+    std::chrono::milliseconds shutdown_grace = env_millis("SHUTDOWN_GRACE_MS", std::chrono::milliseconds(0));
+    std::chrono::milliseconds drain_timeout = env_millis("DRAIN_TIMEOUT_MS", std::chrono::milliseconds(30000));
+    std::chrono::milliseconds store_stop_timeout = env_millis("STORE_STOP_TIMEOUT_MS", std::chrono::milliseconds(10000));
+    std::atomic<bool> draining(false);
+    
+    HttpServer server(port, options);
+    
+    // Approximate distances for city-scale radii unless APPROXIMATE_DISTANCE=0
+    const char* approximate_env = std::getenv("APPROXIMATE_DISTANCE");
+    RankingService ranking_service(!approximate_env || std::string(approximate_env) != "0");
+    
+    // Named scoring profiles, re-read when the file changes
+    ScoringProfiles profiles(std::getenv("SCORING_PROFILES") ? std::getenv("SCORING_PROFILES") : "");
+    try {
+        profiles.load();
+    } catch (const std::runtime_error& e) {
+        std::cerr << "Cannot load scoring profiles: " << e.what() << std::endl;
+        return 1;
+    }
+    
+    // Resident event store, served from a memory-mapped snapshot when one exists
+    StoreOptions store_options;
+    if (const char* snapshot_env = std::getenv("SNAPSHOT_PATH")) {
+        store_options.snapshot_path = snapshot_env;
+    }
+    if (const char* threshold_env = std::getenv("COMPACT_THRESHOLD")) {
+        store_options.compact_threshold = std::atol(threshold_env);
+    }
+    store_options.compact_interval = env_millis("COMPACT_INTERVAL_MS", store_options.compact_interval);
+    if (const char* interactions_env = std::getenv("COMPACT_INTERACTIONS")) {
+        store_options.compact_interactions = std::atol(interactions_env);
+    }
+    if (const char* wal_env = std::getenv("WRITE_AHEAD_LOG")) {
+        store_options.write_ahead_log = std::string(wal_env) != "0";
+    }
+    if (const char* expire_env = std::getenv("EXPIRE_EVENTS")) {
+        store_options.expire_events = std::string(expire_env) != "0";
+    }
+    EventStore store(store_options);
+    try {
+        auto load_start = std::chrono::steady_clock::now();
+        size_t loaded = store.load();
+        auto load_us = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - load_start).count();
+        if (!store_options.snapshot_path.empty()) {
+            StoreView view = store.view();
+            std::cout << "Loaded " << loaded << " events from " << store_options.snapshot_path
+                      << " (generation " << view.snapshot->generation() << ", "
+                      << view.overlay->entries.size() << " writes replayed from the WAL) in "
+                      << load_us / 1000.0 << "ms" << std::endl;
+        }
+    } catch (const std::runtime_error& e) {
+        std::cerr << "Cannot load event store: " << e.what() << std::endl;
+        return 1;
+    }
+    store.start();
+    profiles.start(env_millis("SCORING_PROFILES_RELOAD_MS", std::chrono::milliseconds(1000)));
+    Autocomplete autocomplete(store);
+    autocomplete.start(env_millis("SUGGEST_REFRESH_MS", std::chrono::milliseconds(1000)));
     
     // Health check endpoint
-    server.add_route("GET", "/health", [](const std::string&) {
-        return json{
-            {"status", "healthy"},
+    server.add_route("GET", "/health", [&draining](const HttpRequest&) {
+        HttpResponse response = json_response(json{
+            {"status", draining ? "draining" : "healthy"},
             {"service", "ranking-engine"},
             {"version", "1.0.0"}
-        }.dump();
+        });
+        if (draining) {
+            response.status_code = 503;
+        }
+        return response;
+    });
+    
+    // Load shedding and timeout counters
+    server.add_route("GET", "/metrics", [&server, &store, &profiles, &autocomplete](const std::string&) {
+        return metrics_json(server, store, profiles, autocomplete).dump();
     });
     
     // Rank events endpoint
-    server.add_route("POST", "/rank", [&ranking_service](const std::string& body) {
-        try {
-            json request_json = json::parse(body);
-            
-            // Parse request
-            RankingRequest request;
-            request.user_location.latitude = request_json["user_location"]["latitude"];
-            request.user_location.longitude = request_json["user_location"]["longitude"];
-            request.user_location.current_time = std::time(nullptr);
-            
-            if (request_json["user_location"].contains("preferred_categories")) {
-                for (const auto& cat : request_json["user_location"]["preferred_categories"]) {
-                    request.user_location.preferred_categories.push_back(cat);
-                }
-            }
-            
-            request.max_distance_km = request_json.value("max_distance_km", 50.0);
-            request.limit = request_json.value("limit", 100);
-            
-            // Parse events
-            for (const auto& event_json : request_json["events"]) {
-                request.events.push_back(parse_event(event_json));
-            }
-            
-            // Rank events
-            RankingResponse response = ranking_service.rank_events(request);
-            
-            // Build response
-            json response_json;
-            response_json["total_count"] = response.total_count;
-            response_json["processing_time_ms"] = response.processing_time_ms;
-            response_json["ranked_events"] = json::array();
-            
-            for (const auto& event : response.ranked_events) {
-                response_json["ranked_events"].push_back(event_to_json(event));
-            }
-            
-            return response_json.dump();
-        } catch (const json::exception& e) {
-            return json{
-                {"error", "Invalid JSON"},
-                {"message", e.what()}
-            }.dump();
-        }
+    server.add_route("POST", "/rank", [&ranking_service, &store, &profiles](const HttpRequest& http_request) {
+        return handle_ranking(http_request, ranking_service, store, profiles, false);
+    });
+    
+    // Rank a columnar (structure-of-arrays) binary body without per-event parsing
+    server.add_route("POST", "/rank/columnar", [&ranking_service, &profiles](const HttpRequest& http_request) {
+        return handle_columnar_ranking(http_request, ranking_service, profiles);
     });
     
     // Search and rank endpoint
-    server.add_route("POST", "/search", [&ranking_service](const std::string& body) {
-        try {
-            json request_json = json::parse(body);
-            
-            // Parse request
-            RankingRequest request;
-            request.user_location.latitude = request_json["user_location"]["latitude"];
-            request.user_location.longitude = request_json["user_location"]["longitude"];
-            request.user_location.current_time = std::time(nullptr);
+    server.add_route("POST", "/search", [&ranking_service, &store, &profiles](const HttpRequest& http_request) {
+        return handle_ranking(http_request, ranking_service, store, profiles, true);
+    });
+    
+    // Write events into the resident store
+    server.add_route("POST", "/events", [&store](const HttpRequest& http_request) {
+        return handle_event_batch(http_request, store);
+    });
+    
+    // Live view/save counts for resident events
+    server.add_route("POST", "/events/interactions", [&store](const HttpRequest& http_request) {
+        return handle_interactions(http_request, store);
+    });
+    
+    // Query autocomplete from resident titles and categories
+    server.add_route("GET", "/suggest", [&autocomplete](const HttpRequest& http_request) {
+        return handle_suggest(http_request, autocomplete);
+    });
+    
+    std::cout << "Ranking Engine initialized successfully!" << std::endl;
+    
+    // Serve on a separate thread; main only waits for shutdown
+    std::thread server_thread([&server, server_done_fd]() {
+        server.run();
+        uint64_t done = 1;
+        (void)!write(server_done_fd, &done, sizeof(done));
+    });
+    
+    if (wait_for_shutdown(signal_fd, server_done_fd)) {
+        draining = true;
+        std::this_thread::sleep_for(shutdown_grace);
+        
+        if (!server.drain(drain_timeout)) {
+            std::cerr << "Drain timed out after " << drain_timeout.count()
+                      << "ms, exiting with requests in flight" << std::endl;
             
-            if (request_json["user_location"].contains("preferred_categories")) {
-                for (const auto& cat : request_json["user_location"]["preferred_categories"]) {
-                    request.user_location.preferred_categories.push_back(cat);
+            // Still sync the log and fold acknowledged writes, but don't let a
+            // stuck store hold the exit either
+            std::packaged_task<void()> stop_store([&store]() { store.stop(); });
+            std::future<void> stopped = stop_store.get_future();
+            std::thread(std::move(stop_store)).detach();
+            if (stopped.wait_for(store_stop_timeout) != std::future_status::ready) {
+                std::cerr << "Store shutdown timed out after " << store_stop_timeout.count() << "ms" << std::endl;
+            } else {
+                try {
+                    stopped.get();
+                } catch (const std::runtime_error& e) {
+                    std::cerr << "Final compaction failed: " << e.what() << std::endl;
                 }
             }
-            
-            request.max_distance_km = request_json.value("max_distance_km", 50.0);
-            request.limit = request_json.value("limit", 100);
-            
-            std::string query = request_json.value("query", "");
-            
-            // Parse events
-            for (const auto& event_json : request_json["events"]) {
-                request.events.push_back(parse_event(event_json));
-            }
-            
-            // Search and rank events
-            RankingResponse response = ranking_service.search_and_rank(request, query);
-            
-            // Build response
-            json response_json;
-            response_json["query"] = query;
-            response_json["total_count"] = response.total_count;
-            response_json["processing_time_ms"] = response.processing_time_ms;
-            response_json["ranked_events"] = json::array();
-            
-            for (const auto& event : response.ranked_events) {
-                response_json["ranked_events"].push_back(event_to_json(event));
-            }
-            
-            return response_json.dump();
-        } catch (const json::exception& e) {
-            return json{
-                {"error", "Invalid JSON"},
-                {"message", e.what()}
-            }.dump();
+            std::cout << "Final metrics: " << metrics_json(server, store, profiles, autocomplete).dump() << std::endl;
+            std::_Exit(1);
         }
-    });
+    }
     
-    std::cout << "Ranking Engine initialized successfully!" << std::endl;
+    server_thread.join();
+    profiles.stop();
+    autocomplete.stop();
     
-    // Start server (blocks)
-    server.run();
+    // Fold pending writes into the snapshot so the next start maps them
+    try {
+        store.stop();
+    } catch (const std::runtime_error& e) {
+        std::cerr << "Final compaction failed: " << e.what() << std::endl;
+    }
+    std::cout << "Final metrics: " << metrics_json(server, store, profiles, autocomplete).dump() << std::endl;
+    std::cout << "Shutdown complete" << std::endl;
     
     return 0;
 }
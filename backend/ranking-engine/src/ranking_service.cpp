@@ -1,22 +1,361 @@
 #include "ranking_service.h"
 #include "distance.h"
+#include "embedding.h"
 #include "scoring.h"
+#include "scoring_profiles.h"
+#include "text_index.h"
 #include <algorithm>
 #include <chrono>
+#include <cmath>
+#include <functional>
+#include <stdexcept>
+#include <utility>
 
 namespace zerocost {
 
+namespace {
+
+// (score, row) of an event that passed the distance filter
+using Candidate = std::pair<double, size_t>;
+
+/**
+ * Radius check against max_distance_km for one request. Uses the unit
+ * vector chord when rows carry one, the equirectangular approximation when
+ * it is within its error bound, and haversine otherwise or for points close
+ * enough to the cutoff that the approximation could decide either way.
+ */
+class DistanceFilter {
+public:
+    DistanceFilter(const UserLocation& user, double max_distance_km, bool allow_approximate)
+        : user_(user),
+          max_distance_km_(max_distance_km),
+          approximate_(allow_approximate && approximate_distance_applies(user.latitude, max_distance_km)),
+          projection_(make_local_projection(user.latitude, user.longitude)),
+          cutoff_band_km_(max_distance_km * APPROXIMATE_DISTANCE_MAX_ERROR),
+          unit_(to_unit_vector(user.latitude, user.longitude)),
+          max_chord_sq_(max_chord_squared(max_distance_km)) {}
+    
+    bool within(double latitude, double longitude, double& distance_km) const {
+        if (approximate_) {
+            distance_km = approximate_distance(projection_, latitude, longitude);
+            if (std::fabs(distance_km - max_distance_km_) > cutoff_band_km_) {
+                return distance_km <= max_distance_km_;
+            }
+        }
+        distance_km = haversine_distance(user_.latitude, user_.longitude, latitude, longitude);
+        return distance_km <= max_distance_km_;
+    }
+    
+    bool within_unit(double x, double y, double z, double& distance_km) const {
+        double chord_sq = chord_squared(unit_, x, y, z);
+        if (chord_sq > max_chord_sq_) {
+            return false;
+        }
+        distance_km = chord_distance(chord_sq);
+        return distance_km <= max_distance_km_;
+    }
+    
+    // Row i of columns, by chord when the columns carry unit vectors
+    bool within_row(const EventColumns& columns, size_t i, double& distance_km) const {
+        return columns.unit_x
+            ? within_unit(columns.unit_x[i], columns.unit_y[i], columns.unit_z[i], distance_km)
+            : within(columns.latitude[i], columns.longitude[i], distance_km);
+    }
+    
+private:
+    const UserLocation& user_;
+    double max_distance_km_;
+    bool approximate_;
+    LocalProjection projection_;
+    double cutoff_band_km_;
+    UnitVector unit_;
+    double max_chord_sq_;
+};
+
+// Scoring with the built-in weights, for requests that did not resolve a profile
+const ScoringProfile DEFAULT_PROFILE;
+
+// Profiles a request is scored with; the first gives ranked_events
+using ProfileList = std::vector<const ScoringProfile*>;
+
+ProfileList profiles_of(const std::vector<std::shared_ptr<const ScoringProfile>>& profiles) {
+    if (profiles.size() > ScoringProfiles::MAX_VARIANTS) {
+        throw std::invalid_argument("too many scoring profiles");
+    }
+    ProfileList list;
+    for (const auto& profile : profiles) {
+        list.push_back(profile.get());
+    }
+    if (list.empty()) {
+        list.push_back(&DEFAULT_PROFILE);
+    }
+    return list;
+}
+
+/**
+ * Candidates in range and, when a request has several profiles, their
+ * scores under profiles 1..n-1: n-1 entries per candidate, in candidate order.
+ */
+struct CandidateSet {
+    std::vector<Candidate> candidates;
+    std::vector<double> variant_scores;
+};
+
+// Events scored together by calculate_final_scores
+constexpr size_t SCORE_BLOCK = 256;
+
+struct ScoreBlock {
+    size_t size = 0;
+    size_t row[SCORE_BLOCK];
+    double distance_km[SCORE_BLOCK];
+    int64_t start_time[SCORE_BLOCK];
+    int64_t created_at[SCORE_BLOCK];
+    int view_count[SCORE_BLOCK];
+    int save_count[SCORE_BLOCK];
+    double category_score[SCORE_BLOCK];
+    double text_similarity[SCORE_BLOCK];
+    double embedding_similarity[SCORE_BLOCK];
+    double score[SCORE_BLOCK];
+    
+    // With several profiles: components shared by all of them, and the
+    // scores of profiles 1..n-1 (profile 0 fills score)
+    double distance_score[SCORE_BLOCK];
+    double urgency_score[SCORE_BLOCK];
+    double popularity_score[SCORE_BLOCK];
+    double freshness_score[SCORE_BLOCK];
+    double variant_score[ScoringProfiles::MAX_VARIANTS][SCORE_BLOCK];
+
+    void score_all(std::time_t current_time, const ProfileList& profiles) {
+        ScoreColumns columns{distance_km, start_time, created_at, view_count,
+                             save_count, category_score, text_similarity, embedding_similarity};
+        if (profiles.size() == 1) {
+            calculate_final_scores(columns, size, current_time, *profiles[0], score);
+            return;
+        }
+        
+        // Components are recomputed only when a profile changes the distance
+        // or popularity scale; each profile then costs one weighted sum
+        ComponentScores components{distance_score, urgency_score, popularity_score, freshness_score};
+        for (size_t p = 0; p < profiles.size(); ++p) {
+            if (p == 0 || !same_component_shape(*profiles[p], *profiles[p - 1])) {
+                calculate_component_scores(columns, size, current_time, *profiles[p], components);
+            }
+            combine_component_scores(columns, components, size, *profiles[p], p == 0 ? score : variant_score[p]);
+        }
+    }
+};
+
+void flush_block(ScoreBlock& block, std::time_t current_time, const ProfileList& profiles,
+                 CandidateSet& set) {
+    block.score_all(current_time, profiles);
+    for (size_t j = 0; j < block.size; ++j) {
+        set.candidates.emplace_back(block.score[j], block.row[j]);
+        for (size_t p = 1; p < profiles.size(); ++p) {
+            set.variant_scores.push_back(block.variant_score[p][j]);
+        }
+    }
+    block.size = 0;
+}
+
+/**
+ * Score rows [begin, end) of columns, appending those within range and
+ * window and, with a query, matching at least one of its terms. With a
+ * query embedding, rows are compared with it if the snapshot stores
+ * embeddings. With a store view, rows masked by its overlay (replaced or
+ * deleted since the snapshot) are skipped and popularity comes from the
+ * live counters.
+ */
+void score_rows(const EventColumns& columns, size_t begin, size_t end,
+                const UserLocation& user, const DistanceFilter& distance,
+                const StartWindow& window,
+                const ProfileList& profiles,
+                const std::vector<double>& category_scores,
+                const Bm25Scorer* text,
+                const EmbeddingQuery* embedding,
+                const StoreView* store,
+                CandidateSet& set) {
+    const StoreOverlay* overlay = store ? store->overlay.get() : nullptr;
+    bool check_mask = overlay && !overlay->masked_rows.empty();
+    bool check_window = window.bounded();
+    
+    bool use_embedding = embedding && columns.embeddings;
+    
+    ScoreBlock block;
+    for (size_t i = begin; i < end; ++i) {
+        if (check_window && !window.contains(static_cast<std::time_t>(columns.start_time[i]))) {
+            continue;
+        }
+        // With precomputed unit vectors the radius check is a chord comparison,
+        // and only rows in range pay for the conversion back to kilometers
+        double distance_km;
+        if (!distance.within_row(columns, i, distance_km) || (check_mask && overlay->masks(i))) {
+            continue;
+        }
+        
+        double text_similarity = 0.5;
+        if (text) {
+            text_similarity = columns.terms
+                ? text->score(columns.row_terms(i), columns.row_term_count(i))
+                : text->score(columns.title(i), columns.description(i));
+            if (text_similarity <= 0.0) {
+                continue;
+            }
+        }
+        
+        size_t j = block.size++;
+        block.row[j] = i;
+        block.distance_km[j] = distance_km;
+        block.text_similarity[j] = text_similarity;
+        block.embedding_similarity[j] = use_embedding
+            ? embedding->similarity(columns.row_embedding(i), columns.row_embedding_size(i))
+            : 0.5;
+        block.start_time[j] = columns.start_time[i];
+        block.created_at[j] = columns.created_at[i];
+        block.view_count[j] = store ? store->views(i) : columns.view_count[i];
+        block.save_count[j] = store ? store->saves(i) : columns.save_count[i];
+        block.category_score[j] = category_scores[columns.category_id[i]];
+        if (block.size == SCORE_BLOCK) {
+            flush_block(block, user.current_time, profiles, set);
+        }
+    }
+    flush_block(block, user.current_time, profiles, set);
+}
+
+/**
+ * Pick up to limit non-duplicate events in score order. Candidates are
+ * sorted only as far as needed, and only those examined are materialized;
+ * of two duplicates the higher-scored one is kept.
+ */
+std::vector<Event> select_top(std::vector<Candidate>& candidates, int limit, const Deadline& deadline,
+                              const std::function<Event(size_t)>& materialize) {
+    deadline.check("sorting");
+    auto by_score = [](const Candidate& a, const Candidate& b) {
+        return a.first > b.first || (a.first == b.first && a.second < b.second);
+    };
+    size_t wanted = limit > 0 ? static_cast<size_t>(limit) : candidates.size();
+    
+    std::vector<Event> selected;
+    size_t sorted = 0;
+    for (size_t next = 0; next < candidates.size() && selected.size() < wanted; ++next) {
+        if (next == sorted) {
+            size_t window = std::min(candidates.size(), sorted + std::max<size_t>(wanted, 16));
+            std::partial_sort(candidates.begin() + sorted, candidates.begin() + window,
+                              candidates.end(), by_score);
+            sorted = window;
+            deadline.check("deduplication");
+        }
+        
+        Event event = materialize(candidates[next].second);
+        bool is_duplicate = false;
+        for (const auto& kept : selected) {
+            if (are_events_duplicate(event, kept)) {
+                is_duplicate = true;
+                break;
+            }
+        }
+        if (!is_duplicate) {
+            event.score = candidates[next].first;
+            selected.push_back(std::move(event));
+        }
+    }
+    return selected;
+}
+
+/**
+ * Fill in ranked_events and total_count from the first profile and, with
+ * several profiles, one variant per profile. Each variant selects its own
+ * top events from the shared candidates.
+ */
+void select_rankings(CandidateSet& set, const ProfileList& profiles, int limit, const Deadline& deadline,
+                     const std::function<Event(size_t)>& materialize, RankingResponse& response) {
+    response.total_count = set.candidates.size();
+    
+    // Variants go first: selecting the primary ranking reorders the candidates
+    size_t stride = profiles.size() - 1;
+    for (size_t p = 1; p < profiles.size(); ++p) {
+        std::vector<Candidate> scored(set.candidates.size());
+        for (size_t i = 0; i < set.candidates.size(); ++i) {
+            scored[i] = Candidate(set.variant_scores[i * stride + p - 1], set.candidates[i].second);
+        }
+        response.variants.push_back(RankingVariant{profiles[p]->name, select_top(scored, limit, deadline, materialize), {}});
+    }
+    
+    response.ranked_events = select_top(set.candidates, limit, deadline, materialize);
+    if (profiles.size() > 1) {
+        response.variants.insert(response.variants.begin(), RankingVariant{profiles[0]->name, response.ranked_events, {}});
+    }
+}
+
+std::vector<ScoreExplanation> explain_events(const std::vector<Event>& events, const UserLocation& user,
+                                             const CategoryMask& preferred, const ScoringProfile& profile,
+                                             const Bm25Scorer* text, const EmbeddingQuery* embedding) {
+    std::vector<ScoreExplanation> explanations;
+    explanations.reserve(events.size());
+    for (const Event& event : events) {
+        double text_similarity = text ? text->score(event.title, event.description) : 0.5;
+        double embedding_similarity = embedding ? embedding->similarity(event.embedding) : 0.5;
+        explanations.push_back(explain_final_score(event, user, preferred, profile, text_similarity,
+                                                   embedding_similarity));
+    }
+    return explanations;
+}
+
+/**
+ * Score breakdowns for the returned events of every ranking in response.
+ * Runs after selection, so only requests that ask for it pay, and only for
+ * the events they get back.
+ */
+void explain_rankings(const UserLocation& user, const ProfileList& profiles, const Bm25Scorer* text,
+                      const EmbeddingQuery* embedding, RankingResponse& response) {
+    CategoryMask preferred(user.preferred_categories);
+    response.explanations = explain_events(response.ranked_events, user, preferred, *profiles[0], text,
+                                           embedding);
+    for (size_t p = 0; p < response.variants.size(); ++p) {
+        RankingVariant& variant = response.variants[p];
+        variant.explanations = explain_events(variant.ranked_events, user, preferred, *profiles[p], text,
+                                              embedding);
+    }
+}
+
+/**
+ * The request's query embedding, or null when there is none or no profile
+ * could use it (zero weight and no model), so rows are not compared for
+ * nothing.
+ */
+const EmbeddingQuery* embedding_of(const EmbeddingQuery& query, const ProfileList& profiles) {
+    if (query.empty()) {
+        return nullptr;
+    }
+    for (const ScoringProfile* profile : profiles) {
+        if (profile->weight_embedding != 0.0 || profile->model) {
+            return &query;
+        }
+    }
+    return nullptr;
+}
+
+} // namespace
+
+void RankingService::filter_by_start_window(std::vector<Event>& events, const StartWindow& window) {
+    if (!window.bounded()) {
+        return;
+    }
+    events.erase(
+        std::remove_if(events.begin(), events.end(), [&](const Event& event) {
+            return !window.contains(event.start_time);
+        }),
+        events.end()
+    );
+}
+
 void RankingService::calculate_distances(std::vector<Event>& events, 
                                          const UserLocation& user_location,
                                          double max_distance_km) {
     // Remove events that are too far
+    DistanceFilter distance(user_location, max_distance_km, approximate_distance_);
     events.erase(
         std::remove_if(events.begin(), events.end(), [&](Event& event) {
-            event.distance_km = haversine_distance(
-                user_location.latitude, user_location.longitude,
-                event.latitude, event.longitude
-            );
-            return event.distance_km > max_distance_km;
+            return !distance.within(event.latitude, event.longitude, event.distance_km);
         }),
         events.end()
     );
@@ -24,9 +363,54 @@ void RankingService::calculate_distances(std::vector<Event>& events,
 
 void RankingService::calculate_scores(std::vector<Event>& events, 
                                       const UserLocation& user_location,
-                                      const std::string& query) {
-    for (auto& event : events) {
-        event.score = calculate_final_score(event, user_location, query);
+                                      const std::vector<const ScoringProfile*>& profiles,
+                                      std::vector<double>& variant_scores,
+                                      const std::vector<double>* text_similarity,
+                                      const EmbeddingQuery* embedding) {
+    // Resolve preferences to a mask once; each event is then a bit test
+    CategoryMask preferred(user_location.preferred_categories);
+    ScoreBlock block;
+    for (size_t begin = 0; begin < events.size(); begin += SCORE_BLOCK) {
+        block.size = std::min(SCORE_BLOCK, events.size() - begin);
+        for (size_t j = 0; j < block.size; ++j) {
+            const Event& event = events[begin + j];
+            block.distance_km[j] = event.distance_km;
+            block.start_time[j] = event.start_time;
+            block.created_at[j] = event.created_at;
+            block.view_count[j] = event.view_count;
+            block.save_count[j] = event.save_count;
+            block.category_score[j] = event.category_id != CategoryDictionary::NONE
+                ? preferred.score(event.category_id)
+                : calculate_category_score(event.category, user_location.preferred_categories);
+            block.text_similarity[j] = text_similarity ? (*text_similarity)[begin + j] : 0.5;
+            block.embedding_similarity[j] = embedding ? embedding->similarity(event.embedding) : 0.5;
+        }
+        block.score_all(user_location.current_time, profiles);
+        for (size_t j = 0; j < block.size; ++j) {
+            events[begin + j].score = block.score[j];
+            for (size_t p = 1; p < profiles.size(); ++p) {
+                variant_scores.push_back(block.variant_score[p][j]);
+            }
+        }
+    }
+}
+
+void RankingService::rank_variants(const std::vector<Event>& events,
+                                   const std::vector<double>& variant_scores,
+                                   const std::vector<const ScoringProfile*>& profiles,
+                                   int limit,
+                                   RankingResponse& response) {
+    size_t stride = profiles.size() - 1;
+    for (size_t p = 1; p < profiles.size(); ++p) {
+        RankingVariant variant{profiles[p]->name, events, {}};
+        for (size_t i = 0; i < events.size(); ++i) {
+            variant.ranked_events[i].score = variant_scores[i * stride + p - 1];
+        }
+        sort_by_score(variant.ranked_events);
+        if (limit > 0 && variant.ranked_events.size() > static_cast<size_t>(limit)) {
+            variant.ranked_events.resize(limit);
+        }
+        response.variants.push_back(std::move(variant));
     }
 }
 
@@ -42,16 +426,28 @@ RankingResponse RankingService::rank_events(const RankingRequest& request) {
     RankingResponse response;
     response.ranked_events = request.events;
     
-    // Step 1: Calculate distances and filter by max distance
+    // Step 1: Drop events outside the start window, then calculate
+    // distances and filter by max distance
+    request.deadline.check("distance");
+    filter_by_start_window(response.ranked_events, request.start_window);
     calculate_distances(response.ranked_events, request.user_location, request.max_distance_km);
     
     // Step 2: Deduplicate events
+    request.deadline.check("deduplication");
     deduplicate_events(response.ranked_events);
     
-    // Step 3: Calculate scores
-    calculate_scores(response.ranked_events, request.user_location);
+    // Step 3: Calculate scores, for every profile in one pass
+    request.deadline.check("scoring");
+    ProfileList profiles = profiles_of(request.profiles);
+    EmbeddingQuery query_embedding(request.query_embedding);
+    const EmbeddingQuery* embedding = embedding_of(query_embedding, profiles);
+    std::vector<double> variant_scores;
+    calculate_scores(response.ranked_events, request.user_location, profiles, variant_scores, nullptr,
+                     embedding);
     
     // Step 4: Sort by score
+    request.deadline.check("sorting");
+    rank_variants(response.ranked_events, variant_scores, profiles, request.limit, response);
     sort_by_score(response.ranked_events);
     
     // Step 5: Apply limit
@@ -59,6 +455,12 @@ RankingResponse RankingService::rank_events(const RankingRequest& request) {
     if (request.limit > 0 && response.ranked_events.size() > static_cast<size_t>(request.limit)) {
         response.ranked_events.resize(request.limit);
     }
+    if (profiles.size() > 1) {
+        response.variants.insert(response.variants.begin(), RankingVariant{profiles[0]->name, response.ranked_events, {}});
+    }
+    if (request.explain) {
+        explain_rankings(request.user_location, profiles, nullptr, embedding, response);
+    }
     
     auto end_time = std::chrono::high_resolution_clock::now();
     auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end_time - start_time);
@@ -74,28 +476,63 @@ RankingResponse RankingService::search_and_rank(const RankingRequest& request,
     RankingResponse response;
     response.ranked_events = request.events;
     
-    // Step 1: Calculate distances and filter by max distance
+    // Step 1: Drop events outside the start window, then calculate
+    // distances and filter by max distance
+    request.deadline.check("distance");
+    filter_by_start_window(response.ranked_events, request.start_window);
     calculate_distances(response.ranked_events, request.user_location, request.max_distance_km);
     
     // Step 2: Deduplicate events
+    request.deadline.check("deduplication");
     deduplicate_events(response.ranked_events);
     
-    // Step 3: Calculate scores with query
-    calculate_scores(response.ranked_events, request.user_location, query);
-    
-    // Step 4: Filter by minimum text similarity threshold
+    // Step 3: Score the query by BM25 with the remaining events as the
+    // corpus, keeping those that match at least one query term or a close
+    // misspelling of one found in their titles
+    std::vector<std::vector<TermEntry>> event_terms(response.ranked_events.size());
+    TextCorpusDelta corpus_terms;
+    std::vector<std::string> title_terms;
     if (!query.empty()) {
-        response.ranked_events.erase(
-            std::remove_if(response.ranked_events.begin(), response.ranked_events.end(), 
-                          [&](const Event& event) {
-                std::string event_text = event.title + " " + event.description;
-                return calculate_text_similarity(query, event_text) < 0.1;
-            }),
-            response.ranked_events.end()
-        );
+        for (size_t i = 0; i < response.ranked_events.size(); ++i) {
+            const Event& event = response.ranked_events[i];
+            extract_terms(event.title, event.description, event_terms[i]);
+            corpus_terms.add(event_terms[i]);
+            extract_title_terms(event.title, title_terms);
+        }
+    }
+    VocabularyData vocabulary = build_vocabulary(std::move(title_terms));
+    TermVocabulary vocabulary_view = vocabulary.view();
+    Bm25Scorer scorer(query, TextCorpus(nullptr, 0, TextTotals{}, &corpus_terms), &vocabulary_view);
+    const Bm25Scorer* text = query.empty() ? nullptr : &scorer;
+    std::vector<double> text_similarity;
+    if (text) {
+        size_t kept = 0;
+        for (size_t i = 0; i < response.ranked_events.size(); ++i) {
+            double similarity = text->score(event_terms[i].data(), event_terms[i].size());
+            if (similarity <= 0.0) {
+                continue;
+            }
+            if (kept != i) {
+                response.ranked_events[kept] = std::move(response.ranked_events[i]);
+            }
+            text_similarity.push_back(similarity);
+            ++kept;
+        }
+        response.ranked_events.resize(kept);
     }
     
+    // Step 4: Calculate scores with query, for every profile in one pass
+    request.deadline.check("scoring");
+    ProfileList profiles = profiles_of(request.profiles);
+    EmbeddingQuery query_embedding(request.query_embedding);
+    const EmbeddingQuery* embedding = embedding_of(query_embedding, profiles);
+    std::vector<double> variant_scores;
+    calculate_scores(response.ranked_events, request.user_location, profiles, variant_scores,
+                     text ? &text_similarity : nullptr, embedding);
+    
     // Step 5: Sort by score
+    request.deadline.check("sorting");
+    rank_variants(response.ranked_events, variant_scores, profiles, request.limit, response);
     sort_by_score(response.ranked_events);
     
     // Step 6: Apply limit
@@ -103,6 +540,153 @@ RankingResponse RankingService::search_and_rank(const RankingRequest& request,
     if (request.limit > 0 && response.ranked_events.size() > static_cast<size_t>(request.limit)) {
         response.ranked_events.resize(request.limit);
     }
+    if (profiles.size() > 1) {
+        response.variants.insert(response.variants.begin(), RankingVariant{profiles[0]->name, response.ranked_events, {}});
+    }
+    if (request.explain) {
+        explain_rankings(request.user_location, profiles, text, embedding, response);
+    }
+    
+    auto end_time = std::chrono::high_resolution_clock::now();
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end_time - start_time);
+    response.processing_time_ms = duration.count() / 1000.0;
+    
+    return response;
+}
+
+RankingResponse RankingService::rank_columns(const ColumnarRankingRequest& request) {
+    auto start_time = std::chrono::high_resolution_clock::now();
+    
+    const EventColumns& columns = request.columns;
+    const UserLocation& user = request.user_location;
+    
+    // Category preference as a per-request lookup table instead of string compares
+    std::vector<double> category_scores(columns.category_count,
+                                        request.preferred_category_ids.empty() ? 0.5 : 0.3);
+    for (uint32_t category : request.preferred_category_ids) {
+        category_scores[category] = 1.0;
+    }
+    
+    // Step 1: Filter by distance and score straight from the columns
+    request.deadline.check("scoring");
+    DistanceFilter distance(user, request.max_distance_km, approximate_distance_);
+    ProfileList profiles = profiles_of(request.profiles);
+    CandidateSet set;
+    set.candidates.reserve(columns.count);
+    score_rows(columns, 0, columns.count, user, distance, StartWindow(), profiles,
+               category_scores, nullptr, nullptr, nullptr, set);
+    
+    // Step 2: Select in score order, materializing only the returned rows
+    // with the distance they were scored with
+    RankingResponse response;
+    select_rankings(set, profiles, request.limit, request.deadline, [&](size_t row) {
+        Event event = columns.materialize(row);
+        distance.within_row(columns, row, event.distance_km);
+        return event;
+    }, response);
+    
+    auto end_time = std::chrono::high_resolution_clock::now();
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end_time - start_time);
+    response.processing_time_ms = duration.count() / 1000.0;
+    
+    return response;
+}
+
+RankingResponse RankingService::rank_resident(const RankingRequest& request,
+                                              const StoreView& store,
+                                              const std::string& query) {
+    auto start_time = std::chrono::high_resolution_clock::now();
+    
+    const EventColumns& columns = store.snapshot->columns();
+    const UserLocation& user = request.user_location;
+    
+    ProfileList profiles = profiles_of(request.profiles);
+    
+    // Resolve preferences once per snapshot category rather than per event
+    CategoryMask preferred(user.preferred_categories);
+    const std::vector<uint32_t>& dictionary_ids = store.snapshot->dictionary_ids();
+    std::vector<double> category_scores(columns.category_count);
+    for (size_t category = 0; category < columns.category_count; ++category) {
+        category_scores[category] = dictionary_ids[category] != CategoryDictionary::NONE
+            ? preferred.score(dictionary_ids[category])
+            : calculate_category_score(std::string(columns.category_name(static_cast<uint32_t>(category))),
+                                       user.preferred_categories);
+    }
+    
+    // BM25 statistics of every live event: the snapshot's plus the overlay's
+    // changes, with query terms expanded to close title terms of either
+    Bm25Scorer scorer(query, store.text_corpus(), &store.snapshot->vocabulary(), &store.overlay->title_terms);
+    const Bm25Scorer* text = query.empty() ? nullptr : &scorer;
+    EmbeddingQuery query_embedding(request.query_embedding);
+    const EmbeddingQuery* embedding = embedding_of(query_embedding, profiles);
+    
+    // Step 1: Score snapshot rows in grid cells that can be within range,
+    // skipping blocks that start entirely outside the window
+    request.deadline.check("scoring");
+    std::vector<EventSnapshot::RowRange> ranges;
+    store.snapshot->rows_near(user.latitude, user.longitude, request.max_distance_km, ranges);
+    store.snapshot->restrict_to_window(request.start_window, ranges);
+    DistanceFilter distance(user, request.max_distance_km, approximate_distance_);
+    CandidateSet set;
+    for (const auto& range : ranges) {
+        score_rows(columns, range.first, range.second, user, distance, request.start_window, profiles,
+                   category_scores, text, embedding, &store, set);
+    }
+    
+    // Step 2: Score recent writes, numbered after the snapshot rows
+    std::vector<const StoreEntry*> recent;
+    for (const auto& entry : store.overlay->entries) {
+        if (entry.second.deleted || !request.start_window.contains(entry.second.event.start_time)) {
+            continue;
+        }
+        Event event = entry.second.event;
+        if (store.counters) {
+            event.view_count = store.counters->views(entry.second.slot);
+            event.save_count = store.counters->saves(entry.second.slot);
+        }
+        if (!distance.within(event.latitude, event.longitude, event.distance_km)) {
+            continue;
+        }
+        double text_similarity = 0.5;
+        if (text) {
+            text_similarity = text->score(entry.second.terms.data(), entry.second.terms.size());
+            if (text_similarity <= 0.0) {
+                continue;
+            }
+        }
+        double embedding_similarity = embedding ? embedding->similarity(event.embedding) : 0.5;
+        set.candidates.emplace_back(
+            calculate_final_score(event, user, preferred, *profiles[0], text_similarity, embedding_similarity),
+            columns.count + recent.size());
+        for (size_t p = 1; p < profiles.size(); ++p) {
+            set.variant_scores.push_back(calculate_final_score(event, user, preferred, *profiles[p],
+                                                               text_similarity, embedding_similarity));
+        }
+        recent.push_back(&entry.second);
+    }
+    
+    // Step 3: Select in score order, with the live counts and the distance
+    // the rows were scored with, so explanations reproduce their scores
+    RankingResponse response;
+    select_rankings(set, profiles, request.limit, request.deadline, [&](size_t index) {
+        Event event = index < columns.count ? columns.materialize(index) : recent[index - columns.count]->event;
+        if (index < columns.count) {
+            event.view_count = store.views(index);
+            event.save_count = store.saves(index);
+        } else if (store.counters) {
+            event.view_count = store.counters->views(recent[index - columns.count]->slot);
+            event.save_count = store.counters->saves(recent[index - columns.count]->slot);
+        }
+        if (index < columns.count) {
+            distance.within_row(columns, index, event.distance_km);
+        } else {
+            distance.within(event.latitude, event.longitude, event.distance_km);
+        }
+        return event;
+    }, response);
+    if (request.explain) {
+        explain_rankings(user, profiles, text, embedding, response);
+    }
     
     auto end_time = std::chrono::high_resolution_clock::now();
     auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end_time - start_time);
@@ -0,0 +1,814 @@
+#include "request_codec.h"
+#include "category_dictionary.h"
+#include "embedding.h"
+#include "json.hpp"
+#include <cstdint>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+namespace zerocost {
+
+using json = nlohmann::json;
+
+namespace {
+
+constexpr char CONTENT_TYPE_JSON[] = "application/json";
+constexpr char CONTENT_TYPE_MSGPACK[] = "application/msgpack";
+constexpr char CONTENT_TYPE_CBOR[] = "application/cbor";
+
+bool mentions(const std::string& header, const char* media_type) {
+    return header.find(media_type) != std::string::npos;
+}
+
+// Casting a double the target can't represent is undefined, so every number
+// bound for an integer field goes through here. The negated comparison also
+// rejects NaN.
+template <typename T>
+T checked_integer(double value, const char* field, T minimum = std::numeric_limits<T>::min()) {
+    // -min is a power of two, so it is exact as a double where max may not be
+    double limit = -static_cast<double>(std::numeric_limits<T>::min());
+    if (!(value >= static_cast<double>(minimum) && value < limit)) {
+        throw DecodeError(std::string(field) + " is out of range");
+    }
+    return static_cast<T>(value);
+}
+
+// Fields recognised anywhere in a ranking request
+enum class Field {
+    Unknown,
+    UserLocation, Events, MaxDistanceKm, Limit, Query, Delete, StartAfter, StartBefore,
+    ScoringProfile, ScoringProfiles, Experiment, Explain, QueryEmbedding,
+    Latitude, Longitude, PreferredCategories,
+    Id, Title, Description, StartTime, EndTime, Category,
+    ViewCount, SaveCount, CreatedAt, Embedding
+};
+
+Field lookup_field(const std::string& key) {
+    static const std::pair<const char*, Field> FIELDS[] = {
+        {"id", Field::Id},
+        {"title", Field::Title},
+        {"description", Field::Description},
+        {"latitude", Field::Latitude},
+        {"longitude", Field::Longitude},
+        {"start_time", Field::StartTime},
+        {"end_time", Field::EndTime},
+        {"category", Field::Category},
+        {"view_count", Field::ViewCount},
+        {"save_count", Field::SaveCount},
+        {"created_at", Field::CreatedAt},
+        {"embedding", Field::Embedding},
+        {"user_location", Field::UserLocation},
+        {"events", Field::Events},
+        {"max_distance_km", Field::MaxDistanceKm},
+        {"limit", Field::Limit},
+        {"query", Field::Query},
+        {"start_after", Field::StartAfter},
+        {"start_before", Field::StartBefore},
+        {"scoring_profile", Field::ScoringProfile},
+        {"scoring_profiles", Field::ScoringProfiles},
+        {"experiment", Field::Experiment},
+        {"explain", Field::Explain},
+        {"query_embedding", Field::QueryEmbedding},
+        {"delete", Field::Delete},
+        {"preferred_categories", Field::PreferredCategories},
+    };
+    for (const auto& field : FIELDS) {
+        if (key == field.first) {
+            return field.second;
+        }
+    }
+    return Field::Unknown;
+}
+
+// Where the reader currently is in the document
+enum class Scope { Root, UserLocation, Categories, Profiles, Events, Event, Deletes, Embedding, Skip };
+
+/**
+ * SAX consumer that writes straight into a RankingRequest. Works for every
+ * format nlohmann::json can stream (JSON, MessagePack, CBOR). With a
+ * deletes list it also reads the "delete" array of an event batch.
+ *
+ * Embeddings (an event's "embedding", the request's "query_embedding") are
+ * arrays of numbers, quantized to int8 as they are read, or in the binary
+ * formats a byte string of int8 codes taken as is.
+ */
+class RankingRequestReader {
+public:
+    RankingRequestReader(RankingRequest& request, std::string* query,
+                         std::vector<std::string>* deletes = nullptr)
+        : request_(request), query_(query), deletes_(deletes), now_(std::time(nullptr)) {
+        request_.user_location.current_time = now_;
+        request_.max_distance_km = 50.0;
+        request_.limit = 100;
+    }
+
+    void finish() const {
+        if (!has_latitude_ || !has_longitude_) {
+            throw DecodeError("user_location.latitude and user_location.longitude are required");
+        }
+    }
+
+    bool null() {
+        // Null is treated as an absent field, but cannot stand for a dimension
+        return scope() != Scope::Embedding || unexpected("null");
+    }
+
+    bool boolean(bool value) {
+        if (scope() == Scope::Root && field_ == Field::Explain) {
+            request_.explain = value;
+            return true;
+        }
+        // Unknown fields are skipped whatever their type
+        return scope() == Scope::Skip || field_ == Field::Unknown || unexpected("boolean");
+    }
+
+    bool number_integer(json::number_integer_t value) {
+        return number(static_cast<double>(value));
+    }
+
+    bool number_unsigned(json::number_unsigned_t value) {
+        return number(static_cast<double>(value));
+    }
+
+    bool number_float(json::number_float_t value, const std::string&) {
+        return number(value);
+    }
+
+    bool string(std::string& value) {
+        switch (scope()) {
+            case Scope::Root:
+                if (field_ == Field::Query) {
+                    if (query_) {
+                        *query_ = std::move(value);
+                    }
+                    return true;
+                }
+                if (field_ == Field::StartAfter) {
+                    request_.start_window.after = parse_iso8601(value);
+                    return true;
+                }
+                if (field_ == Field::StartBefore) {
+                    request_.start_window.before = parse_iso8601(value);
+                    return true;
+                }
+                if (field_ == Field::ScoringProfile) {
+                    request_.scoring_profile = std::move(value);
+                    return true;
+                }
+                if (field_ == Field::Experiment) {
+                    request_.experiment = std::move(value);
+                    return true;
+                }
+                return field_ == Field::Unknown || unexpected("string");
+            case Scope::Categories:
+                request_.user_location.preferred_categories.push_back(std::move(value));
+                return true;
+            case Scope::Profiles:
+                request_.scoring_profiles.push_back(std::move(value));
+                return true;
+            case Scope::Deletes:
+                deletes_->push_back(std::move(value));
+                return true;
+            case Scope::Event:
+                return event_string(value);
+            case Scope::UserLocation:
+                return field_ == Field::Unknown || unexpected("string");
+            case Scope::Events:
+            case Scope::Embedding:
+                return unexpected("string");
+            case Scope::Skip:
+                return true;
+        }
+        return true;
+    }
+
+    bool binary(json::binary_t& value) {
+        if (std::vector<int8_t>* embedding = embedding_field()) {
+            if (value.size() > MAX_EMBEDDING_DIMENSIONS) {
+                throw DecodeError("embedding has more than " + std::to_string(MAX_EMBEDDING_DIMENSIONS) +
+                                  " dimensions");
+            }
+            embedding->assign(reinterpret_cast<const int8_t*>(value.data()),
+                              reinterpret_cast<const int8_t*>(value.data()) + value.size());
+            return true;
+        }
+        return scope() == Scope::Skip || field_ == Field::Unknown || unexpected("binary data");
+    }
+
+    bool start_object(std::size_t) {
+        if (scopes_.empty()) {
+            scopes_.push_back(Scope::Root);
+            return true;
+        }
+
+        switch (scope()) {
+            case Scope::Root:
+                if (field_ == Field::UserLocation) {
+                    scopes_.push_back(Scope::UserLocation);
+                    return true;
+                }
+                break;
+            case Scope::Events:
+                request_.events.emplace_back();
+                begin_event(request_.events.back());
+                scopes_.push_back(Scope::Event);
+                return true;
+            case Scope::Categories:
+            case Scope::Profiles:
+            case Scope::Deletes:
+            case Scope::Embedding:
+                return unexpected("object");
+            default:
+                break;
+        }
+
+        if (field_ != Field::Unknown && scope() != Scope::Skip) {
+            return unexpected("object");
+        }
+        scopes_.push_back(Scope::Skip);
+        return true;
+    }
+
+    bool key(std::string& key) {
+        field_ = scope() == Scope::Skip ? Field::Unknown : lookup_field(key);
+        if (field_ == Field::Delete && !deletes_) {
+            field_ = Field::Unknown;
+        }
+        return true;
+    }
+
+    bool end_object() {
+        if (scope() == Scope::Event) {
+            finish_event(request_.events.back());
+        }
+        scopes_.pop_back();
+        field_ = Field::Unknown;
+        return true;
+    }
+
+    bool start_array(std::size_t elements) {
+        if (scopes_.empty()) {
+            throw DecodeError("request body must be an object");
+        }
+
+        if (scope() == Scope::Root && field_ == Field::Events) {
+            if (elements != static_cast<std::size_t>(-1)) {
+                request_.events.reserve(elements);
+            }
+            request_.has_events = true;
+            scopes_.push_back(Scope::Events);
+            return true;
+        }
+        if (scope() == Scope::Root && field_ == Field::Delete) {
+            scopes_.push_back(Scope::Deletes);
+            return true;
+        }
+        if (scope() == Scope::UserLocation && field_ == Field::PreferredCategories) {
+            scopes_.push_back(Scope::Categories);
+            return true;
+        }
+        if (scope() == Scope::Root && field_ == Field::ScoringProfiles) {
+            scopes_.push_back(Scope::Profiles);
+            return true;
+        }
+        if (std::vector<int8_t>* embedding = embedding_field()) {
+            embedding_ = embedding;
+            embedding_values_.clear();
+            scopes_.push_back(Scope::Embedding);
+            return true;
+        }
+        if (scope() == Scope::Events || scope() == Scope::Categories || scope() == Scope::Profiles ||
+            scope() == Scope::Deletes || scope() == Scope::Embedding ||
+            (scope() != Scope::Skip && field_ != Field::Unknown)) {
+            return unexpected("array");
+        }
+        scopes_.push_back(Scope::Skip);
+        return true;
+    }
+
+    bool end_array() {
+        if (scope() == Scope::Embedding) {
+            try {
+                quantize_embedding(embedding_values_, *embedding_);
+            } catch (const std::invalid_argument& e) {
+                throw DecodeError(e.what());
+            }
+        }
+        scopes_.pop_back();
+        field_ = Field::Unknown;
+        return true;
+    }
+
+    bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception& error) {
+        throw DecodeError(error.what());
+    }
+
+private:
+    RankingRequest& request_;
+    std::string* query_;
+    std::vector<std::string>* deletes_;
+    std::time_t now_;
+    std::vector<Scope> scopes_;
+    Field field_ = Field::Unknown;
+    bool has_latitude_ = false;
+    bool has_longitude_ = false;
+
+    // Embedding being read and its values so far
+    std::vector<int8_t>* embedding_ = nullptr;
+    std::vector<double> embedding_values_;
+
+    // Presence of optional timestamps on the event being read
+    bool has_start_time_ = false;
+    bool has_end_time_ = false;
+    bool has_created_at_ = false;
+
+    Scope scope() const {
+        return scopes_.empty() ? Scope::Skip : scopes_.back();
+    }
+
+    bool unexpected(const char* kind) const {
+        throw DecodeError(std::string("unexpected ") + kind + " in ranking request");
+    }
+
+    // Embedding the current field holds, if it is one
+    std::vector<int8_t>* embedding_field() {
+        if (scope() == Scope::Root && field_ == Field::QueryEmbedding) {
+            return &request_.query_embedding;
+        }
+        if (scope() == Scope::Event && field_ == Field::Embedding) {
+            return &request_.events.back().embedding;
+        }
+        return nullptr;
+    }
+
+    bool number(double value) {
+        switch (scope()) {
+            case Scope::Root:
+                switch (field_) {
+                    case Field::MaxDistanceKm: request_.max_distance_km = value; return true;
+                    case Field::Limit: request_.limit = checked_integer<int>(value, "limit"); return true;
+                    case Field::StartAfter:
+                        request_.start_window.after = checked_integer<std::time_t>(value, "start_after");
+                        return true;
+                    case Field::StartBefore:
+                        request_.start_window.before = checked_integer<std::time_t>(value, "start_before");
+                        return true;
+                    case Field::Unknown: return true;
+                    default: return unexpected("number");
+                }
+            case Scope::UserLocation:
+                switch (field_) {
+                    case Field::Latitude:
+                        request_.user_location.latitude = value;
+                        has_latitude_ = true;
+                        return true;
+                    case Field::Longitude:
+                        request_.user_location.longitude = value;
+                        has_longitude_ = true;
+                        return true;
+                    case Field::Unknown: return true;
+                    default: return unexpected("number");
+                }
+            case Scope::Event:
+                return event_number(value);
+            case Scope::Embedding:
+                if (embedding_values_.size() == MAX_EMBEDDING_DIMENSIONS) {
+                    throw DecodeError("embedding has more than " + std::to_string(MAX_EMBEDDING_DIMENSIONS) +
+                                      " dimensions");
+                }
+                embedding_values_.push_back(value);
+                return true;
+            case Scope::Categories:
+            case Scope::Profiles:
+            case Scope::Events:
+            case Scope::Deletes:
+                return unexpected("number");
+            case Scope::Skip:
+                return true;
+        }
+        return true;
+    }
+
+    void begin_event(Event& event) {
+        event.latitude = 0.0;
+        event.longitude = 0.0;
+        event.view_count = 0;
+        event.save_count = 0;
+        event.distance_km = 0.0;
+        event.score = 0.0;
+        has_start_time_ = false;
+        has_end_time_ = false;
+        has_created_at_ = false;
+    }
+
+    void finish_event(Event& event) {
+        if (!has_start_time_) {
+            event.start_time = now_;
+        }
+        if (!has_end_time_) {
+            event.end_time = event.start_time + 3600; // 1 hour default
+        }
+        if (!has_created_at_) {
+            event.created_at = now_;
+        }
+    }
+
+    bool event_number(double value) {
+        Event& event = request_.events.back();
+        switch (field_) {
+            case Field::Latitude: event.latitude = value; return true;
+            case Field::Longitude: event.longitude = value; return true;
+            case Field::ViewCount: event.view_count = checked_integer<int>(value, "view_count", 0); return true;
+            case Field::SaveCount: event.save_count = checked_integer<int>(value, "save_count", 0); return true;
+            // Binary formats carry timestamps as epoch seconds
+            case Field::StartTime:
+                event.start_time = checked_integer<std::time_t>(value, "start_time");
+                has_start_time_ = true;
+                return true;
+            case Field::EndTime:
+                event.end_time = checked_integer<std::time_t>(value, "end_time");
+                has_end_time_ = true;
+                return true;
+            case Field::CreatedAt:
+                event.created_at = checked_integer<std::time_t>(value, "created_at");
+                has_created_at_ = true;
+                return true;
+            case Field::Unknown: return true;
+            default: return unexpected("number");
+        }
+    }
+
+    bool event_string(std::string& value) {
+        Event& event = request_.events.back();
+        switch (field_) {
+            case Field::Id: event.id = std::move(value); return true;
+            case Field::Title: event.title = std::move(value); return true;
+            case Field::Description: event.description = std::move(value); return true;
+            case Field::Category:
+                // Only store writes intern, so request payloads cannot grow
+                // the dictionary; unseen names fall back to string matching
+                event.category_id = CategoryDictionary::global().find(value);
+                event.category = std::move(value);
+                return true;
+            case Field::StartTime:
+                event.start_time = parse_iso8601(value);
+                has_start_time_ = true;
+                return true;
+            case Field::EndTime:
+                event.end_time = parse_iso8601(value);
+                has_end_time_ = true;
+                return true;
+            case Field::CreatedAt:
+                event.created_at = parse_iso8601(value);
+                has_created_at_ = true;
+                return true;
+            case Field::Unknown: return true;
+            default: return unexpected("string");
+        }
+    }
+};
+
+/**
+ * SAX consumer for {"interactions": [{"id", "views", "saves"}, ...]}.
+ * Kept apart from RankingRequestReader: the body is a flat list read at a
+ * much higher rate and shares none of the ranking fields.
+ */
+class InteractionReader {
+public:
+    explicit InteractionReader(std::vector<Interaction>& interactions) : interactions_(interactions) {}
+
+    bool null() { return true; }
+    bool binary(json::binary_t&) { return true; }
+
+    bool boolean(bool) {
+        return scope() != Scope::Item || !known_key() || unexpected("boolean");
+    }
+
+    bool number_integer(json::number_integer_t value) { return number(static_cast<double>(value)); }
+    bool number_unsigned(json::number_unsigned_t value) { return number(static_cast<double>(value)); }
+    bool number_float(json::number_float_t value, const std::string&) { return number(value); }
+
+    bool string(std::string& value) {
+        if (scope() == Scope::List) {
+            return unexpected("string");
+        }
+        if (scope() == Scope::Item && key_ == "id") {
+            interactions_.back().event_id = std::move(value);
+            return true;
+        }
+        return scope() != Scope::Item || !known_key() || unexpected("string");
+    }
+
+    bool start_object(std::size_t) {
+        if (scopes_.empty()) {
+            scopes_.push_back(Scope::Root);
+        } else if (scope() == Scope::List) {
+            interactions_.push_back(Interaction{std::string(), 0, 0});
+            scopes_.push_back(Scope::Item);
+        } else {
+            scopes_.push_back(Scope::Skip);
+        }
+        return true;
+    }
+
+    bool key(std::string& key) {
+        key_ = std::move(key);
+        return true;
+    }
+
+    bool end_object() {
+        if (scope() == Scope::Item && interactions_.back().event_id.empty()) {
+            throw DecodeError("every interaction needs an id");
+        }
+        scopes_.pop_back();
+        key_.clear();
+        return true;
+    }
+
+    bool start_array(std::size_t elements) {
+        if (scopes_.empty()) {
+            throw DecodeError("request body must be an object");
+        }
+        if (scope() == Scope::Root && key_ == "interactions") {
+            if (elements != static_cast<std::size_t>(-1)) {
+                interactions_.reserve(elements);
+            }
+            scopes_.push_back(Scope::List);
+            return true;
+        }
+        if (scope() == Scope::List) {
+            return unexpected("array");
+        }
+        scopes_.push_back(Scope::Skip);
+        return true;
+    }
+
+    bool end_array() {
+        scopes_.pop_back();
+        key_.clear();
+        return true;
+    }
+
+    bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception& error) {
+        throw DecodeError(error.what());
+    }
+
+private:
+    enum class Scope { Root, List, Item, Skip };
+
+    std::vector<Interaction>& interactions_;
+    std::vector<Scope> scopes_;
+    std::string key_;
+
+    Scope scope() const {
+        return scopes_.empty() ? Scope::Skip : scopes_.back();
+    }
+
+    bool known_key() const {
+        return key_ == "id" || key_ == "views" || key_ == "saves";
+    }
+
+    bool unexpected(const char* kind) const {
+        throw DecodeError(std::string("unexpected ") + kind + " in interactions");
+    }
+
+    bool number(double value) {
+        if (scope() == Scope::List) {
+            return unexpected("number");
+        }
+        if (scope() != Scope::Item || !known_key()) {
+            return true;
+        }
+        if (key_ == "id") {
+            return unexpected("number");
+        }
+        if (!(value >= 0 && value <= INT32_MAX)) {
+            throw DecodeError("interaction " + key_ + " must be between 0 and 2147483647");
+        }
+        int& count = key_ == "views" ? interactions_.back().views : interactions_.back().saves;
+        count = static_cast<int>(value);
+        return true;
+    }
+};
+
+json event_to_json(const Event& event) {
+    return json{
+        {"id", event.id},
+        {"title", event.title},
+        {"description", event.description},
+        {"latitude", event.latitude},
+        {"longitude", event.longitude},
+        {"category", event.category},
+        {"distance_km", event.distance_km},
+        {"score", event.score}
+    };
+}
+
+json explanation_to_json(const ScoreExplanation& explanation) {
+    if (!explanation.model.empty()) {
+        // A model's score is not a weighted sum; its inputs are shown bare
+        return json{
+            {"components", {
+                {"distance", explanation.distance},
+                {"urgency", explanation.urgency},
+                {"popularity", explanation.popularity},
+                {"freshness", explanation.freshness},
+                {"category", explanation.category},
+                {"text_similarity", explanation.text_similarity},
+                {"embedding_similarity", explanation.embedding_similarity}
+            }},
+            {"model", explanation.model},
+            {"score", explanation.score}
+        };
+    }
+
+    auto component = [](double value, double weight) {
+        return json{{"value", value}, {"weight", weight}};
+    };
+    return json{
+        {"components", {
+            {"distance", component(explanation.distance, explanation.weight_distance)},
+            {"urgency", component(explanation.urgency, explanation.weight_urgency)},
+            {"popularity", component(explanation.popularity, explanation.weight_popularity)},
+            {"freshness", component(explanation.freshness, explanation.weight_freshness)},
+            {"category", component(explanation.category, explanation.weight_category)},
+            {"text_similarity", component(explanation.text_similarity, explanation.weight_text_similarity)},
+            {"embedding_similarity", component(explanation.embedding_similarity, explanation.weight_embedding)}
+        }},
+        {"boost", explanation.boost},
+        {"score", explanation.score}
+    };
+}
+
+/**
+ * ranked_events as JSON, each with its explanation when there are any.
+ */
+json ranked_events_to_json(const std::vector<Event>& events, const std::vector<ScoreExplanation>& explanations) {
+    json array = json::array();
+    for (size_t i = 0; i < events.size(); ++i) {
+        json event = event_to_json(events[i]);
+        if (i < explanations.size()) {
+            event["explanation"] = explanation_to_json(explanations[i]);
+        }
+        array.push_back(std::move(event));
+    }
+    return array;
+}
+
+std::string encode(const json& document, WireFormat format) {
+    std::string out;
+    switch (format) {
+        case WireFormat::MsgPack:
+            json::to_msgpack(document, out);
+            break;
+        case WireFormat::Cbor:
+            json::to_cbor(document, out);
+            break;
+        case WireFormat::Json:
+            out = document.dump();
+            break;
+    }
+    return out;
+}
+
+nlohmann::detail::input_format_t input_format_for(WireFormat format) {
+    switch (format) {
+        case WireFormat::MsgPack: return nlohmann::detail::input_format_t::msgpack;
+        case WireFormat::Cbor: return nlohmann::detail::input_format_t::cbor;
+        case WireFormat::Json: break;
+    }
+    return nlohmann::detail::input_format_t::json;
+}
+
+} // namespace
+
+WireFormat wire_format_from_content_type(const std::string& content_type) {
+    if (mentions(content_type, CONTENT_TYPE_MSGPACK) || mentions(content_type, "application/x-msgpack")) {
+        return WireFormat::MsgPack;
+    }
+    if (mentions(content_type, CONTENT_TYPE_CBOR)) {
+        return WireFormat::Cbor;
+    }
+    return WireFormat::Json;
+}
+
+WireFormat negotiate_response_format(const std::string& accept, WireFormat request_format) {
+    if (mentions(accept, CONTENT_TYPE_MSGPACK) || mentions(accept, "application/x-msgpack")) {
+        return WireFormat::MsgPack;
+    }
+    if (mentions(accept, CONTENT_TYPE_CBOR)) {
+        return WireFormat::Cbor;
+    }
+    if (mentions(accept, CONTENT_TYPE_JSON)) {
+        return WireFormat::Json;
+    }
+    return request_format;
+}
+
+const char* content_type_for(WireFormat format) {
+    switch (format) {
+        case WireFormat::MsgPack: return CONTENT_TYPE_MSGPACK;
+        case WireFormat::Cbor: return CONTENT_TYPE_CBOR;
+        case WireFormat::Json: break;
+    }
+    return CONTENT_TYPE_JSON;
+}
+
+const char* wire_format_name(WireFormat format) {
+    switch (format) {
+        case WireFormat::MsgPack: return "MessagePack";
+        case WireFormat::Cbor: return "CBOR";
+        case WireFormat::Json: break;
+    }
+    return "JSON";
+}
+
+std::time_t parse_iso8601(const std::string& datetime) {
+    std::tm tm = {};
+    std::istringstream ss(datetime);
+    ss >> std::get_time(&tm, "%Y-%m-%dT%H:%M:%S");
+    return std::mktime(&tm);
+}
+
+RankingRequest decode_ranking_request(const std::string& body,
+                                      WireFormat format,
+                                      std::string* query) {
+    RankingRequest request;
+    RankingRequestReader reader(request, query);
+    json::sax_parse(body.begin(), body.end(), &reader, input_format_for(format));
+    reader.finish();
+    return request;
+}
+
+EventBatch decode_event_batch(const std::string& body, WireFormat format) {
+    RankingRequest request;
+    EventBatch batch;
+    RankingRequestReader reader(request, nullptr, &batch.deletes);
+    json::sax_parse(body.begin(), body.end(), &reader, input_format_for(format));
+
+    for (const auto& event : request.events) {
+        if (event.id.empty()) {
+            throw DecodeError("every event needs an id");
+        }
+    }
+    batch.upserts = std::move(request.events);
+    return batch;
+}
+
+std::vector<Interaction> decode_interactions(const std::string& body, WireFormat format) {
+    std::vector<Interaction> interactions;
+    InteractionReader reader(interactions);
+    json::sax_parse(body.begin(), body.end(), &reader, input_format_for(format));
+    return interactions;
+}
+
+std::string encode_ranking_response(const RankingResponse& response,
+                                    WireFormat format,
+                                    const std::string* query) {
+    json response_json;
+    if (query) {
+        response_json["query"] = *query;
+    }
+    response_json["total_count"] = response.total_count;
+    response_json["processing_time_ms"] = response.processing_time_ms;
+    response_json["ranked_events"] = ranked_events_to_json(response.ranked_events, response.explanations);
+
+    if (!response.variants.empty()) {
+        json variants = json::array();
+        for (const auto& variant : response.variants) {
+            variants.push_back(json{{"profile", variant.profile},
+                                    {"ranked_events", ranked_events_to_json(variant.ranked_events, variant.explanations)}});
+        }
+        response_json["variants"] = std::move(variants);
+    }
+
+    return encode(response_json, format);
+}
+
+std::string encode_event_batch_result(size_t upserted, size_t deleted, size_t event_count, WireFormat format) {
+    return encode(json{{"upserted", upserted}, {"deleted", deleted}, {"event_count", event_count}}, format);
+}
+
+std::string encode_interaction_result(size_t received, size_t applied, WireFormat format) {
+    return encode(json{{"received", received}, {"applied", applied}}, format);
+}
+
+std::string encode_suggestions(const std::string& query, const std::vector<Suggestion>& suggestions,
+                               double processing_time_ms, WireFormat format) {
+    json items = json::array();
+    for (const Suggestion& suggestion : suggestions) {
+        items.push_back(json{{"text", suggestion.text},
+                             {"kind", suggestion.kind == SuggestionKind::Category ? "category" : "term"},
+                             {"weight", suggestion.weight}});
+    }
+    return encode(json{{"query", query}, {"suggestions", items}, {"processing_time_ms", processing_time_ms}}, format);
+}
+
+std::string encode_error(const std::string& error, const std::string& message, WireFormat format) {
+    return encode(json{{"error", error}, {"message", message}}, format);
+}
+
+} // namespace zerocost
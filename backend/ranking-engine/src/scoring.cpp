@@ -1,16 +1,28 @@
 #include "scoring.h"
 #include "distance.h"
+#include "fast_math.h"
+#include "tree_ensemble.h"
 #include <cmath>
 #include <algorithm>
+#include <array>
 #include <sstream>
 #include <cctype>
+#include <cstring>
 #include <set>
+#include <utility>
 
 namespace zerocost {
 
 constexpr double SECONDS_PER_HOUR = 3600.0;
 constexpr double SECONDS_PER_DAY = 86400.0;
 
+// Batch kernels get AVX-512 and AVX2 clones, picked by the loader on first call
+#if defined(__GNUC__) && defined(__x86_64__) && defined(__linux__)
+#define ZEROCOST_TARGET_CLONES __attribute__((target_clones("arch=x86-64-v4", "arch=x86-64-v3", "default")))
+#else
+#define ZEROCOST_TARGET_CLONES
+#endif
+
 std::string to_lowercase(const std::string& str) {
     std::string result = str;
     std::transform(result.begin(), result.end(), result.begin(), ::tolower);
@@ -33,34 +45,72 @@ std::set<std::string> tokenize(const std::string& text) {
     return tokens;
 }
 
-double calculate_urgency_score(std::time_t start_time, std::time_t current_time) {
-    double time_diff_seconds = std::difftime(start_time, current_time);
-    
-    // Event already started or in the past
-    if (time_diff_seconds <= 0) {
-        return 0.5; // Medium urgency for ongoing events
-    }
-    
-    double time_diff_hours = time_diff_seconds / SECONDS_PER_HOUR;
-    
-    // Events within 2 hours: very urgent
-    if (time_diff_hours < 2.0) {
-        return 1.0;
-    }
-    
-    // Events within 24 hours: high urgency
-    if (time_diff_hours < 24.0) {
-        return 0.8 - (time_diff_hours - 2.0) / 22.0 * 0.3; // 0.8 to 0.5
-    }
+namespace {
+
+/*
+ * The urgency and freshness curves are written as selects over every
+ * segment instead of early returns, so loops over them have no branches
+ * and vectorize. Segments are lines in seconds with precomputed slopes
+ * (a multiply where the original divided twice); they agree with the
+ * original hour/day formulas to within a few ulps. This file is built with
+ * -ffp-contract=off so the scalar functions and the AVX clones give
+ * identical results.
+ */
+constexpr double URGENCY_DAY_SLOPE = 0.3 / (22.0 * SECONDS_PER_HOUR);    // 0.8 to 0.5 over 2h..24h
+constexpr double URGENCY_WEEK_SLOPE = 0.3 / (6.0 * SECONDS_PER_DAY);     // 0.5 to 0.2 over 1d..7d
+constexpr double FRESHNESS_DAY_SLOPE = 0.4 / (23.0 * SECONDS_PER_HOUR);  // 0.9 to 0.5 over 1h..24h
+constexpr double FRESHNESS_WEEK_SLOPE = 0.3 / (6.0 * SECONDS_PER_DAY);   // 0.5 to 0.2 over 1d..7d
+
+inline double urgency_curve(double seconds_until_start) {
+    double within_day = 0.8 - (seconds_until_start - 2.0 * SECONDS_PER_HOUR) * URGENCY_DAY_SLOPE;
+    double within_week = 0.5 - (seconds_until_start - SECONDS_PER_DAY) * URGENCY_WEEK_SLOPE;
+    
+    double score = seconds_until_start < 7.0 * SECONDS_PER_DAY ? within_week : 0.2;
+    score = seconds_until_start < SECONDS_PER_DAY ? within_day : score;
+    score = seconds_until_start < 2.0 * SECONDS_PER_HOUR ? 1.0 : score;
+    return seconds_until_start <= 0.0 ? 0.5 : score;  // Medium urgency for ongoing events
+}
+
+inline double freshness_curve(double age_seconds) {
+    double within_day = 0.9 - (age_seconds - SECONDS_PER_HOUR) * FRESHNESS_DAY_SLOPE;
+    double within_week = 0.5 - (age_seconds - SECONDS_PER_DAY) * FRESHNESS_WEEK_SLOPE;
     
-    // Events within 7 days: medium urgency
-    double time_diff_days = time_diff_seconds / SECONDS_PER_DAY;
-    if (time_diff_days < 7.0) {
-        return 0.5 - (time_diff_days - 1.0) / 6.0 * 0.3; // 0.5 to 0.2
+    double score = age_seconds < 7.0 * SECONDS_PER_DAY ? within_week : 0.2;
+    score = age_seconds < SECONDS_PER_DAY ? within_day : score;
+    return age_seconds < SECONDS_PER_HOUR ? 1.0 : score;
+}
+
+// Timestamps are clamped to +-2^49 s (about 17 million years) so their
+// difference stays inside the range where the conversion below is exact
+constexpr int64_t MAX_TIMESTAMP = int64_t(1) << 49;
+
+/*
+ * (to - from) in seconds as a double. Converts through the 2^52 + 2^51
+ * exponent trick rather than cvtsi2sd, which has no vector form before
+ * AVX-512DQ.
+ */
+inline double seconds_between(int64_t from, int64_t to) {
+    from = std::min(std::max(from, -MAX_TIMESTAMP), MAX_TIMESTAMP);
+    to = std::min(std::max(to, -MAX_TIMESTAMP), MAX_TIMESTAMP);
+    int64_t bits = (to - from) + 0x4338000000000000;
+    double value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value - 6755399441055744.0;  // 2^52 + 2^51
+}
+
+} // namespace
+
+double calculate_urgency_score(std::time_t start_time, std::time_t current_time) {
+    return urgency_curve(seconds_between(current_time, start_time));
+}
+
+ZEROCOST_TARGET_CLONES
+void calculate_urgency_scores(const int64_t* start_times, size_t count,
+                              std::time_t current_time, double* scores) {
+    int64_t now = static_cast<int64_t>(current_time);
+    for (size_t i = 0; i < count; ++i) {
+        scores[i] = urgency_curve(seconds_between(now, start_times[i]));
     }
-    
-    // Events beyond 7 days: low urgency
-    return 0.2;
 }
 
 double calculate_popularity_score(int view_count, int save_count) {
@@ -80,27 +130,16 @@ double calculate_popularity_score(int view_count, int save_count) {
 }
 
 double calculate_freshness_score(std::time_t created_at, std::time_t current_time) {
-    double age_seconds = std::difftime(current_time, created_at);
-    double age_hours = age_seconds / SECONDS_PER_HOUR;
-    
-    // Events created within 1 hour: maximum freshness
-    if (age_hours < 1.0) {
-        return 1.0;
-    }
-    
-    // Events created within 24 hours: high freshness
-    if (age_hours < 24.0) {
-        return 0.9 - (age_hours - 1.0) / 23.0 * 0.4; // 0.9 to 0.5
-    }
-    
-    // Events created within 7 days: medium freshness
-    double age_days = age_seconds / SECONDS_PER_DAY;
-    if (age_days < 7.0) {
-        return 0.5 - (age_days - 1.0) / 6.0 * 0.3; // 0.5 to 0.2
+    return freshness_curve(seconds_between(created_at, current_time));
+}
+
+ZEROCOST_TARGET_CLONES
+void calculate_freshness_scores(const int64_t* created_at, size_t count,
+                                std::time_t current_time, double* scores) {
+    int64_t now = static_cast<int64_t>(current_time);
+    for (size_t i = 0; i < count; ++i) {
+        scores[i] = freshness_curve(seconds_between(created_at[i], now));
     }
-    
-    // Older events: low freshness
-    return 0.2;
 }
 
 double calculate_text_similarity(const std::string& query, const std::string& text) {
@@ -153,47 +192,319 @@ double calculate_category_score(const std::string& event_category,
     return 0.3; // Lower score for non-preferred categories
 }
 
-double calculate_final_score(const Event& event, 
-                             const UserLocation& user_location,
-                             const std::string& query) {
-    // Weight factors for different components
-    constexpr double WEIGHT_DISTANCE = 0.30;
-    constexpr double WEIGHT_URGENCY = 0.25;
-    constexpr double WEIGHT_POPULARITY = 0.15;
-    constexpr double WEIGHT_FRESHNESS = 0.15;
-    constexpr double WEIGHT_CATEGORY = 0.10;
-    constexpr double WEIGHT_TEXT_SIMILARITY = 0.05;
-    
-    // Calculate individual scores
-    double distance_score = calculate_distance_score(event.distance_km, 50.0);
-    double urgency_score = calculate_urgency_score(event.start_time, user_location.current_time);
-    double popularity_score = calculate_popularity_score(event.view_count, event.save_count);
-    double freshness_score = calculate_freshness_score(event.created_at, user_location.current_time);
-    double category_score = calculate_category_score(event.category, user_location.preferred_categories);
-    
-    double text_similarity = 0.5;
-    if (!query.empty()) {
-        std::string event_text = event.title + " " + event.description;
-        text_similarity = calculate_text_similarity(query, event_text);
-    }
-    
+double combine_component_scores(double distance_km,
+                                double distance_score,
+                                double urgency_score,
+                                double popularity_score,
+                                double freshness_score,
+                                double category_score,
+                                double text_similarity,
+                                double embedding_similarity,
+                                const ScoringProfile& profile) {
     // Weighted sum
     double final_score = 
-        WEIGHT_DISTANCE * distance_score +
-        WEIGHT_URGENCY * urgency_score +
-        WEIGHT_POPULARITY * popularity_score +
-        WEIGHT_FRESHNESS * freshness_score +
-        WEIGHT_CATEGORY * category_score +
-        WEIGHT_TEXT_SIMILARITY * text_similarity;
+        profile.weight_distance * distance_score +
+        profile.weight_urgency * urgency_score +
+        profile.weight_popularity * popularity_score +
+        profile.weight_freshness * freshness_score +
+        profile.weight_category * category_score +
+        profile.weight_text_similarity * text_similarity +
+        profile.weight_embedding * embedding_similarity;
     
     // Boost very close events
-    if (event.distance_km < 1.0) {
-        final_score *= 1.2;
+    if (distance_km < profile.boost_radius_km) {
+        final_score *= profile.boost_factor;
     }
     
     return std::min(final_score, 1.0);
 }
 
+double calculate_final_score(const Event& event, 
+                             const UserLocation& user_location,
+                             const std::string& query) {
+    double text_similarity = query.empty()
+        ? 0.5
+        : calculate_text_similarity(query, event.title + " " + event.description);
+    return calculate_final_score(event, user_location, CategoryMask(user_location.preferred_categories),
+                                 ScoringProfile(), text_similarity);
+}
+
+namespace {
+
+// Terms a final score kernel computes; category and text are plain loads
+// and always included
+constexpr unsigned DISTANCE_COMPONENT = 1;
+constexpr unsigned URGENCY_COMPONENT = 2;
+constexpr unsigned POPULARITY_COMPONENT = 4;
+constexpr unsigned FRESHNESS_COMPONENT = 8;
+constexpr unsigned ALL_COMPONENTS = 15;
+
+/*
+ * Final scores with the terms in Components only. Skipping a term whose
+ * weight is zero drops a "+ 0.0" from the sum, so every instantiation gives
+ * the same result as the generic (ALL_COMPONENTS) one.
+ */
+template <unsigned Components>
+ZEROCOST_TARGET_CLONES
+void final_scores_kernel(const ScoreColumns& columns, size_t count, std::time_t current_time,
+                         const ScoringProfile& profile, double* scores) {
+    // Locals, so stores to scores cannot alias the profile inside the loop
+    const double weight_distance = profile.weight_distance;
+    const double weight_urgency = profile.weight_urgency;
+    const double weight_popularity = profile.weight_popularity;
+    const double weight_freshness = profile.weight_freshness;
+    const double weight_category = profile.weight_category;
+    const double weight_text_similarity = profile.weight_text_similarity;
+    const double weight_embedding = profile.weight_embedding;
+    const double distance_scale_km = profile.distance_scale_km;
+    const double boost_radius_km = profile.boost_radius_km;
+    const double boost_factor = profile.boost_factor;
+    const double inverse_log_popularity = 1.0 / std::log(profile.popularity_scale + 1.0);
+    
+    int64_t now = static_cast<int64_t>(current_time);
+    for (size_t i = 0; i < count; ++i) {
+        double distance_km = columns.distance_km[i];
+        double final_score = 0.0;
+        
+        if constexpr ((Components & DISTANCE_COMPONENT) != 0) {
+            double distance_score = distance_km >= distance_scale_km
+                ? 0.0
+                : fast_exp(-3.0 * (distance_km / distance_scale_km));
+            final_score += weight_distance * distance_score;
+        }
+        if constexpr ((Components & URGENCY_COMPONENT) != 0) {
+            final_score += weight_urgency * urgency_curve(seconds_between(now, columns.start_time[i]));
+        }
+        if constexpr ((Components & POPULARITY_COMPONENT) != 0) {
+            // Saves weigh 3x views; log(1) = 0 covers the no-engagement case
+            double engagement = static_cast<double>(columns.view_count[i]) +
+                                static_cast<double>(columns.save_count[i]) * 3.0;
+            engagement = std::max(engagement, 0.0);
+            final_score += weight_popularity * std::min(fast_log(engagement + 1.0) * inverse_log_popularity, 1.0);
+        }
+        if constexpr ((Components & FRESHNESS_COMPONENT) != 0) {
+            final_score += weight_freshness * freshness_curve(seconds_between(columns.created_at[i], now));
+        }
+        final_score += weight_category * columns.category_score[i];
+        final_score += weight_text_similarity * columns.text_similarity[i];
+        final_score += weight_embedding * columns.embedding_similarity[i];
+        
+        // Boost very close events
+        final_score = distance_km < boost_radius_km ? final_score * boost_factor : final_score;
+        scores[i] = std::min(final_score, 1.0);
+    }
+}
+
+using FinalScoresKernel = void (*)(const ScoreColumns&, size_t, std::time_t, const ScoringProfile&, double*);
+
+template <unsigned... Components>
+constexpr std::array<FinalScoresKernel, sizeof...(Components)>
+make_final_scores_kernels(std::integer_sequence<unsigned, Components...>) {
+    return {{&final_scores_kernel<Components>...}};
+}
+
+// Indexed by component set
+const std::array<FinalScoresKernel, ALL_COMPONENTS + 1> FINAL_SCORES_KERNELS =
+    make_final_scores_kernels(std::make_integer_sequence<unsigned, ALL_COMPONENTS + 1>());
+
+unsigned components_of(const ScoringProfile& profile) {
+    return (profile.weight_distance != 0.0 ? DISTANCE_COMPONENT : 0) |
+           (profile.weight_urgency != 0.0 ? URGENCY_COMPONENT : 0) |
+           (profile.weight_popularity != 0.0 ? POPULARITY_COMPONENT : 0) |
+           (profile.weight_freshness != 0.0 ? FRESHNESS_COMPONENT : 0);
+}
+
+// Model inputs are gathered per block of this many events, on the stack
+constexpr size_t MODEL_BLOCK = 256;
+
+void model_scores(const ScoreColumns& columns, const ComponentScores& components, size_t count,
+                  const TreeEnsemble& model, double* scores) {
+    double view_count[MODEL_BLOCK];
+    double save_count[MODEL_BLOCK];
+    for (size_t begin = 0; begin < count; begin += MODEL_BLOCK) {
+        size_t block = std::min(MODEL_BLOCK, count - begin);
+        for (size_t i = 0; i < block; ++i) {
+            view_count[i] = static_cast<double>(columns.view_count[begin + i]);
+            save_count[i] = static_cast<double>(columns.save_count[begin + i]);
+        }
+        
+        ModelFeatures features;
+        features[static_cast<size_t>(ModelFeature::DistanceKm)] = columns.distance_km + begin;
+        features[static_cast<size_t>(ModelFeature::Distance)] = components.distance + begin;
+        features[static_cast<size_t>(ModelFeature::Urgency)] = components.urgency + begin;
+        features[static_cast<size_t>(ModelFeature::Popularity)] = components.popularity + begin;
+        features[static_cast<size_t>(ModelFeature::Freshness)] = components.freshness + begin;
+        features[static_cast<size_t>(ModelFeature::Category)] = columns.category_score + begin;
+        features[static_cast<size_t>(ModelFeature::TextSimilarity)] = columns.text_similarity + begin;
+        features[static_cast<size_t>(ModelFeature::ViewCount)] = view_count;
+        features[static_cast<size_t>(ModelFeature::SaveCount)] = save_count;
+        features[static_cast<size_t>(ModelFeature::EmbeddingSimilarity)] = columns.embedding_similarity + begin;
+        model.predict(features, block, scores + begin);
+    }
+}
+
+} // namespace
+
+void calculate_final_scores(const ScoreColumns& columns, size_t count,
+                            std::time_t current_time, const ScoringProfile& profile,
+                            double* scores) {
+    if (!profile.model) {
+        FINAL_SCORES_KERNELS[components_of(profile)](columns, count, current_time, profile, scores);
+        return;
+    }
+    
+    double distance[MODEL_BLOCK];
+    double urgency[MODEL_BLOCK];
+    double popularity[MODEL_BLOCK];
+    double freshness[MODEL_BLOCK];
+    ComponentScores components{distance, urgency, popularity, freshness};
+    for (size_t begin = 0; begin < count; begin += MODEL_BLOCK) {
+        size_t block = std::min(MODEL_BLOCK, count - begin);
+        ScoreColumns window{columns.distance_km + begin, columns.start_time + begin, columns.created_at + begin,
+                            columns.view_count + begin, columns.save_count + begin,
+                            columns.category_score + begin, columns.text_similarity + begin,
+                            columns.embedding_similarity + begin};
+        calculate_component_scores(window, block, current_time, profile, components);
+        model_scores(window, components, block, *profile.model, scores + begin);
+    }
+}
+
+ZEROCOST_TARGET_CLONES
+void calculate_component_scores(const ScoreColumns& columns, size_t count,
+                                std::time_t current_time, const ScoringProfile& profile,
+                                const ComponentScores& components) {
+    const double distance_scale_km = profile.distance_scale_km;
+    const double inverse_log_popularity = 1.0 / std::log(profile.popularity_scale + 1.0);
+    
+    int64_t now = static_cast<int64_t>(current_time);
+    for (size_t i = 0; i < count; ++i) {
+        double distance_km = columns.distance_km[i];
+        components.distance[i] = distance_km >= distance_scale_km
+            ? 0.0
+            : fast_exp(-3.0 * (distance_km / distance_scale_km));
+        components.urgency[i] = urgency_curve(seconds_between(now, columns.start_time[i]));
+        
+        double engagement = static_cast<double>(columns.view_count[i]) +
+                            static_cast<double>(columns.save_count[i]) * 3.0;
+        engagement = std::max(engagement, 0.0);
+        components.popularity[i] = std::min(fast_log(engagement + 1.0) * inverse_log_popularity, 1.0);
+        components.freshness[i] = freshness_curve(seconds_between(columns.created_at[i], now));
+    }
+}
+
+bool same_component_shape(const ScoringProfile& a, const ScoringProfile& b) {
+    return a.distance_scale_km == b.distance_scale_km && a.popularity_scale == b.popularity_scale;
+}
+
+namespace {
+
+ZEROCOST_TARGET_CLONES
+void weighted_scores_kernel(const ScoreColumns& columns, const ComponentScores& components,
+                            size_t count, const ScoringProfile& profile, double* scores) {
+    const double weight_distance = profile.weight_distance;
+    const double weight_urgency = profile.weight_urgency;
+    const double weight_popularity = profile.weight_popularity;
+    const double weight_freshness = profile.weight_freshness;
+    const double weight_category = profile.weight_category;
+    const double weight_text_similarity = profile.weight_text_similarity;
+    const double weight_embedding = profile.weight_embedding;
+    const double boost_radius_km = profile.boost_radius_km;
+    const double boost_factor = profile.boost_factor;
+    
+    // Same summation order as final_scores_kernel, so results are identical
+    for (size_t i = 0; i < count; ++i) {
+        double final_score = 0.0;
+        final_score += weight_distance * components.distance[i];
+        final_score += weight_urgency * components.urgency[i];
+        final_score += weight_popularity * components.popularity[i];
+        final_score += weight_freshness * components.freshness[i];
+        final_score += weight_category * columns.category_score[i];
+        final_score += weight_text_similarity * columns.text_similarity[i];
+        final_score += weight_embedding * columns.embedding_similarity[i];
+        
+        final_score = columns.distance_km[i] < boost_radius_km ? final_score * boost_factor : final_score;
+        scores[i] = std::min(final_score, 1.0);
+    }
+}
+
+} // namespace
+
+void combine_component_scores(const ScoreColumns& columns, const ComponentScores& components,
+                              size_t count, const ScoringProfile& profile, double* scores) {
+    if (profile.model) {
+        model_scores(columns, components, count, *profile.model, scores);
+    } else {
+        weighted_scores_kernel(columns, components, count, profile, scores);
+    }
+}
+
+namespace {
+
+double resolve_category_score(const Event& event, const UserLocation& user_location,
+                              const CategoryMask& preferred) {
+    return event.category_id != CategoryDictionary::NONE
+        ? preferred.score(event.category_id)
+        : calculate_category_score(event.category, user_location.preferred_categories);
+}
+
+} // namespace
+
+double calculate_final_score(const Event& event, 
+                             const UserLocation& user_location,
+                             const CategoryMask& preferred,
+                             const ScoringProfile& profile,
+                             double text_similarity,
+                             double embedding_similarity) {
+    double category_score = resolve_category_score(event, user_location, preferred);
+    
+    // A block of one, so single events score exactly like batched ones
+    int64_t start_time = event.start_time;
+    int64_t created_at = event.created_at;
+    ScoreColumns columns{&event.distance_km, &start_time, &created_at, &event.view_count,
+                         &event.save_count, &category_score, &text_similarity, &embedding_similarity};
+    double score;
+    calculate_final_scores(columns, 1, user_location.current_time, profile, &score);
+    return score;
+}
+
+ScoreExplanation explain_final_score(const Event& event,
+                                     const UserLocation& user_location,
+                                     const CategoryMask& preferred,
+                                     const ScoringProfile& profile,
+                                     double text_similarity,
+                                     double embedding_similarity) {
+    ScoreExplanation explanation{};
+    explanation.category = resolve_category_score(event, user_location, preferred);
+    explanation.text_similarity = text_similarity;
+    explanation.embedding_similarity = embedding_similarity;
+    
+    // The batch kernels on a block of one, so the breakdown adds up to
+    // exactly what ranking computes
+    int64_t start_time = event.start_time;
+    int64_t created_at = event.created_at;
+    ScoreColumns columns{&event.distance_km, &start_time, &created_at, &event.view_count,
+                         &event.save_count, &explanation.category, &explanation.text_similarity,
+                         &explanation.embedding_similarity};
+    ComponentScores components{&explanation.distance, &explanation.urgency,
+                               &explanation.popularity, &explanation.freshness};
+    calculate_component_scores(columns, 1, user_location.current_time, profile, components);
+    combine_component_scores(columns, components, 1, profile, &explanation.score);
+    if (profile.model) {
+        explanation.model = profile.model->name();
+        return explanation;
+    }
+    
+    explanation.weight_distance = profile.weight_distance;
+    explanation.weight_urgency = profile.weight_urgency;
+    explanation.weight_popularity = profile.weight_popularity;
+    explanation.weight_freshness = profile.weight_freshness;
+    explanation.weight_category = profile.weight_category;
+    explanation.weight_text_similarity = profile.weight_text_similarity;
+    explanation.weight_embedding = profile.weight_embedding;
+    explanation.boost = event.distance_km < profile.boost_radius_km ? profile.boost_factor : 1.0;
+    return explanation;
+}
+
 bool are_events_duplicate(const Event& event1, const Event& event2) {
     // Check location similarity (within 100 meters)
     double distance = haversine_distance(event1.latitude, event1.longitude,
@@ -0,0 +1,300 @@
+#include "scoring_profiles.h"
+#include "json.hpp"
+#include "tree_ensemble.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+#include <sys/stat.h>
+
+namespace zerocost {
+
+namespace {
+
+using json = nlohmann::json;
+
+double profile_number(const json& value, const std::string& profile, const std::string& key,
+                      double minimum, bool exclusive) {
+    if (!value.is_number()) {
+        throw std::runtime_error("scoring profile " + profile + ": " + key + " must be a number");
+    }
+    double number = value.get<double>();
+    if (!std::isfinite(number) || number < minimum || (exclusive && number == minimum)) {
+        throw std::runtime_error("scoring profile " + profile + ": " + key + " out of range");
+    }
+    return number;
+}
+
+/**
+ * Stat a file the profile set depends on and append it to files, to notice
+ * when it changes. A missing file is appended too (size -1), so that
+ * creating it triggers a reload, before this throws.
+ */
+void watch_file(const std::string& path, std::vector<ScoringProfiles::WatchedFile>& files) {
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0) {
+        files.push_back(ScoringProfiles::WatchedFile{path, timespec{}, -1});
+        throw std::runtime_error("cannot stat " + path);
+    }
+    files.push_back(ScoringProfiles::WatchedFile{path, info.st_mtim, info.st_size});
+}
+
+/**
+ * @param directory Directory of the profile file; relative model paths are
+ *        resolved against it
+ * @param files Model files read are appended, to be watched for changes
+ *        (including one that failed to load)
+ */
+ScoringProfile parse_profile(const std::string& name, const json& body, const std::string& directory,
+                             std::vector<ScoringProfiles::WatchedFile>& files) {
+    if (!body.is_object()) {
+        throw std::runtime_error("scoring profile " + name + " must be an object");
+    }
+
+    ScoringProfile profile;
+    profile.name = name;
+    for (const auto& item : body.items()) {
+        const std::string& key = item.key();
+        if (key == "weights") {
+            if (!item.value().is_object()) {
+                throw std::runtime_error("scoring profile " + name + ": weights must be an object");
+            }
+            for (const auto& weight : item.value().items()) {
+                double value = profile_number(weight.value(), name, "weights." + weight.key(), 0.0, false);
+                if (weight.key() == "distance") {
+                    profile.weight_distance = value;
+                } else if (weight.key() == "urgency") {
+                    profile.weight_urgency = value;
+                } else if (weight.key() == "popularity") {
+                    profile.weight_popularity = value;
+                } else if (weight.key() == "freshness") {
+                    profile.weight_freshness = value;
+                } else if (weight.key() == "category") {
+                    profile.weight_category = value;
+                } else if (weight.key() == "text") {
+                    profile.weight_text_similarity = value;
+                } else if (weight.key() == "embedding") {
+                    profile.weight_embedding = value;
+                } else {
+                    throw std::runtime_error("scoring profile " + name + ": unknown weight " + weight.key());
+                }
+            }
+        } else if (key == "distance_scale_km") {
+            profile.distance_scale_km = profile_number(item.value(), name, key, 0.0, true);
+        } else if (key == "boost_radius_km") {
+            profile.boost_radius_km = profile_number(item.value(), name, key, 0.0, false);
+        } else if (key == "boost_factor") {
+            profile.boost_factor = profile_number(item.value(), name, key, 0.0, false);
+        } else if (key == "popularity_scale") {
+            profile.popularity_scale = profile_number(item.value(), name, key, 0.0, true);
+        } else if (key == "model") {
+            if (!item.value().is_string() || item.value().get<std::string>().empty()) {
+                throw std::runtime_error("scoring profile " + name + ": model must be a file path");
+            }
+            std::string path = item.value().get<std::string>();
+            if (path[0] != '/' && !directory.empty()) {
+                path = directory + "/" + path;
+            }
+            // Stat before reading, as for the profile file itself
+            watch_file(path, files);
+            profile.model = TreeEnsemble::load(path);
+        } else {
+            // Unknown keys are rejected so a typo does not silently rank with defaults
+            throw std::runtime_error("scoring profile " + name + ": unknown key " + key);
+        }
+    }
+    return profile;
+}
+
+} // namespace
+
+ScoringProfiles::ScoringProfiles(std::string path) : path_(std::move(path)) {
+    auto profiles = std::make_shared<ProfileSet>();
+    profiles->profiles["default"] = std::make_shared<const ScoringProfile>();
+    profiles_ = std::move(profiles);
+}
+
+ScoringProfiles::~ScoringProfiles() {
+    stop();
+}
+
+void ScoringProfiles::load() {
+    std::vector<WatchedFile> files;
+    load(files);
+}
+
+void ScoringProfiles::load(std::vector<WatchedFile>& files) {
+    if (path_.empty()) {
+        return;
+    }
+
+    // Stat before reading: a write that lands in between is picked up again
+    // on the next check rather than missed
+    watch_file(path_, files);
+    std::ifstream file(path_);
+    if (!file) {
+        throw std::runtime_error("cannot open " + path_);
+    }
+    std::stringstream contents;
+    contents << file.rdbuf();
+
+    json document;
+    try {
+        document = json::parse(contents.str());
+    } catch (const json::exception& e) {
+        throw std::runtime_error(path_ + ": " + e.what());
+    }
+    if (!document.is_object() || !document.contains("profiles") || !document["profiles"].is_object()) {
+        throw std::runtime_error(path_ + ": expected an object with a \"profiles\" object");
+    }
+
+    size_t slash = path_.find_last_of('/');
+    std::string directory = slash == std::string::npos ? "" : path_.substr(0, slash);
+
+    auto profiles = std::make_shared<ProfileSet>();
+    profiles->profiles["default"] = std::make_shared<const ScoringProfile>();
+    for (const auto& item : document["profiles"].items()) {
+        profiles->profiles[item.key()] =
+            std::make_shared<const ScoringProfile>(parse_profile(item.key(), item.value(), directory, files));
+    }
+
+    if (document.contains("experiments")) {
+        const json& experiments = document["experiments"];
+        if (!experiments.is_object()) {
+            throw std::runtime_error(path_ + ": experiments must be an object");
+        }
+        for (const auto& item : experiments.items()) {
+            if (!item.value().is_array() || item.value().empty() || item.value().size() > MAX_VARIANTS) {
+                throw std::runtime_error("experiment " + item.key() + " must list 1 to " +
+                                         std::to_string(MAX_VARIANTS) + " profiles");
+            }
+            auto& variants = profiles->experiments[item.key()];
+            for (const auto& name : item.value()) {
+                auto it = name.is_string() ? profiles->profiles.find(name.get<std::string>()) : profiles->profiles.end();
+                if (it == profiles->profiles.end()) {
+                    throw std::runtime_error("experiment " + item.key() + " names an unknown profile");
+                }
+                variants.push_back(it->second);
+            }
+        }
+    }
+
+    std::atomic_store(&profiles_, std::shared_ptr<const ProfileSet>(std::move(profiles)));
+    watched_ = files;
+}
+
+void ScoringProfiles::start(std::chrono::milliseconds interval) {
+    if (path_.empty() || watcher_.joinable()) {
+        return;
+    }
+    stopping_ = false;
+    watcher_ = std::thread(&ScoringProfiles::watch_loop, this, interval);
+}
+
+void ScoringProfiles::stop() {
+    {
+        std::lock_guard<std::mutex> lock(watch_mutex_);
+        stopping_ = true;
+    }
+    watch_cv_.notify_all();
+    if (watcher_.joinable()) {
+        watcher_.join();
+    }
+}
+
+std::shared_ptr<const ScoringProfile> ScoringProfiles::find(const std::string& name) const {
+    std::shared_ptr<const ProfileSet> profiles = std::atomic_load(&profiles_);
+    auto it = profiles->profiles.find(name.empty() ? "default" : name);
+    return it != profiles->profiles.end() ? it->second : nullptr;
+}
+
+std::vector<std::shared_ptr<const ScoringProfile>> ScoringProfiles::resolve(const std::string& name,
+                                                                            const std::vector<std::string>& names,
+                                                                            const std::string& experiment) const {
+    std::shared_ptr<const ProfileSet> profiles = std::atomic_load(&profiles_);
+    if (!experiment.empty()) {
+        auto it = profiles->experiments.find(experiment);
+        if (it == profiles->experiments.end()) {
+            throw std::invalid_argument("unknown experiment " + experiment);
+        }
+        return it->second;
+    }
+
+    std::vector<std::shared_ptr<const ScoringProfile>> resolved;
+    if (names.size() > MAX_VARIANTS) {
+        throw std::invalid_argument("at most " + std::to_string(MAX_VARIANTS) + " scoring profiles per request");
+    }
+    for (const std::string& wanted : names.empty() ? std::vector<std::string>{name} : names) {
+        auto it = profiles->profiles.find(wanted.empty() ? "default" : wanted);
+        if (it == profiles->profiles.end()) {
+            throw std::invalid_argument("unknown scoring profile " + wanted);
+        }
+        resolved.push_back(it->second);
+    }
+    return resolved;
+}
+
+size_t ScoringProfiles::size() const {
+    return std::atomic_load(&profiles_)->profiles.size();
+}
+
+bool ScoringProfiles::file_changed() const {
+    for (const WatchedFile& watched : watched_) {
+        struct stat info;
+        if (stat(watched.path.c_str(), &info) != 0) {
+            continue;  // Keep the last good set while a file is missing (e.g. mid-rename)
+        }
+        if (info.st_mtim.tv_sec != watched.modified.tv_sec ||
+            info.st_mtim.tv_nsec != watched.modified.tv_nsec ||
+            info.st_size != watched.size) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void ScoringProfiles::watch_loop(std::chrono::milliseconds interval) {
+    std::unique_lock<std::mutex> lock(watch_mutex_);
+    while (!stopping_) {
+        watch_cv_.wait_for(lock, interval, [this]() { return stopping_; });
+        if (stopping_ || !file_changed()) {
+            continue;
+        }
+
+        lock.unlock();
+        std::vector<WatchedFile> files;
+        try {
+            load(files);
+            ++reloads_;
+            std::cout << "Reloaded " << size() << " scoring profiles from " << path_ << std::endl;
+        } catch (const std::runtime_error& e) {
+            // Watch what the failed attempt read as well as the last good
+            // set, so fixing whichever file broke it (say a model only the new
+            // profile file names) triggers the next reload
+            for (const WatchedFile& watched : watched_) {
+                auto same = [&](const WatchedFile& file) { return file.path == watched.path; };
+                if (std::none_of(files.begin(), files.end(), same)) {
+                    files.push_back(watched);
+                }
+            }
+
+            // Remember the broken files as they are now, so they are reported
+            // once, not every interval
+            for (WatchedFile& watched : files) {
+                struct stat info;
+                if (stat(watched.path.c_str(), &info) == 0) {
+                    watched.modified = info.st_mtim;
+                    watched.size = info.st_size;
+                }
+            }
+            watched_ = std::move(files);
+            std::cerr << "Scoring profile reload failed, keeping the previous profiles: " << e.what() << std::endl;
+        }
+        lock.lock();
+    }
+}
+
+} // namespace zerocost
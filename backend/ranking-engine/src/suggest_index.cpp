@@ -0,0 +1,328 @@
+#include "suggest_index.h"
+#include "event_store.h"
+#include "text_index.h"
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace zerocost {
+
+namespace {
+
+// Popularity an event lends its terms and category, counting saves as the popularity score does
+double event_weight(int64_t views, int64_t saves) {
+    return 1.0 + static_cast<double>(views) + 3.0 * static_cast<double>(saves);
+}
+
+// Category name tokenized like a query: "Arts & Culture" -> "arts culture"
+std::string category_key(std::string_view category) {
+    std::vector<std::string> tokens;
+    extract_title_terms(category, tokens);
+    std::string key;
+    for (const std::string& token : tokens) {
+        key += key.empty() ? "" : " ";
+        key += token;
+    }
+    return key;
+}
+
+/**
+ * Adds up weights per (text, kind) for a batch of events.
+ */
+class WeightTally {
+public:
+    void add_event(std::string_view title, std::string_view category, double weight) {
+        terms_.clear();
+        extract_title_terms(title, terms_);
+        std::sort(terms_.begin(), terms_.end());
+        terms_.erase(std::unique(terms_.begin(), terms_.end()), terms_.end());
+        for (const std::string& term : terms_) {
+            term_weights_[term] += weight;
+        }
+        std::string key = category_key(category);
+        if (!key.empty()) {
+            category_weights_[key] += weight;
+        }
+    }
+
+    void append_to(std::vector<Suggestion>& suggestions) const {
+        for (const auto& term : term_weights_) {
+            suggestions.push_back(Suggestion{term.first, SuggestionKind::Term, term.second});
+        }
+        for (const auto& category : category_weights_) {
+            suggestions.push_back(Suggestion{category.first, SuggestionKind::Category, category.second});
+        }
+    }
+
+private:
+    std::vector<std::string> terms_;
+    std::unordered_map<std::string, double> term_weights_;
+    std::unordered_map<std::string, double> category_weights_;
+};
+
+} // namespace
+
+std::shared_ptr<const SuggestIndex> SuggestIndex::build(std::vector<Suggestion> suggestions) {
+    std::shared_ptr<SuggestIndex> index(new SuggestIndex());
+
+    // Combine repeats, then drop what nothing live supports
+    std::sort(suggestions.begin(), suggestions.end(), [](const Suggestion& a, const Suggestion& b) {
+        return a.text != b.text ? a.text < b.text : a.kind < b.kind;
+    });
+    for (Suggestion& suggestion : suggestions) {
+        if (suggestion.text.empty() || suggestion.text.size() > MAX_LENGTH) {
+            continue;
+        }
+        std::vector<Suggestion>& kept = index->suggestions_;
+        if (!kept.empty() && kept.back().text == suggestion.text && kept.back().kind == suggestion.kind) {
+            kept.back().weight += suggestion.weight;
+        } else {
+            if (!kept.empty() && kept.back().weight <= 0.0) {
+                kept.pop_back();
+            }
+            kept.push_back(std::move(suggestion));
+        }
+    }
+    if (!index->suggestions_.empty() && index->suggestions_.back().weight <= 0.0) {
+        index->suggestions_.pop_back();
+    }
+    if (index->suggestions_.size() > UINT32_MAX) {
+        throw std::length_error("too many suggestions");
+    }
+
+    for (const Suggestion& suggestion : index->suggestions_) {
+        index->key_offsets_.push_back(static_cast<uint32_t>(index->keys_.size()));
+        index->keys_ += suggestion.text;
+        if (index->keys_.size() > UINT32_MAX) {
+            throw std::length_error("suggestion keys exceed 2^32 bytes");
+        }
+    }
+
+    index->nodes_.push_back(Node{0, 0, 0, 0, 0, 0});
+    index->build_node(0, 0, index->suggestions_.size(), 0);
+    return index;
+}
+
+void SuggestIndex::build_node(uint32_t node, size_t begin, size_t end, size_t depth) {
+    // Suggestions [begin, end) share their first depth bytes; those that end
+    // there sort first and belong to this node
+    std::vector<uint32_t> candidates;
+    size_t next = begin;
+    while (next < end && suggestions_[next].text.size() == depth) {
+        candidates.push_back(static_cast<uint32_t>(next++));
+    }
+
+    // One child per distinct next byte, labelled with the group's common prefix
+    std::vector<std::pair<size_t, size_t>> groups;
+    for (size_t i = next; i < end;) {
+        size_t group_end = i + 1;
+        while (group_end < end && suggestions_[group_end].text[depth] == suggestions_[i].text[depth]) {
+            ++group_end;
+        }
+        groups.emplace_back(i, group_end);
+        i = group_end;
+    }
+    uint32_t first_child = static_cast<uint32_t>(nodes_.size());
+    nodes_.resize(nodes_.size() + groups.size());
+    for (size_t g = 0; g < groups.size(); ++g) {
+        // Sorted, so the first and last of a group bound the common prefix of all
+        const std::string& first = suggestions_[groups[g].first].text;
+        const std::string& last = suggestions_[groups[g].second - 1].text;
+        size_t common = depth + 1;
+        while (common < first.size() && common < last.size() && first[common] == last[common]) {
+            ++common;
+        }
+        uint32_t child = first_child + static_cast<uint32_t>(g);
+        nodes_[child].label_offset = key_offsets_[groups[g].first] + static_cast<uint32_t>(depth);
+        nodes_[child].label_length = static_cast<uint8_t>(common - depth);
+        build_node(child, groups[g].first, groups[g].second, common);
+
+        const Node& built = nodes_[child];
+        candidates.insert(candidates.end(), top_.begin() + built.top_offset,
+                          top_.begin() + built.top_offset + built.top_count);
+    }
+
+    size_t count = std::min(candidates.size(), TOP_N);
+    std::partial_sort(candidates.begin(), candidates.begin() + count, candidates.end(),
+                      [this](uint32_t a, uint32_t b) {
+                          return suggestions_[a].weight > suggestions_[b].weight ||
+                                 (suggestions_[a].weight == suggestions_[b].weight && a < b);
+                      });
+    Node& built = nodes_[node];
+    built.first_child = first_child;
+    built.child_count = static_cast<uint16_t>(groups.size());
+    built.top_offset = static_cast<uint32_t>(top_.size());
+    built.top_count = static_cast<uint8_t>(count);
+    top_.insert(top_.end(), candidates.begin(), candidates.begin() + count);
+}
+
+void SuggestIndex::complete(std::string_view prefix, size_t limit,
+                            std::vector<const Suggestion*>& completions) const {
+    if (suggestions_.empty()) {
+        return;
+    }
+    const Node* node = &nodes_[0];
+    size_t matched = 0;
+    while (matched < prefix.size()) {
+        const Node* children = nodes_.data() + node->first_child;
+        const Node* children_end = children + node->child_count;
+        const Node* child = std::lower_bound(children, children_end, prefix[matched],
+            [this](const Node& n, char byte) {
+                return static_cast<unsigned char>(keys_[n.label_offset]) < static_cast<unsigned char>(byte);
+            });
+        if (child == children_end || keys_[child->label_offset] != prefix[matched]) {
+            return;
+        }
+        // The prefix may end inside the label: everything below still matches
+        size_t length = std::min<size_t>(child->label_length, prefix.size() - matched);
+        if (keys_.compare(child->label_offset, length, prefix.data() + matched, length) != 0) {
+            return;
+        }
+        matched += length;
+        node = child;
+    }
+
+    size_t count = std::min<size_t>(node->top_count, limit);
+    for (size_t i = 0; i < count; ++i) {
+        completions.push_back(&suggestions_[top_[node->top_offset + i]]);
+    }
+}
+
+std::vector<Suggestion> SuggestIndex::suggest(std::string_view query, size_t limit) const {
+    std::vector<std::string> words;
+    extract_title_terms(query, words);
+    if (words.empty()) {
+        return {};
+    }
+    limit = std::min(limit, TOP_N);
+
+    std::string lead;
+    for (size_t i = 0; i + 1 < words.size(); ++i) {
+        lead += words[i] + " ";
+    }
+    std::vector<const Suggestion*> completions;
+    complete(words.back(), limit, completions);
+    size_t last_word_completions = completions.size();
+    if (words.size() > 1) {
+        complete(lead + words.back(), limit, completions);
+    }
+
+    std::vector<Suggestion> suggestions;
+    for (size_t i = 0; i < completions.size(); ++i) {
+        const Suggestion& completion = *completions[i];
+        bool extends_query = i < last_word_completions && completion.kind == SuggestionKind::Term;
+        Suggestion suggestion{extends_query ? lead + completion.text : completion.text, completion.kind,
+                              completion.weight};
+        bool seen = std::any_of(suggestions.begin(), suggestions.end(), [&suggestion](const Suggestion& s) {
+            return s.kind == suggestion.kind && s.text == suggestion.text;
+        });
+        if (!seen) {
+            suggestions.push_back(std::move(suggestion));
+        }
+    }
+    std::stable_sort(suggestions.begin(), suggestions.end(), [](const Suggestion& a, const Suggestion& b) {
+        return a.weight > b.weight;
+    });
+    suggestions.resize(std::min(suggestions.size(), limit));
+    return suggestions;
+}
+
+Autocomplete::Autocomplete(const EventStore& store)
+    : store_(store), index_(SuggestIndex::build({})) {}
+
+Autocomplete::~Autocomplete() {
+    stop();
+}
+
+bool Autocomplete::refresh() {
+    std::lock_guard<std::mutex> lock(refresh_mutex_);
+    StoreView view = store_.view();
+    if (view.snapshot == snapshot_ && view.overlay == overlay_) {
+        return false;
+    }
+
+    // Snapshot rows only change with a new generation
+    if (view.snapshot != snapshot_) {
+        const EventColumns& columns = view.snapshot->columns();
+        WeightTally tally;
+        for (size_t row = 0; row < columns.count; ++row) {
+            tally.add_event(columns.title(row), columns.category_name(columns.category_id[row]),
+                            event_weight(columns.view_count[row], columns.save_count[row]));
+        }
+        snapshot_suggestions_.clear();
+        tally.append_to(snapshot_suggestions_);
+        snapshot_ = view.snapshot;
+    }
+
+    // Writes since: take out the rows they replace or delete, add what is live
+    const EventColumns& columns = view.snapshot->columns();
+    WeightTally removed;
+    WeightTally added;
+    for (const auto& entry : view.overlay->entries) {
+        int64_t row = view.snapshot->find(entry.first);
+        if (row >= 0) {
+            removed.add_event(columns.title(row), columns.category_name(columns.category_id[row]),
+                              event_weight(columns.view_count[row], columns.save_count[row]));
+        }
+        if (!entry.second.deleted) {
+            const Event& event = entry.second.event;
+            double weight = view.counters
+                ? event_weight(view.counters->views(entry.second.slot), view.counters->saves(entry.second.slot))
+                : event_weight(event.view_count, event.save_count);
+            added.add_event(event.title, event.category, weight);
+        }
+    }
+    std::vector<Suggestion> suggestions = snapshot_suggestions_;
+    size_t before_removed = suggestions.size();
+    removed.append_to(suggestions);
+    for (size_t i = before_removed; i < suggestions.size(); ++i) {
+        suggestions[i].weight = -suggestions[i].weight;
+    }
+    added.append_to(suggestions);
+
+    std::atomic_store(&index_, SuggestIndex::build(std::move(suggestions)));
+    overlay_ = view.overlay;
+    ++rebuilds_;
+    return true;
+}
+
+void Autocomplete::start(std::chrono::milliseconds interval) {
+    if (refresher_.joinable()) {
+        return;
+    }
+    refresh();
+    stopping_ = false;
+    refresher_ = std::thread(&Autocomplete::refresh_loop, this, interval);
+}
+
+void Autocomplete::stop() {
+    {
+        std::lock_guard<std::mutex> lock(loop_mutex_);
+        stopping_ = true;
+    }
+    loop_cv_.notify_all();
+    if (refresher_.joinable()) {
+        refresher_.join();
+    }
+}
+
+void Autocomplete::refresh_loop(std::chrono::milliseconds interval) {
+    std::unique_lock<std::mutex> lock(loop_mutex_);
+    while (!stopping_) {
+        loop_cv_.wait_for(lock, interval, [this]() { return stopping_; });
+        if (stopping_) {
+            continue;
+        }
+
+        lock.unlock();
+        try {
+            refresh();
+        } catch (const std::exception& e) {
+            std::cerr << "Suggestion index rebuild failed, keeping the previous index: " << e.what() << std::endl;
+        }
+        lock.lock();
+    }
+}
+
+} // namespace zerocost
@@ -0,0 +1,506 @@
+#include "text_index.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <unordered_set>
+#include <utility>
+
+namespace zerocost {
+
+namespace {
+
+// FNV-1a, stable across processes (as for snapshot ids)
+constexpr uint64_t FNV_OFFSET = 14695981039346656037ull;
+constexpr uint64_t FNV_PRIME = 1099511628211ull;
+
+/**
+ * Call visit with the hash of each term of text: runs of non-space bytes,
+ * lowercased, with punctuation dropped (the tokenization deduplication
+ * and calculate_text_similarity use). Hashes as it goes, so no strings are
+ * built.
+ */
+template <typename Visit>
+void for_each_term(std::string_view text, Visit visit) {
+    uint64_t hash = FNV_OFFSET;
+    size_t length = 0;
+    for (char c : text) {
+        unsigned char byte = static_cast<unsigned char>(c);
+        if (std::isspace(byte)) {
+            if (length > 0) {
+                visit(hash);
+            }
+            hash = FNV_OFFSET;
+            length = 0;
+        } else if (!std::ispunct(byte)) {
+            hash = (hash ^ static_cast<unsigned char>(std::tolower(byte))) * FNV_PRIME;
+            ++length;
+        }
+    }
+    if (length > 0) {
+        visit(hash);
+    }
+}
+
+/**
+ * Call visit with each term of text, tokenized as for_each_term.
+ */
+template <typename Visit>
+void for_each_token(std::string_view text, Visit visit) {
+    std::string token;
+    for (char c : text) {
+        unsigned char byte = static_cast<unsigned char>(c);
+        if (std::isspace(byte)) {
+            if (!token.empty()) {
+                visit(token);
+            }
+            token.clear();
+        } else if (!std::ispunct(byte)) {
+            token += static_cast<char>(std::tolower(byte));
+        }
+    }
+    if (!token.empty()) {
+        visit(token);
+    }
+}
+
+// Hash of a term already tokenized, equal to what for_each_term reports
+uint64_t hash_term(std::string_view term) {
+    uint64_t hash = FNV_OFFSET;
+    for (char c : term) {
+        hash = (hash ^ static_cast<unsigned char>(c)) * FNV_PRIME;
+    }
+    return hash;
+}
+
+constexpr size_t MAX_FUZZY_LENGTH = 64;   // One machine word of pattern bits
+
+// Call visit with each trigram of term, padded with a space at both ends
+template <typename Visit>
+void for_each_trigram(std::string_view term, Visit visit) {
+    auto byte = [&term](size_t i) -> uint32_t {
+        return i == 0 || i > term.size() ? ' ' : static_cast<unsigned char>(term[i - 1]);
+    };
+    for (size_t i = 0; i < term.size(); ++i) {
+        visit((byte(i) << 16) | (byte(i + 1) << 8) | byte(i + 2));
+    }
+}
+
+/**
+ * Bit-parallel optimal string alignment distance of a pattern of at most
+ * 64 bytes to text: Myers' algorithm in Hyyrö's formulation for a global
+ * distance, with his transposition term. Column j of the edit matrix is
+ * kept as vertical +1/-1 delta bit vectors, so each text byte costs a
+ * handful of word operations.
+ */
+class PatternMatcher {
+public:
+    explicit PatternMatcher(std::string_view pattern) : length_(pattern.size()) {
+        for (size_t i = 0; i < pattern.size(); ++i) {
+            peq_[static_cast<unsigned char>(pattern[i])] |= uint64_t(1) << i;
+        }
+    }
+
+    uint32_t distance(std::string_view text) const {
+        if (length_ == 0) {
+            return static_cast<uint32_t>(text.size());
+        }
+        const uint64_t last = uint64_t(1) << (length_ - 1);
+        uint64_t vp = ~uint64_t(0);
+        uint64_t vn = 0;
+        uint64_t previous_d0 = 0;
+        uint64_t previous_eq = 0;
+        uint32_t distance = static_cast<uint32_t>(length_);
+        for (char c : text) {
+            uint64_t eq = peq_[static_cast<unsigned char>(c)];
+            uint64_t transposed = (((~previous_d0) & eq) << 1) & previous_eq;
+            uint64_t d0 = (((eq & vp) + vp) ^ vp) | eq | vn | transposed;
+            uint64_t hp = vn | ~(d0 | vp);
+            uint64_t hn = vp & d0;
+            if (hp & last) {
+                ++distance;
+            } else if (hn & last) {
+                --distance;
+            }
+            hp = (hp << 1) | 1;
+            hn <<= 1;
+            vp = hn | ~(d0 | hp);
+            vn = hp & d0;
+            previous_d0 = d0;
+            previous_eq = eq;
+        }
+        return distance;
+    }
+
+private:
+    size_t length_;
+    uint64_t peq_[256] = {};
+};
+
+uint32_t length_difference(size_t a, size_t b) {
+    return static_cast<uint32_t>(a > b ? a - b : b - a);
+}
+
+// Vocabulary order: by length, then bytes
+bool vocabulary_less(std::string_view a, std::string_view b) {
+    return a.size() != b.size() ? a.size() < b.size() : a < b;
+}
+
+} // namespace
+
+void extract_terms(std::string_view title, std::string_view description, std::vector<TermEntry>& terms) {
+    // (hash, in title) per occurrence, grouped by sorting
+    std::vector<std::pair<uint64_t, bool>> occurrences;
+    for_each_term(title, [&occurrences](uint64_t hash) { occurrences.emplace_back(hash, true); });
+    for_each_term(description, [&occurrences](uint64_t hash) { occurrences.emplace_back(hash, false); });
+    std::sort(occurrences.begin(), occurrences.end());
+
+    terms.clear();
+    for (const auto& occurrence : occurrences) {
+        if (terms.empty() || terms.back().hash != occurrence.first) {
+            terms.push_back(TermEntry{occurrence.first, 0, 0, 0});
+        }
+        uint16_t& count = occurrence.second ? terms.back().title_count : terms.back().description_count;
+        if (count < std::numeric_limits<uint16_t>::max()) {
+            ++count;
+        }
+    }
+}
+
+void extract_title_terms(std::string_view title, std::vector<std::string>& terms) {
+    for_each_token(title, [&terms](const std::string& token) { terms.push_back(token); });
+}
+
+uint32_t max_fuzzy_edits(size_t length) {
+    return length < 4 ? 0 : length < 8 ? 1 : 2;
+}
+
+void find_similar_terms(const ShardedSet<std::string>& terms, std::string_view term, uint32_t max_edits,
+                        std::vector<SimilarTerm>& similar) {
+    if (max_edits == 0 || term.size() > MAX_FUZZY_LENGTH) {
+        return;
+    }
+    PatternMatcher matcher(term);
+    for (const std::string& candidate : terms) {
+        if (length_difference(candidate.size(), term.size()) > max_edits) {
+            continue;
+        }
+        uint32_t edits = matcher.distance(candidate);
+        if (edits > 0 && edits <= max_edits) {
+            similar.push_back(SimilarTerm{candidate, edits});
+        }
+    }
+}
+
+bool TermVocabulary::contains(std::string_view term) const {
+    size_t low = 0;
+    size_t high = term_count;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (vocabulary_less(this->term(middle), term)) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low < term_count && this->term(low) == term;
+}
+
+void TermVocabulary::find_similar(std::string_view term, uint32_t max_edits,
+                                  std::vector<SimilarTerm>& similar) const {
+    if (max_edits == 0 || term.size() > MAX_FUZZY_LENGTH || trigram_count == 0) {
+        return;
+    }
+
+    // An edit changes at most 3 of a term's trigrams and a transposition 4,
+    // so a match keeps all but 4 * max_edits of term's distinct trigrams
+    uint32_t query_trigrams[MAX_FUZZY_LENGTH];
+    size_t distinct = 0;
+    for_each_trigram(term, [&](uint32_t trigram) { query_trigrams[distinct++] = trigram; });
+    std::sort(query_trigrams, query_trigrams + distinct);
+    distinct = std::unique(query_trigrams, query_trigrams + distinct) - query_trigrams;
+    size_t required = distinct > 4 * max_edits ? distinct - 4 * max_edits : 1;
+
+    // Terms are ordered by length, so the lengths in reach are one id range
+    auto first_of_length = [this](size_t length) {
+        size_t low = 0;
+        size_t high = term_count;
+        while (low < high) {
+            size_t middle = low + (high - low) / 2;
+            if (term_offsets[middle + 1] - term_offsets[middle] < length) {
+                low = middle + 1;
+            } else {
+                high = middle;
+            }
+        }
+        return static_cast<uint32_t>(low);
+    };
+    uint32_t first_id = first_of_length(term.size() > max_edits ? term.size() - max_edits : 0);
+    uint32_t end_id = first_of_length(term.size() + max_edits + 1);
+
+    // Shared trigram counts per term; reset after each call
+    thread_local std::vector<uint8_t> shared;
+    thread_local std::vector<uint32_t> touched;
+    if (shared.size() < term_count) {
+        shared.assign(term_count, 0);
+    }
+    touched.clear();
+    const TrigramEntry* end = trigrams + trigram_count;
+    for (size_t i = 0; i < distinct; ++i) {
+        const TrigramEntry* entry = std::lower_bound(trigrams, end, query_trigrams[i],
+            [](const TrigramEntry& e, uint32_t trigram) { return e.trigram < trigram; });
+        if (entry == end || entry->trigram != query_trigrams[i]) {
+            continue;
+        }
+        const uint32_t* begin = std::lower_bound(postings + entry->first, postings + entry[1].first, first_id);
+        const uint32_t* run_end = std::lower_bound(begin, postings + entry[1].first, end_id);
+        for (const uint32_t* p = begin; p < run_end; ++p) {
+            if (shared[*p]++ == 0) {
+                touched.push_back(*p);
+            }
+        }
+    }
+
+    PatternMatcher matcher(term);
+    std::sort(touched.begin(), touched.end());
+    for (uint32_t id : touched) {
+        std::string_view candidate = this->term(id);
+        if (shared[id] >= required) {
+            uint32_t edits = matcher.distance(candidate);
+            if (edits > 0 && edits <= max_edits) {
+                similar.push_back(SimilarTerm{candidate, edits});
+            }
+        }
+        shared[id] = 0;
+    }
+}
+
+TermVocabulary VocabularyData::view() const {
+    TermVocabulary vocabulary;
+    vocabulary.term_count = term_offsets.empty() ? 0 : term_offsets.size() - 1;
+    vocabulary.term_offsets = term_offsets.data();
+    vocabulary.text = text.data();
+    vocabulary.trigram_count = trigrams.empty() ? 0 : trigrams.size() - 1;
+    vocabulary.trigrams = trigrams.data();
+    vocabulary.postings = postings.data();
+    return vocabulary;
+}
+
+VocabularyData build_vocabulary(std::vector<std::string> terms) {
+    // Titles repeat most terms many times: drop repeats before sorting
+    std::unordered_set<std::string> distinct;
+    for (std::string& term : terms) {
+        distinct.insert(std::move(term));
+    }
+    terms.assign(distinct.begin(), distinct.end());
+    std::sort(terms.begin(), terms.end(), vocabulary_less);
+
+    VocabularyData data;
+    data.term_offsets.reserve(terms.size() + 1);
+    data.term_offsets.push_back(0);
+    std::vector<std::pair<uint32_t, uint32_t>> pairs;   // (trigram, term id)
+    for (size_t id = 0; id < terms.size(); ++id) {
+        data.text += terms[id];
+        if (data.text.size() > UINT32_MAX) {
+            throw std::length_error("vocabulary exceeds 2^32 bytes");
+        }
+        data.term_offsets.push_back(static_cast<uint32_t>(data.text.size()));
+        if (terms[id].size() <= MAX_FUZZY_LENGTH) {
+            for_each_trigram(terms[id], [&](uint32_t trigram) {
+                pairs.emplace_back(trigram, static_cast<uint32_t>(id));
+            });
+        }
+    }
+    std::sort(pairs.begin(), pairs.end());
+    pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+
+    data.postings.reserve(pairs.size());
+    for (const auto& pair : pairs) {
+        if (data.trigrams.empty() || data.trigrams.back().trigram != pair.first) {
+            data.trigrams.push_back(TrigramEntry{pair.first, static_cast<uint32_t>(data.postings.size())});
+        }
+        data.postings.push_back(pair.second);
+    }
+    data.trigrams.push_back(TrigramEntry{UINT32_MAX, static_cast<uint32_t>(data.postings.size())});
+    return data;
+}
+
+void TextCorpusDelta::apply(const TermEntry* terms, size_t count, int64_t sign) {
+    documents += sign;
+    for (size_t i = 0; i < count; ++i) {
+        title_terms += sign * terms[i].title_count;
+        description_terms += sign * terms[i].description_count;
+        int64_t& frequency = document_frequency[terms[i].hash];
+        frequency += sign;
+        if (frequency == 0) {
+            document_frequency.erase(terms[i].hash);
+        }
+    }
+}
+
+TextCorpus::TextCorpus(const DocumentFrequency* frequencies, size_t frequency_count, const TextTotals& totals,
+                       const TextCorpusDelta* delta)
+    : frequencies_(frequencies), frequency_count_(frequency_count), delta_(delta) {
+    auto adjusted = [](uint64_t base, int64_t change) {
+        int64_t value = static_cast<int64_t>(base) + change;
+        return static_cast<uint64_t>(std::max<int64_t>(value, 0));
+    };
+    documents_ = adjusted(totals.documents, delta ? delta->documents : 0);
+    title_terms_ = adjusted(totals.title_terms, delta ? delta->title_terms : 0);
+    description_terms_ = adjusted(totals.description_terms, delta ? delta->description_terms : 0);
+}
+
+uint64_t TextCorpus::document_frequency(uint64_t hash) const {
+    int64_t documents = 0;
+    const DocumentFrequency* end = frequencies_ + frequency_count_;
+    const DocumentFrequency* found = std::lower_bound(frequencies_, end, hash,
+        [](const DocumentFrequency& entry, uint64_t h) { return entry.hash < h; });
+    if (found != end && found->hash == hash) {
+        documents = found->documents;
+    }
+    if (delta_) {
+        auto it = delta_->document_frequency.find(hash);
+        documents += it != delta_->document_frequency.end() ? it->second : 0;
+    }
+    return static_cast<uint64_t>(std::max<int64_t>(documents, 0));
+}
+
+double TextCorpus::average_title_terms() const {
+    return documents_ > 0 ? static_cast<double>(title_terms_) / static_cast<double>(documents_) : 0.0;
+}
+
+double TextCorpus::average_description_terms() const {
+    return documents_ > 0 ? static_cast<double>(description_terms_) / static_cast<double>(documents_) : 0.0;
+}
+
+Bm25Scorer::Bm25Scorer(const std::string& query, const TextCorpus& corpus,
+                       const TermVocabulary* vocabulary, const ShardedSet<std::string>* recent_terms) {
+    std::vector<std::string> tokens;
+    for_each_token(query, [&tokens](const std::string& token) {
+        if (tokens.size() < MAX_QUERY_TERMS && std::find(tokens.begin(), tokens.end(), token) == tokens.end()) {
+            tokens.push_back(token);
+        }
+    });
+    groups_ = tokens.size();
+
+    // Lucene's idf, which stays positive for terms in most events
+    double documents = static_cast<double>(corpus.documents());
+    auto idf = [documents](double frequency) {
+        frequency = std::min(frequency, documents);
+        return std::log(1.0 + (documents - frequency + 0.5) / (frequency + 0.5));
+    };
+
+    struct Expansion {
+        uint64_t hash;
+        uint32_t edits;
+        uint64_t documents;
+    };
+    std::vector<double> group_weights(groups_);
+    std::vector<SimilarTerm> similar;
+    std::vector<Expansion> expansions;
+    double total = 0.0;
+    for (uint32_t group = 0; group < groups_; ++group) {
+        const std::string& token = tokens[group];
+        uint64_t hash = hash_term(token);
+        uint64_t frequency = corpus.document_frequency(hash);
+        terms_.push_back(QueryTerm{hash, 1.0, group});
+
+        // Terms a few edits away that some event still has, closest and most common first
+        uint32_t max_edits = max_fuzzy_edits(token.size());
+        similar.clear();
+        if (vocabulary) {
+            vocabulary->find_similar(token, max_edits, similar);
+        }
+        if (recent_terms) {
+            find_similar_terms(*recent_terms, token, max_edits, similar);
+        }
+        expansions.clear();
+        for (const SimilarTerm& term : similar) {
+            uint64_t term_hash = hash_term(term.term);
+            uint64_t term_documents = corpus.document_frequency(term_hash);
+            bool seen = std::any_of(expansions.begin(), expansions.end(),
+                                    [term_hash](const Expansion& e) { return e.hash == term_hash; });
+            if (term_documents > 0 && !seen) {
+                expansions.push_back(Expansion{term_hash, term.edits, term_documents});
+            }
+        }
+        std::sort(expansions.begin(), expansions.end(), [](const Expansion& a, const Expansion& b) {
+            return a.edits != b.edits ? a.edits < b.edits
+                 : a.documents != b.documents ? a.documents > b.documents
+                 : a.hash < b.hash;
+        });
+        expansions.resize(std::min(expansions.size(), MAX_EXPANSIONS));
+        for (const Expansion& expansion : expansions) {
+            double penalty = 1.0 - static_cast<double>(expansion.edits) / static_cast<double>(token.size());
+            terms_.push_back(QueryTerm{expansion.hash, penalty, group});
+            frequency = std::max(frequency, expansion.documents);
+        }
+
+        group_weights[group] = idf(static_cast<double>(frequency));
+        total += group_weights[group];
+    }
+    for (QueryTerm& term : terms_) {
+        term.weight *= group_weights[term.group] / total;
+    }
+    std::sort(terms_.begin(), terms_.end(), [](const QueryTerm& a, const QueryTerm& b) {
+        return a.hash < b.hash || (a.hash == b.hash && a.group < b.group);
+    });
+
+    double title_average = corpus.average_title_terms();
+    double description_average = corpus.average_description_terms();
+    title_length_factor_ = title_average > 0.0 ? B / title_average : 0.0;
+    description_length_factor_ = description_average > 0.0 ? B / description_average : 0.0;
+}
+
+double Bm25Scorer::score(const TermEntry* terms, size_t count) const {
+    if (terms_.empty()) {
+        return 0.0;
+    }
+
+    // One pass over the event's terms: field lengths, and the query terms it has
+    // (event term, query term) per match
+    uint32_t title_length = 0;
+    uint32_t description_length = 0;
+    std::pair<uint32_t, uint32_t> matches[MAX_QUERY_TERMS * (1 + MAX_EXPANSIONS)];
+    size_t matched = 0;
+    size_t next = 0;
+    for (size_t i = 0; i < count; ++i) {
+        title_length += terms[i].title_count;
+        description_length += terms[i].description_count;
+        while (next < terms_.size() && terms_[next].hash < terms[i].hash) {
+            ++next;
+        }
+        for (; next < terms_.size() && terms_[next].hash == terms[i].hash; ++next) {
+            matches[matched++] = {static_cast<uint32_t>(i), static_cast<uint32_t>(next)};
+        }
+    }
+    if (matched == 0) {
+        return 0.0;
+    }
+
+    // Each query term counts once, by its best match
+    double title_norm = 1.0 - B + title_length * title_length_factor_;
+    double description_norm = 1.0 - B + description_length * description_length_factor_;
+    double best[MAX_QUERY_TERMS] = {};
+    for (size_t m = 0; m < matched; ++m) {
+        const TermEntry& term = terms[matches[m].first];
+        const QueryTerm& query_term = terms_[matches[m].second];
+        double frequency = TITLE_WEIGHT * term.title_count / title_norm +
+                           DESCRIPTION_WEIGHT * term.description_count / description_norm;
+        best[query_term.group] = std::max(best[query_term.group], query_term.weight * frequency / (K1 + frequency));
+    }
+    double score = 0.0;
+    for (size_t group = 0; group < groups_; ++group) {
+        score += best[group];
+    }
+    return score;
+}
+
+double Bm25Scorer::score(std::string_view title, std::string_view description) const {
+    std::vector<TermEntry> terms;
+    extract_terms(title, description, terms);
+    return score(terms.data(), terms.size());
+}
+
+} // namespace zerocost
@@ -0,0 +1,68 @@
+#include "timing_wheel.h"
+#include <utility>
+
+namespace zerocost {
+
+TimingWheel::TimingWheel(int64_t now) : current_(now) {}
+
+void TimingWheel::schedule(std::string id, int64_t when) {
+    place(Timer{std::move(id), when});
+    ++size_;
+}
+
+void TimingWheel::place(Timer timer) {
+    // Overdue timers fire on the next tick
+    int64_t when = timer.when > current_ ? timer.when : current_ + 1;
+    int64_t delta = when - current_;
+
+    int level = 0;
+    while (level < LEVELS - 1 && delta >= (int64_t(1) << (SLOT_BITS * (level + 1)))) {
+        ++level;
+    }
+    if (delta >= (int64_t(1) << (SLOT_BITS * LEVELS))) {
+        // Beyond the top level: park in its farthest slot and re-place on cascade
+        when = current_ + (int64_t(1) << (SLOT_BITS * LEVELS)) - 1;
+    }
+    size_t slot = static_cast<size_t>((when >> (SLOT_BITS * level)) & (SLOTS - 1));
+    slots_[level][slot].push_back(std::move(timer));
+}
+
+void TimingWheel::cascade(int level) {
+    std::vector<Timer> timers;
+    timers.swap(slots_[level][(current_ >> (SLOT_BITS * level)) & (SLOTS - 1)]);
+    for (auto& timer : timers) {
+        place(std::move(timer));
+    }
+}
+
+void TimingWheel::advance(int64_t now, std::vector<std::string>& due) {
+    if (size_ == 0) {
+        current_ = now > current_ ? now : current_;
+        return;
+    }
+
+    while (current_ < now) {
+        ++current_;
+
+        // Entering a new block of a level: pull its timers down first
+        for (int level = 1; level < LEVELS; ++level) {
+            if ((current_ & ((int64_t(1) << (SLOT_BITS * level)) - 1)) != 0) {
+                break;
+            }
+            cascade(level);
+        }
+
+        std::vector<Timer>& slot = slots_[0][current_ & (SLOTS - 1)];
+        for (auto& timer : slot) {
+            due.push_back(std::move(timer.id));
+        }
+        size_ -= slot.size();
+        slot.clear();
+
+        if (size_ == 0) {
+            current_ = now;
+        }
+    }
+}
+
+} // namespace zerocost
@@ -0,0 +1,341 @@
+#include "tree_ensemble.h"
+#include "json.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+namespace zerocost {
+
+namespace {
+
+using json = nlohmann::json;
+
+constexpr const char* FEATURE_NAMES[MODEL_FEATURE_COUNT] = {
+    "distance_km", "distance", "urgency", "popularity", "freshness",
+    "category", "text_similarity", "view_count", "save_count", "embedding_similarity"
+};
+
+bool parse_index(const std::string& digits, size_t& index) {
+    if (digits.empty() || digits.size() > 4 ||
+        !std::all_of(digits.begin(), digits.end(), [](char c) { return c >= '0' && c <= '9'; })) {
+        return false;
+    }
+    index = std::stoul(digits);
+    return true;
+}
+
+// A feature by name, or by position as "f3" or "Column_3"
+ModelFeature feature_named(const std::string& name) {
+    for (size_t f = 0; f < MODEL_FEATURE_COUNT; ++f) {
+        if (name == FEATURE_NAMES[f]) {
+            return static_cast<ModelFeature>(f);
+        }
+    }
+    size_t index = MODEL_FEATURE_COUNT;
+    if ((name.compare(0, 1, "f") == 0 && parse_index(name.substr(1), index)) ||
+        (name.compare(0, 7, "Column_") == 0 && parse_index(name.substr(7), index))) {
+        if (index < MODEL_FEATURE_COUNT) {
+            return static_cast<ModelFeature>(index);
+        }
+    }
+    throw std::runtime_error("unknown model feature " + name);
+}
+
+double number_at(const json& node, const char* key) {
+    auto it = node.find(key);
+    if (it == node.end() || !it->is_number()) {
+        throw std::runtime_error(std::string("model node without numeric ") + key);
+    }
+    return it->get<double>();
+}
+
+} // namespace
+
+/**
+ * Flattens trees into TreeEnsemble's layout. Leaves are numbered left to
+ * right as the tree is walked; a split's mask clears the leaves of its left
+ * subtree, which a value above the threshold cannot reach.
+ */
+class TreeEnsembleBuilder {
+public:
+    explicit TreeEnsembleBuilder(std::string name) : ensemble_(std::make_shared<TreeEnsemble>()) {
+        ensemble_->name_ = std::move(name);
+    }
+
+    void add_xgboost_tree(const json& root) {
+        begin_tree();
+        add_xgboost_node(root, 0);
+    }
+
+    void add_lightgbm_tree(const json& root, const std::vector<ModelFeature>& features) {
+        begin_tree();
+        add_lightgbm_node(root, features, 0);
+    }
+
+    std::shared_ptr<const TreeEnsemble> finish() {
+        if (ensemble_->leaf_offsets_.empty()) {
+            throw std::runtime_error("model has no trees");
+        }
+        std::sort(splits_.begin(), splits_.end(), [](const Split& a, const Split& b) {
+            return a.feature != b.feature ? a.feature < b.feature : a.threshold < b.threshold;
+        });
+
+        TreeEnsemble& ensemble = *ensemble_;
+        ensemble.thresholds_.reserve(splits_.size());
+        ensemble.threshold_trees_.reserve(splits_.size());
+        ensemble.threshold_masks_.reserve(splits_.size());
+        size_t next = 0;
+        for (size_t f = 0; f < MODEL_FEATURE_COUNT; ++f) {
+            ensemble.feature_offsets_[f] = static_cast<uint32_t>(next);
+            for (; next < splits_.size() && splits_[next].feature == f; ++next) {
+                ensemble.thresholds_.push_back(splits_[next].threshold);
+                ensemble.threshold_trees_.push_back(splits_[next].tree);
+                ensemble.threshold_masks_.push_back(splits_[next].mask);
+            }
+        }
+        ensemble.feature_offsets_[MODEL_FEATURE_COUNT] = static_cast<uint32_t>(next);
+        return std::move(ensemble_);
+    }
+
+private:
+    struct Split {
+        size_t feature;
+        double threshold;  // Left when value <= threshold
+        uint32_t tree;
+        uint64_t mask;
+    };
+
+    void begin_tree() {
+        ensemble_->leaf_offsets_.push_back(static_cast<uint32_t>(ensemble_->leaf_values_.size()));
+        tree_leaves_ = 0;
+    }
+
+    void add_leaf(double value) {
+        if (tree_leaves_ == TreeEnsemble::MAX_LEAVES) {
+            throw std::runtime_error("model tree has more than 64 leaves");
+        }
+        ensemble_->leaf_values_.push_back(value);
+        ++tree_leaves_;
+    }
+
+    void add_split(ModelFeature feature, double threshold, uint32_t first_leaf) {
+        // Leaves [first_leaf, tree_leaves_) make up the left subtree (at most 63)
+        uint64_t left = ((uint64_t(1) << (tree_leaves_ - first_leaf)) - 1) << first_leaf;
+        uint32_t tree = static_cast<uint32_t>(ensemble_->leaf_offsets_.size() - 1);
+        splits_.push_back(Split{static_cast<size_t>(feature), threshold, tree, ~left});
+    }
+
+    static void check_depth(size_t depth) {
+        if (depth >= TreeEnsemble::MAX_LEAVES) {
+            throw std::runtime_error("model tree deeper than 64 levels");
+        }
+    }
+
+    // XGBoost: {"split": "f0", "split_condition": c, "yes": id, "no": id,
+    // "children": [...]} goes to "yes" when value < c
+    void add_xgboost_node(const json& node, size_t depth) {
+        check_depth(depth);
+        if (!node.is_object()) {
+            throw std::runtime_error("malformed XGBoost tree node");
+        }
+        if (node.contains("leaf")) {
+            add_leaf(number_at(node, "leaf"));
+            return;
+        }
+        auto split = node.find("split");
+        auto children = node.find("children");
+        if (split == node.end() || !split->is_string() || children == node.end() || !children->is_array()) {
+            throw std::runtime_error("malformed XGBoost tree node");
+        }
+        auto child = [&](const char* key) -> const json& {
+            double id = number_at(node, key);
+            for (const auto& candidate : *children) {
+                if (candidate.is_object() && candidate.contains("nodeid") && number_at(candidate, "nodeid") == id) {
+                    return candidate;
+                }
+            }
+            throw std::runtime_error("XGBoost tree node without its children");
+        };
+
+        // value < c is value <= the double just below c
+        double threshold = std::nextafter(number_at(node, "split_condition"), -std::numeric_limits<double>::infinity());
+        ModelFeature feature = feature_named(split->get<std::string>());
+        uint32_t first_leaf = tree_leaves_;
+        add_xgboost_node(child("yes"), depth + 1);
+        add_split(feature, threshold, first_leaf);
+        add_xgboost_node(child("no"), depth + 1);
+    }
+
+    // LightGBM: {"split_feature": i, "threshold": t, "decision_type": "<=",
+    // "left_child": {...}, "right_child": {...}} or {"leaf_value": v}
+    void add_lightgbm_node(const json& node, const std::vector<ModelFeature>& features, size_t depth) {
+        check_depth(depth);
+        if (!node.is_object()) {
+            throw std::runtime_error("malformed LightGBM tree node");
+        }
+        if (node.contains("leaf_value")) {
+            add_leaf(number_at(node, "leaf_value"));
+            return;
+        }
+        auto decision = node.find("decision_type");
+        if (decision == node.end() || !decision->is_string() || decision->get<std::string>() != "<=") {
+            throw std::runtime_error("only numeric <= splits are supported in LightGBM models");
+        }
+        auto left = node.find("left_child");
+        auto right = node.find("right_child");
+        if (left == node.end() || right == node.end()) {
+            throw std::runtime_error("malformed LightGBM tree node");
+        }
+        double index = number_at(node, "split_feature");
+        if (index < 0 || index >= features.size()) {
+            throw std::runtime_error("LightGBM split on a feature outside feature_names");
+        }
+
+        uint32_t first_leaf = tree_leaves_;
+        add_lightgbm_node(*left, features, depth + 1);
+        add_split(features[static_cast<size_t>(index)], number_at(node, "threshold"), first_leaf);
+        add_lightgbm_node(*right, features, depth + 1);
+    }
+
+    std::shared_ptr<TreeEnsemble> ensemble_;
+    std::vector<Split> splits_;
+    uint32_t tree_leaves_ = 0;
+};
+
+std::shared_ptr<const TreeEnsemble> TreeEnsemble::load(const std::string& path) {
+    std::ifstream file(path);
+    if (!file) {
+        throw std::runtime_error("cannot open model " + path);
+    }
+    std::stringstream contents;
+    contents << file.rdbuf();
+    size_t slash = path.find_last_of('/');
+    try {
+        return parse(contents.str(), slash == std::string::npos ? path : path.substr(slash + 1));
+    } catch (const std::runtime_error& e) {
+        throw std::runtime_error(path + ": " + e.what());
+    }
+}
+
+std::shared_ptr<const TreeEnsemble> TreeEnsemble::parse(const std::string& text, const std::string& name) {
+    json document;
+    try {
+        document = json::parse(text);
+    } catch (const json::exception& e) {
+        throw std::runtime_error(e.what());
+    }
+
+    // Nodes are type-checked as they are read; json errors that still get
+    // through become runtime_errors, so a bad model is reported and skipped
+    // rather than escaping load() and the profile reload
+    try {
+        TreeEnsembleBuilder builder(name);
+        if (document.is_array()) {
+            for (const auto& tree : document) {
+                builder.add_xgboost_tree(tree);
+            }
+        } else if (document.is_object() && document.contains("tree_info") && document["tree_info"].is_array()) {
+            std::vector<ModelFeature> features;
+            auto names = document.find("feature_names");
+            if (names != document.end() && !names->is_array()) {
+                throw std::runtime_error("LightGBM feature_names is not an array");
+            }
+            for (const auto& feature : names != document.end() ? *names : json::array()) {
+                if (!feature.is_string()) {
+                    throw std::runtime_error("LightGBM feature name is not a string");
+                }
+                features.push_back(feature_named(feature.get<std::string>()));
+            }
+            for (const auto& tree : document["tree_info"]) {
+                if (!tree.is_object() || !tree.contains("tree_structure")) {
+                    throw std::runtime_error("LightGBM tree without tree_structure");
+                }
+                builder.add_lightgbm_tree(tree["tree_structure"], features);
+            }
+        } else {
+            throw std::runtime_error("expected an XGBoost JSON dump or LightGBM JSON model");
+        }
+        return builder.finish();
+    } catch (const json::exception& e) {
+        throw std::runtime_error(std::string("malformed model: ") + e.what());
+    }
+}
+
+namespace {
+
+// Events scored together: one 512-bit vector of reachable-leaf words per tree
+constexpr size_t LANES = 8;
+
+typedef double DoubleLanes __attribute__((vector_size(LANES * sizeof(double))));
+typedef int64_t MaskLanes __attribute__((vector_size(LANES * sizeof(int64_t))));
+
+// Reachable leaves of one tree in each lane
+struct alignas(64) TreeLanes {
+    uint64_t leaves[LANES];
+};
+
+// AVX-512 and AVX2 clones, as for the scoring kernels
+#if defined(__GNUC__) && defined(__x86_64__) && defined(__linux__)
+__attribute__((target_clones("arch=x86-64-v4", "arch=x86-64-v3", "default")))
+#endif
+void apply_false_splits(const double* thresholds, const uint32_t* trees, const uint64_t* masks,
+                        uint32_t begin, uint32_t end, const double* values, double highest,
+                        uint64_t* reachable) {
+    DoubleLanes value;
+    std::memcpy(&value, values, sizeof(value));
+    for (uint32_t k = begin; k < end && thresholds[k] < highest; ++k) {
+        // Lanes at or below the threshold keep every leaf (all-ones)
+        MaskLanes kept = value <= thresholds[k];
+        MaskLanes* tree = reinterpret_cast<MaskLanes*>(reachable + static_cast<size_t>(trees[k]) * LANES);
+        *tree &= static_cast<int64_t>(masks[k]) | kept;
+    }
+}
+
+} // namespace
+
+void TreeEnsemble::predict(const ModelFeatures& features, size_t count, double* scores) const {
+    size_t trees = leaf_offsets_.size();
+    std::vector<TreeLanes> storage(trees);
+    uint64_t* reachable = storage.data()->leaves;
+    for (size_t begin = 0; begin < count; begin += LANES) {
+        size_t lanes = std::min(LANES, count - begin);
+        std::fill(reachable, reachable + trees * LANES, ~uint64_t(0));
+
+        // vQS: a threshold is tested against all lanes at once, and the scan
+        // of a feature stops at the first threshold no lane exceeds. Missing
+        // (NaN) values and unused lanes go left at every split.
+        for (size_t f = 0; f < MODEL_FEATURE_COUNT; ++f) {
+            if (feature_offsets_[f] == feature_offsets_[f + 1]) {
+                continue;
+            }
+            alignas(64) double values[LANES];
+            double highest = -std::numeric_limits<double>::infinity();
+            for (size_t d = 0; d < LANES; ++d) {
+                double value = d < lanes ? features[f][begin + d] : -std::numeric_limits<double>::infinity();
+                values[d] = std::isnan(value) ? -std::numeric_limits<double>::infinity() : value;
+                highest = std::max(highest, values[d]);
+            }
+            apply_false_splits(thresholds_.data(), threshold_trees_.data(), threshold_masks_.data(),
+                               feature_offsets_[f], feature_offsets_[f + 1], values, highest, reachable);
+        }
+
+        // Each tree's exit leaf is its leftmost leaf still reachable; lanes
+        // sum independently, each in tree order
+        double sums[LANES] = {};
+        for (size_t t = 0; t < trees; ++t) {
+            const double* leaves = leaf_values_.data() + leaf_offsets_[t];
+            const uint64_t* tree = reachable + t * LANES;
+            for (size_t d = 0; d < LANES; ++d) {
+                sums[d] += leaves[__builtin_ctzll(tree[d])];
+            }
+        }
+        std::copy(sums, sums + lanes, scores + begin);
+    }
+}
+
+} // namespace zerocost
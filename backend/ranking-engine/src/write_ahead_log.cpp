@@ -0,0 +1,427 @@
+#include "write_ahead_log.h"
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace zerocost {
+
+namespace {
+
+constexpr size_t FRAME_HEADER_SIZE = 8;     // length + crc
+constexpr uint32_t MAX_RECORD_SIZE = 64u << 20;
+
+// CRC-32C (Castagnoli), reflected polynomial
+uint32_t crc32c(const char* data, size_t size) {
+    static const auto TABLE = []() {
+        std::array<uint32_t, 256> table{};
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; ++bit) {
+                crc = (crc >> 1) ^ (0x82F63B78u & (0u - (crc & 1u)));
+            }
+            table[i] = crc;
+        }
+        return table;
+    }();
+
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < size; ++i) {
+        crc = (crc >> 8) ^ TABLE[(crc ^ static_cast<unsigned char>(data[i])) & 0xFF];
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+template <typename T>
+void put(std::string& out, T value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void put_string(std::string& out, const std::string& value) {
+    put<uint32_t>(out, static_cast<uint32_t>(value.size()));
+    out += value;
+}
+
+/**
+ * Bounds-checked cursor over a record payload.
+ */
+class PayloadReader {
+public:
+    PayloadReader(const char* data, size_t size) : data_(data), size_(size) {}
+
+    template <typename T>
+    T get() {
+        T value;
+        require(sizeof(T));
+        std::memcpy(&value, data_ + offset_, sizeof(T));
+        offset_ += sizeof(T);
+        return value;
+    }
+
+    std::string get_string() {
+        uint32_t length = get<uint32_t>();
+        require(length);
+        std::string value(data_ + offset_, length);
+        offset_ += length;
+        return value;
+    }
+
+    bool at_end() const {
+        return offset_ == size_;
+    }
+
+private:
+    void require(size_t bytes) const {
+        if (bytes > size_ - offset_) {
+            throw WalError("record body truncated");
+        }
+    }
+
+    const char* data_;
+    size_t size_;
+    size_t offset_ = 0;
+};
+
+std::string encode_record(const WalRecord& record) {
+    std::string payload;
+    put<uint8_t>(payload, static_cast<uint8_t>(record.type));
+    put<uint64_t>(payload, record.sequence);
+    if (record.type == WalRecordType::Interactions) {
+        put<uint32_t>(payload, static_cast<uint32_t>(record.interactions.size()));
+        for (const auto& interaction : record.interactions) {
+            put_string(payload, interaction.event_id);
+            put<int32_t>(payload, interaction.views);
+            put<int32_t>(payload, interaction.saves);
+        }
+    } else {
+        put_string(payload, record.event.id);
+    }
+    if (record.type == WalRecordType::Upsert) {
+        const Event& event = record.event;
+        put_string(payload, event.title);
+        put_string(payload, event.description);
+        put_string(payload, event.category);
+        put<double>(payload, event.latitude);
+        put<double>(payload, event.longitude);
+        put<int64_t>(payload, event.start_time);
+        put<int64_t>(payload, event.end_time);
+        put<int64_t>(payload, event.created_at);
+        put<int32_t>(payload, event.view_count);
+        put<int32_t>(payload, event.save_count);
+        if (!event.embedding.empty()) {
+            put_string(payload, std::string(event.embedding.begin(), event.embedding.end()));
+        }
+    }
+
+    std::string frame;
+    frame.reserve(FRAME_HEADER_SIZE + payload.size());
+    put<uint32_t>(frame, static_cast<uint32_t>(payload.size()));
+    put<uint32_t>(frame, crc32c(payload.data(), payload.size()));
+    frame += payload;
+    return frame;
+}
+
+WalRecord decode_record(const char* data, size_t size) {
+    PayloadReader reader(data, size);
+    WalRecord record;
+    record.type = static_cast<WalRecordType>(reader.get<uint8_t>());
+    record.sequence = reader.get<uint64_t>();
+    record.event = Event();
+    if (record.type == WalRecordType::Interactions) {
+        uint32_t count = reader.get<uint32_t>();
+        while (count-- > 0) {
+            Interaction interaction;
+            interaction.event_id = reader.get_string();
+            interaction.views = reader.get<int32_t>();
+            interaction.saves = reader.get<int32_t>();
+            record.interactions.push_back(std::move(interaction));
+        }
+        return record;
+    }
+    record.event.id = reader.get_string();
+    if (record.type == WalRecordType::Upsert) {
+        Event& event = record.event;
+        event.title = reader.get_string();
+        event.description = reader.get_string();
+        event.category = reader.get_string();
+        event.latitude = reader.get<double>();
+        event.longitude = reader.get<double>();
+        event.start_time = static_cast<std::time_t>(reader.get<int64_t>());
+        event.end_time = static_cast<std::time_t>(reader.get<int64_t>());
+        event.created_at = static_cast<std::time_t>(reader.get<int64_t>());
+        event.view_count = reader.get<int32_t>();
+        event.save_count = reader.get<int32_t>();
+        if (!reader.at_end()) {
+            std::string embedding = reader.get_string();
+            event.embedding.assign(embedding.begin(), embedding.end());
+        }
+        event.distance_km = 0.0;
+        event.score = 0.0;
+    } else if (record.type != WalRecordType::Delete) {
+        throw WalError("unknown record type");
+    }
+    return record;
+}
+
+std::string errno_message(const std::string& what, const std::string& path) {
+    return what + " " + path + ": " + std::strerror(errno);
+}
+
+std::string parent_directory(const std::string& path) {
+    size_t slash = path.find_last_of('/');
+    return slash == std::string::npos ? "." : path.substr(0, std::max<size_t>(slash, 1));
+}
+
+std::string read_file(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw WalError(errno_message("cannot open", path));
+    }
+    std::string contents;
+    char buffer[1 << 16];
+    ssize_t n;
+    while ((n = ::read(fd, buffer, sizeof(buffer))) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ::close(fd);
+            throw WalError(errno_message("cannot read", path));
+        }
+        contents.append(buffer, static_cast<size_t>(n));
+    }
+    ::close(fd);
+    return contents;
+}
+
+} // namespace
+
+WriteAheadLog::WriteAheadLog(std::string base_path) : base_path_(std::move(base_path)) {}
+
+WriteAheadLog::~WriteAheadLog() {
+    close();
+}
+
+uint64_t WriteAheadLog::open(uint64_t base_sequence, const std::function<void(const WalRecord&)>& apply) {
+    std::string directory = parent_directory(base_path_);
+    size_t slash = base_path_.find_last_of('/');
+    std::string prefix = (slash == std::string::npos ? base_path_ : base_path_.substr(slash + 1)) + ".wal-";
+
+    // Segment names carry their first sequence as fixed-width hex, so
+    // lexical order is replay order
+    std::vector<std::string> segments;
+    if (DIR* dir = opendir(directory.c_str())) {
+        while (struct dirent* entry = readdir(dir)) {
+            std::string name = entry->d_name;
+            if (name.compare(0, prefix.size(), prefix) == 0) {
+                segments.push_back(directory + "/" + name);
+            }
+        }
+        closedir(dir);
+    }
+    std::sort(segments.begin(), segments.end());
+
+    uint64_t last_sequence = base_sequence;
+    for (const auto& path : segments) {
+        std::string contents = read_file(path);
+        uint64_t segment_last = 0;
+        size_t offset = 0;
+        while (contents.size() - offset >= FRAME_HEADER_SIZE) {
+            uint32_t length;
+            uint32_t crc;
+            std::memcpy(&length, contents.data() + offset, sizeof(length));
+            std::memcpy(&crc, contents.data() + offset + 4, sizeof(crc));
+            const char* payload = contents.data() + offset + FRAME_HEADER_SIZE;
+            if (length > MAX_RECORD_SIZE || length > contents.size() - offset - FRAME_HEADER_SIZE ||
+                crc32c(payload, length) != crc) {
+                break;
+            }
+
+            WalRecord record;
+            try {
+                record = decode_record(payload, length);
+            } catch (const WalError&) {
+                break;
+            }
+            if (record.sequence > base_sequence) {
+                apply(record);
+            }
+            segment_last = record.sequence;
+            offset += FRAME_HEADER_SIZE + length;
+        }
+        if (offset != contents.size()) {
+            std::cerr << "WAL: ignoring " << contents.size() - offset << " torn or corrupt bytes at the end of "
+                      << path << std::endl;
+        }
+
+        if (segment_last == 0) {
+            ::unlink(path.c_str());
+        } else {
+            closed_segments_.push_back(Segment{path, segment_last});
+            last_sequence = std::max(last_sequence, segment_last);
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_sequence_ = last_sequence;
+    durable_sequence_ = last_sequence;
+    open_segment(last_sequence + 1);
+    flusher_ = std::thread(&WriteAheadLog::flush_loop, this);
+    return last_sequence;
+}
+
+void WriteAheadLog::open_segment(uint64_t first_sequence) {
+    // Caller holds mutex_
+    char suffix[24];
+    std::snprintf(suffix, sizeof(suffix), ".wal-%016llx", static_cast<unsigned long long>(first_sequence));
+    segment_path_ = base_path_ + suffix;
+    segment_first_sequence_ = first_sequence;
+
+    fd_ = ::open(segment_path_.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+    if (fd_ < 0) {
+        error_ = errno_message("cannot create", segment_path_);
+        throw WalError(error_);
+    }
+
+    // Make the new directory entry itself durable
+    int dir_fd = ::open(parent_directory(segment_path_).c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd >= 0) {
+        ::fsync(dir_fd);
+        ::close(dir_fd);
+    }
+}
+
+void WriteAheadLog::append(const WalRecord& record) {
+    std::string frame = encode_record(record);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!error_.empty()) {
+        throw WalError(error_);
+    }
+    pending_ += frame;
+    pending_sequence_ = record.sequence;
+    stats_.records.fetch_add(1, std::memory_order_relaxed);
+    work_cv_.notify_one();
+}
+
+void WriteAheadLog::wait_durable(uint64_t sequence) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    durable_cv_.wait(lock, [&]() {
+        return durable_sequence_ >= sequence || !error_.empty();
+    });
+    if (durable_sequence_ < sequence) {
+        throw WalError(error_);
+    }
+}
+
+uint64_t WriteAheadLog::durable_sequence() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return durable_sequence_;
+}
+
+void WriteAheadLog::flush_loop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        work_cv_.wait(lock, [this]() {
+            return stopping_ || !pending_.empty();
+        });
+        if (pending_.empty() || !error_.empty()) {
+            break;
+        }
+
+        // Everything queued while the previous sync ran goes out in one batch
+        std::string batch;
+        batch.swap(pending_);
+        uint64_t batch_sequence = pending_sequence_;
+        int fd = fd_;
+        flushing_ = true;
+        lock.unlock();
+
+        std::string failure;
+        const char* data = batch.data();
+        size_t remaining = batch.size();
+        while (remaining > 0 && failure.empty()) {
+            ssize_t written = ::write(fd, data, remaining);
+            if (written < 0) {
+                if (errno != EINTR) {
+                    failure = errno_message("cannot write", segment_path_);
+                }
+                continue;
+            }
+            data += written;
+            remaining -= static_cast<size_t>(written);
+        }
+        if (failure.empty() && fdatasync(fd) != 0) {
+            failure = errno_message("cannot sync", segment_path_);
+        }
+
+        lock.lock();
+        flushing_ = false;
+        if (failure.empty()) {
+            durable_sequence_ = batch_sequence;
+            stats_.syncs.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            std::cerr << "WAL: " << failure << std::endl;
+            error_ = failure;
+        }
+        durable_cv_.notify_all();
+    }
+}
+
+void WriteAheadLog::wait_idle(std::unique_lock<std::mutex>& lock) {
+    work_cv_.notify_one();
+    durable_cv_.wait(lock, [this]() {
+        return (pending_.empty() && !flushing_) || !error_.empty();
+    });
+}
+
+void WriteAheadLog::rotate() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (fd_ < 0 || !error_.empty()) {
+        return;
+    }
+    wait_idle(lock);
+    if (!error_.empty() || durable_sequence_ < segment_first_sequence_) {
+        return; // Failed, or nothing written to the current segment yet
+    }
+
+    ::close(fd_);
+    fd_ = -1;
+    closed_segments_.push_back(Segment{segment_path_, durable_sequence_});
+    open_segment(durable_sequence_ + 1);
+}
+
+void WriteAheadLog::truncate_through(uint64_t sequence) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto covered = std::remove_if(closed_segments_.begin(), closed_segments_.end(), [&](const Segment& segment) {
+        if (segment.last_sequence > sequence) {
+            return false;
+        }
+        ::unlink(segment.path.c_str());
+        return true;
+    });
+    closed_segments_.erase(covered, closed_segments_.end());
+}
+
+void WriteAheadLog::close() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    work_cv_.notify_all();
+    if (flusher_.joinable()) {
+        flusher_.join();
+    }
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+}
+
+} // namespace zerocost
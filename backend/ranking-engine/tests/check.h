@@ -0,0 +1,49 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+
+/*
+ * Minimal assertions for the test executables: a failed check prints its
+ * location and the test keeps going, then check_result() turns the failure
+ * count into the exit status ctest looks at.
+ */
+
+inline int& check_failures() {
+    static int failures = 0;
+    return failures;
+}
+
+#define CHECK(condition)                                                              \
+    do {                                                                              \
+        if (!(condition)) {                                                           \
+            ++check_failures();                                                       \
+            std::cerr << __FILE__ << ":" << __LINE__                                  \
+                      << ": CHECK(" #condition ") failed" << std::endl;               \
+        }                                                                             \
+    } while (0)
+
+#define CHECK_NEAR(actual, expected, tolerance)                                       \
+    do {                                                                              \
+        double check_actual_ = (actual);                                              \
+        double check_expected_ = (expected);                                          \
+        if (!(std::fabs(check_actual_ - check_expected_) <= (tolerance))) {           \
+            ++check_failures();                                                       \
+            std::cerr << std::setprecision(17) << __FILE__ << ":" << __LINE__         \
+                      << ": " #actual " = "                                           \
+                      << check_actual_ << ", expected " << check_expected_            \
+                      << " +- " << (tolerance) << std::endl;                          \
+        }                                                                             \
+    } while (0)
+
+inline int check_result() {
+    if (check_failures() > 0) {
+        std::cerr << check_failures() << " check(s) failed" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+#endif // CHECK_H
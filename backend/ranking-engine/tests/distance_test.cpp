@@ -0,0 +1,135 @@
+#include "check.h"
+#include "distance.h"
+#include <cmath>
+#include <initializer_list>
+
+using namespace zerocost;
+
+namespace {
+
+// Worst relative errors quoted in distance.h and the README
+constexpr double WORST_ERROR_50_KM = 2.3e-5;
+constexpr double WORST_ERROR_100_KM = 9.2e-5;
+
+struct Point {
+    double latitude;
+    double longitude;
+};
+
+// The point distance_km from origin along an initial bearing (radians)
+Point destination(Point origin, double distance_km, double bearing) {
+    double latitude = origin.latitude * DEGREES_TO_RADIANS;
+    double angle = distance_km / EARTH_RADIUS_KM;
+    double end_latitude = std::asin(std::sin(latitude) * std::cos(angle) +
+                                    std::cos(latitude) * std::sin(angle) * std::cos(bearing));
+    double delta_longitude = std::atan2(std::sin(bearing) * std::sin(angle) * std::cos(latitude),
+                                        std::cos(angle) - std::sin(latitude) * std::sin(end_latitude));
+    double end_longitude = std::remainder(origin.longitude + delta_longitude / DEGREES_TO_RADIANS, 360.0);
+    return Point{end_latitude / DEGREES_TO_RADIANS, end_longitude};
+}
+
+/*
+ * Worst relative error of approximate_distance against haversine_distance
+ * for points at radius_km (and fractions of it) around origins between the
+ * given latitudes, on every bearing in 1 degree steps. Also checks the
+ * approximation never falls below the north-south separation (to 1e-9:
+ * the separation here subtracts latitudes in degrees, which cancels).
+ */
+double worst_error(double max_latitude, double radius_km, std::initializer_list<double> longitudes) {
+    double worst = 0.0;
+    bool below_separation = false;
+    for (double latitude = -max_latitude; latitude <= max_latitude; latitude += 2.5) {
+        for (double longitude : longitudes) {
+            Point origin{latitude, longitude};
+            LocalProjection projection = make_local_projection(latitude, longitude);
+            for (int degrees = 0; degrees < 360; ++degrees) {
+                for (double fraction : {0.1, 0.5, 1.0}) {
+                    Point point = destination(origin, radius_km * fraction, degrees * DEGREES_TO_RADIANS);
+                    double exact = haversine_distance(latitude, longitude, point.latitude, point.longitude);
+                    double approximate = approximate_distance(projection, point.latitude, point.longitude);
+                    worst = std::max(worst, std::fabs(approximate - exact) / exact);
+                    double separation = EARTH_RADIUS_KM * std::fabs(point.latitude - latitude) * DEGREES_TO_RADIANS;
+                    below_separation |= approximate < separation * (1.0 - 1e-9);
+                }
+            }
+        }
+    }
+    CHECK(!below_separation);
+    return worst;
+}
+
+void test_error_bound() {
+    // Every radius up to the limit, with origins up to the latitude limit
+    for (double radius_km : {1.0, 10.0, 25.0, 50.0, 75.0, APPROXIMATE_DISTANCE_MAX_KM}) {
+        CHECK(approximate_distance_applies(APPROXIMATE_DISTANCE_MAX_LATITUDE, radius_km));
+        double worst = worst_error(APPROXIMATE_DISTANCE_MAX_LATITUDE, radius_km, {0.0, 45.0, -120.0});
+        CHECK(worst <= APPROXIMATE_DISTANCE_MAX_ERROR);
+    }
+    CHECK(!approximate_distance_applies(APPROXIMATE_DISTANCE_MAX_LATITUDE + 0.1, 10.0));
+    CHECK(!approximate_distance_applies(0.0, APPROXIMATE_DISTANCE_MAX_KM + 0.1));
+}
+
+void test_quoted_worst_cases() {
+    // The quoted figures are the maxima, reached at the latitude limit;
+    // bearings in 0.01 degree steps
+    double worst_50 = 0.0;
+    double worst_100 = 0.0;
+    for (double latitude : {APPROXIMATE_DISTANCE_MAX_LATITUDE, -APPROXIMATE_DISTANCE_MAX_LATITUDE}) {
+        Point origin{latitude, 10.0};
+        LocalProjection projection = make_local_projection(origin.latitude, origin.longitude);
+        auto error = [&](double radius_km, double bearing) {
+            Point point = destination(origin, radius_km, bearing);
+            double exact = haversine_distance(origin.latitude, origin.longitude, point.latitude, point.longitude);
+            return std::fabs(approximate_distance(projection, point.latitude, point.longitude) - exact) / exact;
+        };
+        for (int step = 0; step < 36000; ++step) {
+            double bearing = step * 0.01 * DEGREES_TO_RADIANS;
+            worst_50 = std::max(worst_50, error(50.0, bearing));
+            worst_100 = std::max(worst_100, error(100.0, bearing));
+        }
+    }
+    std::cout << "worst relative error: " << worst_50 << " at 50 km, " << worst_100 << " at 100 km" << std::endl;
+    CHECK(worst_50 <= WORST_ERROR_50_KM);
+    CHECK(worst_100 <= WORST_ERROR_100_KM);
+
+    // Close to the quoted values, so they are not just loose bounds
+    CHECK(worst_50 > 0.9 * WORST_ERROR_50_KM);
+    CHECK(worst_100 > 0.9 * WORST_ERROR_100_KM);
+}
+
+void test_antimeridian() {
+    // Origins on and next to +-180 degrees, with points on the other side
+    double worst = worst_error(APPROXIMATE_DISTANCE_MAX_LATITUDE, APPROXIMATE_DISTANCE_MAX_KM,
+                               {180.0, -180.0, 179.9, -179.9, 179.999});
+    CHECK(worst <= APPROXIMATE_DISTANCE_MAX_ERROR);
+
+    // Two points 0.2 degrees of longitude apart across the line
+    LocalProjection east = make_local_projection(10.0, 179.9);
+    double exact = haversine_distance(10.0, 179.9, 10.0, -179.9);
+    CHECK_NEAR(approximate_distance(east, 10.0, -179.9), exact, exact * APPROXIMATE_DISTANCE_MAX_ERROR);
+    LocalProjection west = make_local_projection(-45.0, -179.95);
+    exact = haversine_distance(-45.0, -179.95, -45.5, 179.95);
+    CHECK_NEAR(approximate_distance(west, -45.5, 179.95), exact, exact * APPROXIMATE_DISTANCE_MAX_ERROR);
+}
+
+void test_far_points_stay_far() {
+    // Outside the mode's radius the approximation may be off, but never
+    // below the north-south separation, so far points are not pulled in
+    LocalProjection projection = make_local_projection(60.0, 25.0);
+    for (double latitude : {58.0, 62.0, 0.0, -60.0, 89.0}) {
+        for (double longitude : {25.0, -155.0, 179.0}) {
+            double separation = EARTH_RADIUS_KM * std::fabs(latitude - 60.0) * DEGREES_TO_RADIANS;
+            CHECK(approximate_distance(projection, latitude, longitude) >= separation * (1.0 - 1e-9));
+        }
+    }
+}
+
+} // namespace
+
+int main() {
+    test_error_bound();
+    test_quoted_worst_cases();
+    test_antimeridian();
+    test_far_points_stay_far();
+    return check_result();
+}
@@ -0,0 +1,96 @@
+#include "check.h"
+#include "fast_math.h"
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <random>
+
+using namespace zerocost;
+
+namespace {
+
+constexpr int SWEEP_POINTS = 1 << 20;
+
+// |actual - expected| in units of the last place of expected
+double ulps(double actual, double expected) {
+    double magnitude = std::fabs(expected);
+    double ulp = std::nextafter(magnitude, std::numeric_limits<double>::infinity()) - magnitude;
+    return std::fabs(actual - expected) / ulp;
+}
+
+struct WorstCase {
+    double error = 0.0;
+    double x = 0.0;
+
+    void add(double x_value, double error_value) {
+        if (error_value > error) {
+            error = error_value;
+            x = x_value;
+        }
+    }
+};
+
+void report(const char* name, const WorstCase& worst) {
+    std::cout << name << ": worst " << worst.error << " ulp at x = " << std::setprecision(17) << worst.x
+              << std::setprecision(6) << std::endl;
+    CHECK(worst.error <= FAST_MATH_MAX_ULPS);
+}
+
+void test_exp() {
+    // Distance scores take exp of [-3, 0]: an even grid, then random points
+    WorstCase worst;
+    for (int i = 0; i <= SWEEP_POINTS; ++i) {
+        double x = -3.0 * i / SWEEP_POINTS;
+        worst.add(x, ulps(fast_exp(x), std::exp(x)));
+    }
+    std::mt19937_64 random(42);
+    std::uniform_real_distribution<double> uniform(-3.0, 0.0);
+    for (int i = 0; i < SWEEP_POINTS; ++i) {
+        double x = uniform(random);
+        worst.add(x, ulps(fast_exp(x), std::exp(x)));
+    }
+    for (double x : {0.0, -0.0, -std::numeric_limits<double>::denorm_min(), -0.5 * LN2_HI, -LN2_HI, -3.0}) {
+        worst.add(x, ulps(fast_exp(x), std::exp(x)));
+    }
+    CHECK(fast_exp(0.0) == 1.0);
+    report("fast_exp on [-3, 0]", worst);
+}
+
+void test_log() {
+    // Popularity scores take log of engagement + 1: every small integer,
+    // then a log-spaced grid and random points up to 2^33
+    WorstCase worst;
+    for (int i = 1; i <= SWEEP_POINTS; ++i) {
+        double x = i;
+        worst.add(x, ulps(fast_log(x), std::log(x)));
+    }
+    for (int i = 1; i <= SWEEP_POINTS; ++i) {
+        double x = std::exp2(33.0 * i / SWEEP_POINTS);
+        worst.add(x, ulps(fast_log(x), std::log(x)));
+    }
+    std::mt19937_64 random(42);
+    std::uniform_real_distribution<double> exponent(0.0, 33.0);
+    for (int i = 0; i < SWEEP_POINTS; ++i) {
+        double x = std::exp2(exponent(random));
+        worst.add(x, ulps(fast_log(x), std::log(x)));
+    }
+
+    // Just above 1, where log(x) is tiny and only relative error is meaningful
+    for (int i = 1; i <= SWEEP_POINTS; ++i) {
+        double x = 1.0 + std::ldexp(static_cast<double>(i), -40);
+        worst.add(x, ulps(fast_log(x), std::log(x)));
+    }
+    for (double x : {std::nextafter(1.0, 2.0), SQRT2, std::nextafter(SQRT2, 2.0), 2.0, 4294967296.0, 8589934592.0}) {
+        worst.add(x, ulps(fast_log(x), std::log(x)));
+    }
+    CHECK(fast_log(1.0) == 0.0);
+    report("fast_log on [1, 2^33]", worst);
+}
+
+} // namespace
+
+int main() {
+    test_exp();
+    test_log();
+    return check_result();
+}
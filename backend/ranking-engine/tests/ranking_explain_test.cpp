@@ -0,0 +1,123 @@
+#include "check.h"
+#include "event_store.h"
+#include "ranking_service.h"
+#include "scoring.h"
+#include <ctime>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace zerocost;
+
+namespace {
+
+constexpr double USER_LATITUDE = 40.7128;
+constexpr double USER_LONGITUDE = -74.0060;
+
+// Events spread from 0.2 to about 60 km north-east of the user, some either
+// side of the 1 km boost radius, with varied start times and popularity
+std::vector<Event> make_events(const std::string& prefix, int count, std::time_t now) {
+    std::vector<Event> events;
+    for (int i = 0; i < count; ++i) {
+        Event event{};
+        event.id = prefix + std::to_string(i);
+        event.title = (i % 2 ? "jazz night " : "food market ") + event.id;
+        event.description = i % 3 ? "live music downtown" : "street food and music";
+        event.latitude = USER_LATITUDE + 0.0013 * i * i / 4.0 + 0.0017;
+        event.longitude = USER_LONGITUDE + 0.0011 * i;
+        event.start_time = now + 1800 * i;
+        event.end_time = event.start_time + 7200;
+        event.category = i % 2 ? "music" : "food";
+        event.view_count = 37 * i;
+        event.save_count = 5 * i;
+        event.created_at = now - 3000 * i;
+        events.push_back(event);
+    }
+    return events;
+}
+
+RankingRequest make_request(std::time_t now, double max_distance_km) {
+    RankingRequest request;
+    request.user_location = UserLocation{USER_LATITUDE, USER_LONGITUDE, now, {"music"}};
+    request.max_distance_km = max_distance_km;
+    request.limit = 0;
+    request.explain = true;
+    return request;
+}
+
+// A second profile, so variants are explained too
+std::shared_ptr<const ScoringProfile> nearby_profile() {
+    auto profile = std::make_shared<ScoringProfile>();
+    profile->name = "nearby";
+    profile->weight_distance = 0.6;
+    profile->weight_urgency = 0.1;
+    profile->boost_radius_km = 2.5;
+    profile->boost_factor = 1.1;
+    return profile;
+}
+
+// Every explained score is exactly the score the event was ranked with
+void check_explanations(const std::vector<Event>& events, const std::vector<ScoreExplanation>& explanations) {
+    CHECK(!events.empty());
+    CHECK(explanations.size() == events.size());
+    for (size_t i = 0; i < events.size() && i < explanations.size(); ++i) {
+        CHECK(explanations[i].score == events[i].score);
+    }
+}
+
+void check_response(const RankingResponse& response) {
+    check_explanations(response.ranked_events, response.explanations);
+    for (const RankingVariant& variant : response.variants) {
+        check_explanations(variant.ranked_events, variant.explanations);
+    }
+}
+
+void test_resident(bool approximate_distance) {
+    std::time_t now = std::time(nullptr);
+    StoreOptions options;
+    options.expire_events = false;
+    EventStore store(options);
+    store.load();
+    store.start();
+
+    // Snapshot rows (scored by chord) and recent writes (haversine or approximate)
+    store.upsert(make_events("snapshot-", 40, now));
+    store.compact();
+    store.upsert(make_events("recent-", 12, now));
+
+    RankingService service(approximate_distance);
+    for (double max_distance_km : {5.0, 50.0, 500.0}) {
+        RankingRequest request = make_request(now, max_distance_km);
+        check_response(service.rank_resident(request, store.view()));
+        check_response(service.rank_resident(request, store.view(), "music"));
+
+        request.profiles = {std::make_shared<ScoringProfile>(), nearby_profile()};
+        check_response(service.rank_resident(request, store.view()));
+    }
+    store.stop();
+}
+
+void test_inline(bool approximate_distance) {
+    std::time_t now = std::time(nullptr);
+    RankingService service(approximate_distance);
+    for (double max_distance_km : {5.0, 50.0, 500.0}) {
+        RankingRequest request = make_request(now, max_distance_km);
+        request.events = make_events("inline-", 30, now);
+        request.has_events = true;
+        check_response(service.rank_events(request));
+        check_response(service.search_and_rank(request, "music"));
+
+        request.profiles = {std::make_shared<ScoringProfile>(), nearby_profile()};
+        check_response(service.rank_events(request));
+    }
+}
+
+} // namespace
+
+int main() {
+    test_resident(true);
+    test_resident(false);
+    test_inline(true);
+    test_inline(false);
+    return check_result();
+}
@@ -0,0 +1,173 @@
+#include "check.h"
+#include "scoring.h"
+#include <cstdint>
+#include <ctime>
+#include <limits>
+#include <vector>
+
+using namespace zerocost;
+
+namespace {
+
+constexpr int64_t HOUR = 3600;
+constexpr int64_t DAY = 86400;
+constexpr int64_t NOW = 1700000000;  // 2023-11-14
+
+// The branch-free curves only reorder the arithmetic of the originals
+constexpr double CURVE_TOLERANCE = 1e-15;
+
+// The original formulas, before the curves were rewritten as selects
+double baseline_urgency(std::time_t start_time, std::time_t current_time) {
+    double time_diff_seconds = std::difftime(start_time, current_time);
+    if (time_diff_seconds <= 0) {
+        return 0.5;
+    }
+    double time_diff_hours = time_diff_seconds / 3600.0;
+    if (time_diff_hours < 2.0) {
+        return 1.0;
+    }
+    if (time_diff_hours < 24.0) {
+        return 0.8 - (time_diff_hours - 2.0) / 22.0 * 0.3;
+    }
+    double time_diff_days = time_diff_seconds / 86400.0;
+    if (time_diff_days < 7.0) {
+        return 0.5 - (time_diff_days - 1.0) / 6.0 * 0.3;
+    }
+    return 0.2;
+}
+
+double baseline_freshness(std::time_t created_at, std::time_t current_time) {
+    double age_seconds = std::difftime(current_time, created_at);
+    double age_hours = age_seconds / 3600.0;
+    if (age_hours < 1.0) {
+        return 1.0;
+    }
+    if (age_hours < 24.0) {
+        return 0.9 - (age_hours - 1.0) / 23.0 * 0.4;
+    }
+    double age_days = age_seconds / 86400.0;
+    if (age_days < 7.0) {
+        return 0.5 - (age_days - 1.0) / 6.0 * 0.3;
+    }
+    return 0.2;
+}
+
+// Offsets (seconds) around every segment boundary of either curve
+std::vector<int64_t> boundary_offsets() {
+    std::vector<int64_t> offsets;
+    for (int64_t boundary : {int64_t(0), HOUR, 2 * HOUR, 24 * HOUR, 72 * HOUR, 168 * HOUR}) {
+        for (int64_t delta : {int64_t(-1), int64_t(0), int64_t(1)}) {
+            offsets.push_back(boundary + delta);
+            offsets.push_back(-boundary + delta);
+        }
+    }
+    return offsets;
+}
+
+// Deltas far outside the curves, up to the ends of the timestamp range
+std::vector<int64_t> huge_offsets() {
+    std::vector<int64_t> offsets;
+    for (int shift : {30, 40, 48, 49, 50, 55, 62}) {
+        offsets.push_back(int64_t(1) << shift);
+        offsets.push_back(-(int64_t(1) << shift));
+    }
+    return offsets;
+}
+
+void check_offset(int64_t offset) {
+    // Upcoming events for urgency, past creation times for freshness
+    CHECK_NEAR(calculate_urgency_score(NOW + offset, NOW), baseline_urgency(NOW + offset, NOW), CURVE_TOLERANCE);
+    CHECK_NEAR(calculate_freshness_score(NOW - offset, NOW), baseline_freshness(NOW - offset, NOW), CURVE_TOLERANCE);
+}
+
+void test_boundaries() {
+    for (int64_t offset : boundary_offsets()) {
+        check_offset(offset);
+    }
+
+    // Exact values at the segment ends
+    CHECK(calculate_urgency_score(NOW, NOW) == 0.5);
+    CHECK(calculate_urgency_score(NOW + 2 * HOUR - 1, NOW) == 1.0);
+    CHECK_NEAR(calculate_urgency_score(NOW + 2 * HOUR, NOW), 0.8, CURVE_TOLERANCE);
+    CHECK_NEAR(calculate_urgency_score(NOW + 24 * HOUR, NOW), 0.5, CURVE_TOLERANCE);
+    CHECK_NEAR(calculate_urgency_score(NOW + 72 * HOUR, NOW), 0.4, CURVE_TOLERANCE);
+    CHECK(calculate_urgency_score(NOW + 168 * HOUR, NOW) == 0.2);
+    CHECK(calculate_freshness_score(NOW - HOUR + 1, NOW) == 1.0);
+    CHECK_NEAR(calculate_freshness_score(NOW - HOUR, NOW), 0.9, CURVE_TOLERANCE);
+    CHECK_NEAR(calculate_freshness_score(NOW - 24 * HOUR, NOW), 0.5, CURVE_TOLERANCE);
+    CHECK_NEAR(calculate_freshness_score(NOW - 72 * HOUR, NOW), 0.4, CURVE_TOLERANCE);
+    CHECK(calculate_freshness_score(NOW - 168 * HOUR, NOW) == 0.2);
+}
+
+void test_past_events() {
+    // Started events are medium urgency; creation times in the future count as new
+    for (int64_t offset : {int64_t(-1), -HOUR, -DAY, -30 * DAY}) {
+        CHECK(calculate_urgency_score(NOW + offset, NOW) == 0.5);
+        CHECK(calculate_freshness_score(NOW - offset, NOW) == 1.0);
+        check_offset(offset);
+    }
+}
+
+void test_sweep() {
+    // Every 7 s over +-8 days, through all segments of both curves
+    double worst = 0.0;
+    for (int64_t offset = -8 * DAY; offset <= 8 * DAY; offset += 7) {
+        worst = std::max(worst, std::fabs(calculate_urgency_score(NOW + offset, NOW) -
+                                          baseline_urgency(NOW + offset, NOW)));
+        worst = std::max(worst, std::fabs(calculate_freshness_score(NOW - offset, NOW) -
+                                          baseline_freshness(NOW - offset, NOW)));
+    }
+    CHECK(worst <= CURVE_TOLERANCE);
+}
+
+void test_huge_deltas() {
+    for (int64_t offset : huge_offsets()) {
+        check_offset(offset);
+    }
+    constexpr int64_t MIN = std::numeric_limits<int64_t>::min();
+    constexpr int64_t MAX = std::numeric_limits<int64_t>::max();
+    CHECK(calculate_urgency_score(MAX, NOW) == baseline_urgency(MAX, NOW));
+    CHECK(calculate_urgency_score(MIN, NOW) == baseline_urgency(MIN, NOW));
+    CHECK(calculate_urgency_score(MAX, MIN) == baseline_urgency(MAX, MIN));
+    CHECK(calculate_urgency_score(MIN, MAX) == baseline_urgency(MIN, MAX));
+    CHECK(calculate_freshness_score(MIN, NOW) == baseline_freshness(MIN, NOW));
+    CHECK(calculate_freshness_score(MAX, NOW) == baseline_freshness(MAX, NOW));
+    CHECK(calculate_freshness_score(MIN, MAX) == baseline_freshness(MIN, MAX));
+    CHECK(calculate_freshness_score(MAX, MIN) == baseline_freshness(MAX, MIN));
+}
+
+void test_batch_matches_scalar() {
+    std::vector<int64_t> times;
+    for (int64_t offset : boundary_offsets()) {
+        times.push_back(NOW + offset);
+    }
+    for (int64_t offset : huge_offsets()) {
+        times.push_back(NOW + offset);
+    }
+    for (int64_t offset = -8 * DAY; offset <= 8 * DAY; offset += 997) {
+        times.push_back(NOW + offset);
+    }
+    times.push_back(std::numeric_limits<int64_t>::min());
+    times.push_back(std::numeric_limits<int64_t>::max());
+
+    std::vector<double> urgency(times.size()), freshness(times.size());
+    calculate_urgency_scores(times.data(), times.size(), NOW, urgency.data());
+    calculate_freshness_scores(times.data(), times.size(), NOW, freshness.data());
+    size_t mismatches = 0;
+    for (size_t i = 0; i < times.size(); ++i) {
+        mismatches += urgency[i] != calculate_urgency_score(times[i], NOW) ? 1 : 0;
+        mismatches += freshness[i] != calculate_freshness_score(times[i], NOW) ? 1 : 0;
+    }
+    CHECK(mismatches == 0);
+}
+
+} // namespace
+
+int main() {
+    test_boundaries();
+    test_past_events();
+    test_sweep();
+    test_huge_deltas();
+    test_batch_matches_scalar();
+    return check_result();
+}
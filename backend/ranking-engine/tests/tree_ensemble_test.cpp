@@ -0,0 +1,104 @@
+#include "check.h"
+#include "tree_ensemble.h"
+#include <stdexcept>
+#include <string>
+
+using namespace zerocost;
+
+namespace {
+
+const char* XGBOOST_MODEL = R"([
+    {"nodeid": 0, "split": "distance_km", "split_condition": 1.0, "yes": 1, "no": 2, "children": [
+        {"nodeid": 1, "leaf": 2.0},
+        {"nodeid": 2, "leaf": -1.0}
+    ]}
+])";
+
+const char* LIGHTGBM_MODEL = R"({
+    "feature_names": ["view_count"],
+    "tree_info": [{"tree_structure": {
+        "split_feature": 0, "threshold": 10.0, "decision_type": "<=",
+        "left_child": {"leaf_value": 1.0},
+        "right_child": {"leaf_value": 3.0}
+    }}]
+})";
+
+// Scores for two events: distance 0.5 km with 5 views, 2 km with 50
+void check_scores(const TreeEnsemble& model, double first, double second) {
+    double zeros[2] = {0.0, 0.0};
+    double distance_km[2] = {0.5, 2.0};
+    double view_count[2] = {5.0, 50.0};
+    ModelFeatures features;
+    features.fill(zeros);
+    features[static_cast<size_t>(ModelFeature::DistanceKm)] = distance_km;
+    features[static_cast<size_t>(ModelFeature::ViewCount)] = view_count;
+    double scores[2] = {0.0, 0.0};
+    model.predict(features, 2, scores);
+    CHECK(scores[0] == first);
+    CHECK(scores[1] == second);
+}
+
+// Malformed models must fail with runtime_error (which model loading and
+// profile reloads catch), never with a json exception or a crash
+bool rejected(const std::string& text) {
+    try {
+        TreeEnsemble::parse(text, "test");
+    } catch (const std::runtime_error&) {
+        return true;
+    } catch (...) {
+        return false;
+    }
+    return false;
+}
+
+void test_valid_models() {
+    check_scores(*TreeEnsemble::parse(XGBOOST_MODEL, "xgboost"), 2.0, -1.0);
+    check_scores(*TreeEnsemble::parse(LIGHTGBM_MODEL, "lightgbm"), 1.0, 3.0);
+}
+
+void test_malformed_xgboost() {
+    CHECK(rejected("[3]"));
+    CHECK(rejected("[[]]"));
+    CHECK(rejected("[]"));
+    CHECK(rejected(R"([{"leaf": "x"}])"));
+    CHECK(rejected(R"([{"split": 3, "split_condition": 1, "yes": 1, "no": 2, "children": []}])"));
+    CHECK(rejected(R"([{"split": "f0", "split_condition": 1, "yes": 1, "no": 2, "children": {"a": 1}}])"));
+    CHECK(rejected(R"([{"split": "f0", "split_condition": 1, "yes": 1, "no": 2, "children": [5, "x"]}])"));
+    CHECK(rejected(R"([{"split": "f0", "split_condition": "1", "yes": 1, "no": 2,
+                        "children": [{"nodeid": 1, "leaf": 1}, {"nodeid": 2, "leaf": 2}]}])"));
+    CHECK(rejected(R"([{"split": "nope", "split_condition": 1, "yes": 1, "no": 2,
+                        "children": [{"nodeid": 1, "leaf": 1}, {"nodeid": 2, "leaf": 2}]}])"));
+    CHECK(rejected("[{\"leaf\": 1}"));
+}
+
+void test_malformed_lightgbm() {
+    auto model = [](const std::string& feature_names, const std::string& tree) {
+        return "{\"feature_names\": " + feature_names + ", \"tree_info\": [{\"tree_structure\": " + tree + "}]}";
+    };
+    const std::string leaf = R"({"leaf_value": 1})";
+    auto split = [&](const std::string& left, const std::string& decision) {
+        return R"({"split_feature": 0, "threshold": 1, "decision_type": )" + decision +
+               R"(, "left_child": )" + left + R"(, "right_child": )" + leaf + "}";
+    };
+
+    CHECK(rejected(model(R"(["view_count"])", split("3", "\"<=\""))));
+    CHECK(rejected(model(R"(["view_count"])", split("[1]", "\"<=\""))));
+    CHECK(rejected(model(R"(["view_count"])", split(leaf, "5"))));
+    CHECK(rejected(model(R"(["view_count"])", split(leaf, "\"==\""))));
+    CHECK(rejected(model(R"([1])", split(leaf, "\"<=\""))));
+    CHECK(rejected(model(R"("view_count")", split(leaf, "\"<=\""))));
+    CHECK(rejected(model(R"([])", split(leaf, "\"<=\""))));
+    CHECK(rejected(model(R"(["view_count"])", "[1]")));
+    CHECK(rejected(model(R"(["view_count"])", R"({"leaf_value": "x"})")));
+    CHECK(rejected(R"({"tree_info": [3]})"));
+    CHECK(rejected(R"({"tree_info": []})"));
+}
+
+} // namespace
+
+int main() {
+    test_valid_models();
+    test_malformed_xgboost();
+    test_malformed_lightgbm();
+    return check_result();
+}